@@ -6,6 +6,9 @@
 #include <cstdlib>
 #include <cstdint>
 #include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
 #include "bst.h"
 
 struct KeyError { };
@@ -21,19 +24,26 @@ class AVLNode : public Node<Key, Value>
 public:
     // Constructor/destructor.
     AVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
-    virtual ~AVLNode();
+    AVLNode(Key&& key, Value&& value, AVLNode<Key, Value>* parent);
+    ~AVLNode();
 
     // Getter/setter for the node's height.
     int8_t getBalance () const;
     void setBalance (int8_t balance);
     void updateBalance(int8_t diff);
 
+    // Plain AVLNodes keep no subtree size; see RankedAVLNode.
+    static const bool hasSize = false;
+    void updateSize();
+    bool hasValidSize() const;
+
     // Getters for parent, left, and right. These need to be redefined since they
-    // return pointers to AVLNodes - not plain Nodes. See the Node class in bst.h
-    // for more information.
-    virtual AVLNode<Key, Value>* getParent() const override;
-    virtual AVLNode<Key, Value>* getLeft() const override;
-    virtual AVLNode<Key, Value>* getRight() const override;
+    // return pointers to AVLNodes - not plain Nodes. They hide (rather than
+    // override) the Node getters, so the call is resolved at compile time.
+    // See the Node class in bst.h for more information.
+    AVLNode<Key, Value>* getParent() const;
+    AVLNode<Key, Value>* getLeft() const;
+    AVLNode<Key, Value>* getRight() const;
 
 protected:
     int8_t balance_;    // effectively a signed char
@@ -55,6 +65,16 @@ AVLNode<Key, Value>::AVLNode(const Key& key, const Value& value, AVLNode<Key, Va
 
 }
 
+/**
+* An explicit constructor that moves the key and value into the node.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>::AVLNode(Key&& key, Value&& value, AVLNode<Key, Value> *parent) :
+    Node<Key, Value>(std::move(key), std::move(value), parent), balance_(0)
+{
+
+}
+
 /**
 * A destructor which does nothing.
 */
@@ -92,7 +112,25 @@ void AVLNode<Key, Value>::updateBalance(int8_t diff)
 }
 
 /**
-* An overridden function for getting the parent since a static_cast is necessary to make sure
+* Does nothing, since a plain AVLNode has no subtree size to maintain.
+*/
+template<class Key, class Value>
+void AVLNode<Key, Value>::updateSize()
+{
+
+}
+
+/**
+* Always true, since a plain AVLNode has no subtree size to get wrong.
+*/
+template<class Key, class Value>
+bool AVLNode<Key, Value>::hasValidSize() const
+{
+    return true;
+}
+
+/**
+* A redefined function for getting the parent since a static_cast is necessary to make sure
 * that our node is a AVLNode.
 */
 template<class Key, class Value>
@@ -127,63 +165,311 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
 */
 
 
-template <class Key, class Value>
-class AVLTree : public BinarySearchTree<Key, Value>
+/**
+* A special kind of AVLNode that also records the number of nodes in its subtree,
+* which lets an AVLTree answer order-statistic queries (select and rank) in
+* logarithmic time. Use it through OrderStatisticTree below.
+*/
+template <typename Key, typename Value>
+class RankedAVLNode : public AVLNode<Key, Value>
 {
 public:
-    virtual void insert (const std::pair<const Key, Value> &new_item); // TODO
-    virtual void remove(const Key& key);  // TODO
-protected:
-    virtual void nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2);
+    RankedAVLNode(const Key& key, const Value& value, RankedAVLNode<Key, Value>* parent);
+    RankedAVLNode(Key&& key, Value&& value, RankedAVLNode<Key, Value>* parent);
 
-    // Add helper functions here
-    void insertFix(AVLNode<Key, Value>* node, int8_t diff);
-    void removeFix(AVLNode<Key, Value>* node, int8_t diff);
-    AVLNode<Key, Value>* rotateLeft(AVLNode<Key, Value>* x);
-    AVLNode<Key, Value>* rotateRight(AVLNode<Key, Value>* y);
+    static const bool hasSize = true;
+    size_t getSize() const;
+    void setSize(size_t size);
+    void updateSize();
+    bool hasValidSize() const;
+
+    RankedAVLNode<Key, Value>* getParent() const;
+    RankedAVLNode<Key, Value>* getLeft() const;
+    RankedAVLNode<Key, Value>* getRight() const;
+
+protected:
+    size_t size_;
 };
 
 /*
- * Recall: If key is already in the tree, you should 
- * overwrite the current value with the updated value.
- */
+  -------------------------------------------------
+  Begin implementations for the RankedAVLNode class.
+  -------------------------------------------------
+*/
+
+/**
+* An explicit constructor for a node that starts out as a leaf (size 1).
+*/
 template<class Key, class Value>
-void AVLTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
+RankedAVLNode<Key, Value>::RankedAVLNode(const Key& key, const Value& value, RankedAVLNode<Key, Value> *parent) :
+    AVLNode<Key, Value>(key, value, parent), size_(1)
 {
-    // Handle empty tree case
-    if (this->root_ == nullptr) {
-        this->root_ = new AVLNode<Key, Value>(new_item.first, new_item.second, nullptr);
-        return;
-    }
 
-    AVLNode<Key, Value>* curr = static_cast<AVLNode<Key, Value>*>(this->root_);
-    AVLNode<Key, Value>* parent = nullptr;
-    bool wentLeft = false;
+}
 
-    // Find insertion point
-    while (curr != nullptr) {
-        parent = curr;
-        if (new_item.first < curr->getKey()) {
-            curr = curr->getLeft();
-            wentLeft = true;
-        } 
-        else if (curr->getKey() < new_item.first) {
-            curr = curr->getRight();
-            wentLeft = false;
-        } 
-        else {
-            // Key already exists, update value and return
-            curr->setValue(new_item.second);
-            return;
+/**
+* An explicit constructor that moves the key and value into the node.
+*/
+template<class Key, class Value>
+RankedAVLNode<Key, Value>::RankedAVLNode(Key&& key, Value&& value, RankedAVLNode<Key, Value> *parent) :
+    AVLNode<Key, Value>(std::move(key), std::move(value), parent), size_(1)
+{
+
+}
+
+/**
+* A getter for the number of nodes in the subtree rooted at this node.
+*/
+template<class Key, class Value>
+size_t RankedAVLNode<Key, Value>::getSize() const
+{
+    return size_;
+}
+
+/**
+* A setter for the subtree size.
+*/
+template<class Key, class Value>
+void RankedAVLNode<Key, Value>::setSize(size_t size)
+{
+    size_ = size;
+}
+
+/**
+* Recomputes the subtree size from the sizes of the children.
+*/
+template<class Key, class Value>
+void RankedAVLNode<Key, Value>::updateSize()
+{
+    size_ = 1;
+    if (getLeft() != nullptr) size_ += getLeft()->getSize();
+    if (getRight() != nullptr) size_ += getRight()->getSize();
+}
+
+/**
+* Checks the subtree size against the sizes of the children.
+*/
+template<class Key, class Value>
+bool RankedAVLNode<Key, Value>::hasValidSize() const
+{
+    size_t size = 1;
+    if (getLeft() != nullptr) size += getLeft()->getSize();
+    if (getRight() != nullptr) size += getRight()->getSize();
+    return size_ == size;
+}
+
+/**
+* Redefined for the same reasons as in AVLNode.
+*/
+template<class Key, class Value>
+RankedAVLNode<Key, Value> *RankedAVLNode<Key, Value>::getParent() const
+{
+    return static_cast<RankedAVLNode<Key, Value>*>(this->parent_);
+}
+
+/**
+* Redefined for the same reasons as in AVLNode.
+*/
+template<class Key, class Value>
+RankedAVLNode<Key, Value> *RankedAVLNode<Key, Value>::getLeft() const
+{
+    return static_cast<RankedAVLNode<Key, Value>*>(this->left_);
+}
+
+/**
+* Redefined for the same reasons as in AVLNode.
+*/
+template<class Key, class Value>
+RankedAVLNode<Key, Value> *RankedAVLNode<Key, Value>::getRight() const
+{
+    return static_cast<RankedAVLNode<Key, Value>*>(this->right_);
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the RankedAVLNode class.
+  -----------------------------------------------
+*/
+
+/**
+* An AVL tree. Compare orders the keys, as for BinarySearchTree.
+* NodeType selects the kind of node it is built from: plain
+* AVLNodes by default, or RankedAVLNodes to support select() and rank().
+* Any per-node bookkeeping is resolved at compile time, so a plain AVLTree
+* pays nothing for it.
+*/
+template <class Key, class Value, class Compare = ThreeWayCompare<Key>, class NodeType = AVLNode<Key, Value> >
+class AVLTree : public BinarySearchTree<Key, Value, Compare>
+{
+public:
+    AVLTree();
+    explicit AVLTree(const Compare& comp);
+    template<typename ForwardIt>
+    AVLTree(ForwardIt first, ForwardIt last, const Compare& comp = Compare());
+    AVLTree(AVLTree&& other);
+    AVLTree& operator=(AVLTree&& other);
+    virtual ~AVLTree();
+    virtual void remove(const Key& key);  // TODO
+
+    virtual bool isValid() const override;
+    virtual int height() const override;
+
+    // Order statistics, only available with RankedAVLNode
+    typename BinarySearchTree<Key, Value, Compare>::iterator select(size_t k) const;
+    size_t rank(const Key& key) const;
+
+    // Set operations in O(m log(n/m + 1)) for trees of m <= n items. Each one
+    // consumes other, leaving it empty, and relinks its nodes instead of
+    // allocating new ones.
+    void union_with(AVLTree&& other);
+    void intersect_with(AVLTree&& other);
+    void difference(AVLTree&& other);
+
+    // Splitting and concatenating by key range in O(log n), by relinking nodes
+    AVLTree split(const Key& key);
+    void join(AVLTree&& right);
+
+    // Bulk edits spread over several threads by key range
+    template<typename ForwardIt>
+    void insert_parallel(ForwardIt first, ForwardIt last, unsigned threads = std::thread::hardware_concurrency());
+    template<typename ForwardIt>
+    void erase_parallel(ForwardIt first, ForwardIt last, unsigned threads = std::thread::hardware_concurrency());
+protected:
+    virtual void nodeSwap( NodeType* n1, NodeType* n2);
+
+    // Add helper functions here
+    void insertFix(NodeType* node, int8_t diff);
+    void removeFix(NodeType* node, int8_t diff);
+    NodeType* rotateLeft(NodeType* x);
+    NodeType* rotateRight(NodeType* y);
+    void updateSizes(NodeType* node);
+
+    // Per-node check for auditSubtree(): the subtree must be height-balanced
+    // and the stored balance (and size, if any) must match it
+    struct BalanceFactors {
+        bool operator()(Node<Key, Value>* node, int leftHeight, int rightHeight) const
+        {
+            NodeType* n = static_cast<NodeType*>(node);
+            return abs(leftHeight - rightHeight) <= 1 &&
+                   n->getBalance() == leftHeight - rightHeight &&
+                   n->hasValidSize();
         }
+    };
+    // Join-based building blocks for the set operations. Subtrees are passed
+    // along with their heights (0 for an empty subtree), which the balance
+    // factors keep exact, so no height is ever recomputed.
+    static int leftChildHeight(NodeType* node, int height);
+    static int rightChildHeight(NodeType* node, int height);
+    NodeType* attach(NodeType* left, int leftHeight, NodeType* mid, NodeType* right, int rightHeight, int& height);
+    NodeType* joinSubtrees(NodeType* left, int leftHeight, NodeType* mid, NodeType* right, int rightHeight, int& height);
+    NodeType* joinRight(NodeType* left, int leftHeight, NodeType* mid, NodeType* right, int rightHeight, int& height);
+    NodeType* joinLeft(NodeType* left, int leftHeight, NodeType* mid, NodeType* right, int rightHeight, int& height);
+    NodeType* concatSubtrees(NodeType* left, int leftHeight, NodeType* right, int rightHeight, int& height);
+    NodeType* splitLast(NodeType* root, int height, NodeType*& last, int& restHeight);
+    NodeType* splitSubtree(NodeType* root, int height, const Key& key,
+                    NodeType*& left, int& leftHeight, NodeType*& right, int& rightHeight);
+    NodeType* unionOf(NodeType* a, int aHeight, NodeType* b, int bHeight, int& height);
+    NodeType* intersectionOf(NodeType* a, int aHeight, NodeType* b, int bHeight, int& height);
+    NodeType* differenceOf(NodeType* a, int aHeight, NodeType* b, int bHeight, int& height);
+    NodeType* takeNodes(AVLTree& other, int& height);
+    void resetSize(std::true_type hasSize);
+    void resetSize(std::false_type hasSize);
+
+    // Helpers for the parallel bulk edits
+    static const size_t MIN_ITEMS_PER_PIECE = 4096;
+    static size_t pieceCount(size_t items, unsigned threads);
+    template<typename Fn>
+    static std::exception_ptr forEachParallel(size_t tasks, unsigned threads, Fn task);
+    template<typename T, typename Less>
+    static void sortParallel(std::vector<T>& items, unsigned threads, Less less);
+    void cutInto(std::vector<AVLTree>& pieces, const std::vector<const Key*>& cuts);
+    void gather(std::vector<AVLTree>& pieces);
+    void setRoot(NodeType* root);
+
+    virtual void linkFix(Node<Key, Value>* node) override;
+    virtual Node<Key, Value>* createNode(const Key& key, const Value& value, Node<Key, Value>* parent) override;
+    virtual Node<Key, Value>* createNode(Key&& key, Value&& value, Node<Key, Value>* parent) override;
+    virtual void destroyNode(Node<Key, Value>* node) override;
+    virtual void destroyAllNodes() override;
+    virtual void buildFix(Node<Key, Value>* node, int leftHeight, int rightHeight) override;
+};
+
+/**
+* Default constructor for an empty AVLTree.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+AVLTree<Key, Value, Compare, NodeType>::AVLTree()
+{
+
+}
+
+/**
+* Constructor for an empty AVLTree that orders its keys with the given comparator.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+AVLTree<Key, Value, Compare, NodeType>::AVLTree(const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(comp)
+{
+
+}
+
+/**
+* Constructs a balanced AVLTree from a range of key/value pairs sorted by
+* strictly increasing key, in linear time. See BinarySearchTree::assign().
+*/
+template<class Key, class Value, class Compare, class NodeType>
+template<typename ForwardIt>
+AVLTree<Key, Value, Compare, NodeType>::AVLTree(ForwardIt first, ForwardIt last, const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(comp)
+{
+    this->assign(first, last);
+}
+
+/**
+* Move constructor, which takes over the nodes of other and leaves it empty.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+AVLTree<Key, Value, Compare, NodeType>::AVLTree(AVLTree&& other) :
+    BinarySearchTree<Key, Value, Compare>(std::move(other))
+{
+
+}
+
+/**
+* Move assignment, which clears the tree and takes over the nodes of other.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+AVLTree<Key, Value, Compare, NodeType>& AVLTree<Key, Value, Compare, NodeType>::operator=(AVLTree&& other)
+{
+    BinarySearchTree<Key, Value, Compare>::operator=(std::move(other));
+    return *this;
+}
+
+/**
+* Destructor, which clears the tree while its nodes can still be
+* destroyed as AVLNodes.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+AVLTree<Key, Value, Compare, NodeType>::~AVLTree()
+{
+    this->clear();
+}
+
+/**
+ * Rebalances after insert (or any of its variants in BinarySearchTree)
+ * links a new leaf into the tree.
+ */
+template<class Key, class Value, class Compare, class NodeType>
+void AVLTree<Key, Value, Compare, NodeType>::linkFix(Node<Key, Value>* node)
+{
+    NodeType* newNode = static_cast<NodeType*>(node);
+    NodeType* parent = newNode->getParent();
+    if (parent == nullptr) {
+        return;
     }
+    updateSizes(parent);
 
-    // Create new node
-    AVLNode<Key, Value>* newNode = new AVLNode<Key, Value>(new_item.first, new_item.second, parent);
-    
-    // Link new node to parent
-    if (wentLeft) {
-        parent->setLeft(newNode);
+    if (parent->getLeft() == newNode) {
         // Update balance and fix if needed
         if (parent->getBalance() == 0) {
             parent->setBalance(1);
@@ -195,7 +481,6 @@ void AVLTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
         }
     } 
     else {
-        parent->setRight(newNode);
         // Update balance and fix if needed
         if (parent->getBalance() == 0) {
             parent->setBalance(-1);
@@ -208,15 +493,15 @@ void AVLTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
     }
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::insertFix(AVLNode<Key, Value>* node, int8_t diff)
+template<class Key, class Value, class Compare, class NodeType>
+void AVLTree<Key, Value, Compare, NodeType>::insertFix(NodeType* node, int8_t diff)
 {
     // Base case: reached root or no more propagation needed
     if (node == nullptr || node->getBalance() == 0) {
         return;
     }
 
-    AVLNode<Key, Value>* parent = node->getParent();
+    NodeType* parent = node->getParent();
     
     // Determine if node is left or right child of parent
     int8_t nextDiff = 0;
@@ -239,8 +524,8 @@ void AVLTree<Key, Value>::insertFix(AVLNode<Key, Value>* node, int8_t diff)
         } 
         else {
             // Left-right case
-            AVLNode<Key, Value>* leftChild = node->getLeft();
-            AVLNode<Key, Value>* rightGrandchild = leftChild->getRight();
+            NodeType* leftChild = node->getLeft();
+            NodeType* rightGrandchild = leftChild->getRight();
             rotateLeft(leftChild);
             rotateRight(node);
             
@@ -273,8 +558,8 @@ void AVLTree<Key, Value>::insertFix(AVLNode<Key, Value>* node, int8_t diff)
         } 
         else {
             // Right-left case
-            AVLNode<Key, Value>* rightChild = node->getRight();
-            AVLNode<Key, Value>* leftGrandchild = rightChild->getLeft();
+            NodeType* rightChild = node->getRight();
+            NodeType* leftGrandchild = rightChild->getLeft();
             rotateRight(rightChild);
             rotateLeft(node);
             
@@ -311,23 +596,24 @@ void AVLTree<Key, Value>::insertFix(AVLNode<Key, Value>* node, int8_t diff)
  * Recall: The writeup specifies that if a node has 2 children you
  * should swap with the predecessor and then remove.
  */
-template<class Key, class Value>
-void AVLTree<Key, Value>::remove(const Key& key)
+template<class Key, class Value, class Compare, class NodeType>
+void AVLTree<Key, Value, Compare, NodeType>::remove(const Key& key)
 {
-    AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(this->internalFind(key));
+    NodeType* node = static_cast<NodeType*>(this->internalFind(key));
     if (node == nullptr) {
         return;
     }
 
     // If node has two children, swap with predecessor
     if (node->getLeft() != nullptr && node->getRight() != nullptr) {
-        AVLNode<Key, Value>* pred = static_cast<AVLNode<Key, Value>*>(this->predecessor(node));
+        NodeType* pred = static_cast<NodeType*>(this->predecessor(node));
         nodeSwap(node, pred);
     }
 
     // Now node has at most one child
-    AVLNode<Key, Value>* parent = node->getParent();
-    AVLNode<Key, Value>* child = (node->getLeft() != nullptr) ? node->getLeft() : node->getRight();
+    this->unlinkBounds(node);
+    NodeType* parent = node->getParent();
+    NodeType* child = (node->getLeft() != nullptr) ? node->getLeft() : node->getRight();
     int8_t diff = 0;
 
     // Calculate balance factor change for parent
@@ -354,7 +640,9 @@ void AVLTree<Key, Value>::remove(const Key& key)
     }
 
     // Delete the node
-    delete node;
+    this->destroyNode(node);
+    this->size_--;
+    updateSizes(parent);
 
     // Rebalance the tree
     if (parent != nullptr) {
@@ -362,13 +650,13 @@ void AVLTree<Key, Value>::remove(const Key& key)
     }
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* node, int8_t diff)
+template<class Key, class Value, class Compare, class NodeType>
+void AVLTree<Key, Value, Compare, NodeType>::removeFix(NodeType* node, int8_t diff)
 {
     if (node == nullptr) return;
 
     // Calculate next node and diff for potential upward propagation
-    AVLNode<Key, Value>* parent = node->getParent();
+    NodeType* parent = node->getParent();
     int8_t nextDiff = 0;
     
     if (parent != nullptr) {
@@ -385,7 +673,7 @@ void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* node, int8_t diff)
     // Check if tree is now unbalanced
     if (node->getBalance() == 2) {
         // Left heavy
-        AVLNode<Key, Value>* leftChild = node->getLeft();
+        NodeType* leftChild = node->getLeft();
         
         // Determine rotation type based on left child's balance
         if (leftChild->getBalance() >= 0) {
@@ -405,7 +693,7 @@ void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* node, int8_t diff)
             }
         } else {
             // Left-right case
-            AVLNode<Key, Value>* rightGrandchild = leftChild->getRight();
+            NodeType* rightGrandchild = leftChild->getRight();
             rotateLeft(leftChild);
             rotateRight(node);
             
@@ -427,7 +715,7 @@ void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* node, int8_t diff)
         }
     } else if (node->getBalance() == -2) {
         // Right heavy
-        AVLNode<Key, Value>* rightChild = node->getRight();
+        NodeType* rightChild = node->getRight();
         
         // Determine rotation type based on right child's balance
         if (rightChild->getBalance() <= 0) {
@@ -447,7 +735,7 @@ void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* node, int8_t diff)
             }
         } else {
             // Right-left case
-            AVLNode<Key, Value>* leftGrandchild = rightChild->getLeft();
+            NodeType* leftGrandchild = rightChild->getLeft();
             rotateRight(rightChild);
             rotateLeft(node);
             
@@ -478,20 +766,89 @@ void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* node, int8_t diff)
     }
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::nodeSwap(AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
+template<class Key, class Value, class Compare, class NodeType>
+void AVLTree<Key, Value, Compare, NodeType>::nodeSwap(NodeType* n1, NodeType* n2)
 {
-    BinarySearchTree<Key, Value>::nodeSwap(n1, n2);
+    BinarySearchTree<Key, Value, Compare>::nodeSwap(n1, n2);
     int8_t tempB = n1->getBalance();
     n1->setBalance(n2->getBalance());
     n2->setBalance(tempB);
+    if (NodeType::hasSize) {
+        // Sizes belong to positions in the tree. Recomputing n1 both before
+        // and after n2 is right whichever of them ended up lower.
+        n1->updateSize();
+        n2->updateSize();
+        n1->updateSize();
+    }
 }
 
-template<class Key, class Value>
-AVLNode<Key, Value>* AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* x)
+/**
+* Allocates an AVLNode from the tree's arena instead of a plain Node.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+Node<Key, Value>* AVLTree<Key, Value, Compare, NodeType>::createNode(const Key& key, const Value& value, Node<Key, Value>* parent)
+{
+    void* block = this->pool_.allocate(sizeof(NodeType));
+    try {
+        return new (block) NodeType(key, value, static_cast<NodeType*>(parent));
+    }
+    catch (...) {
+        this->pool_.deallocate(block);
+        throw;
+    }
+}
+
+/**
+* Same as above, but moves the key and value into the node.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+Node<Key, Value>* AVLTree<Key, Value, Compare, NodeType>::createNode(Key&& key, Value&& value, Node<Key, Value>* parent)
 {
-    AVLNode<Key, Value>* y = x->getRight();
-    AVLNode<Key, Value>* parent = x->getParent();
+    void* block = this->pool_.allocate(sizeof(NodeType));
+    try {
+        return new (block) NodeType(std::move(key), std::move(value), static_cast<NodeType*>(parent));
+    }
+    catch (...) {
+        this->pool_.deallocate(block);
+        throw;
+    }
+}
+
+/**
+* Destroys a single AVLNode and puts its memory back on the arena's freelist.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+void AVLTree<Key, Value, Compare, NodeType>::destroyNode(Node<Key, Value>* node)
+{
+    static_cast<NodeType*>(node)->~NodeType();
+    this->pool_.deallocate(node);
+}
+
+/**
+* Destroys every node in the tree as an AVLNode.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+void AVLTree<Key, Value, Compare, NodeType>::destroyAllNodes()
+{
+    this->template clearHelper<NodeType>(this->root_);
+}
+
+/**
+* Sets the balance of a node built by assign() straight from the
+* heights of its subtrees, so no rotations are needed.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+void AVLTree<Key, Value, Compare, NodeType>::buildFix(Node<Key, Value>* node, int leftHeight, int rightHeight)
+{
+    static_cast<NodeType*>(node)->setBalance(leftHeight - rightHeight);
+    static_cast<NodeType*>(node)->updateSize();
+}
+
+template<class Key, class Value, class Compare, class NodeType>
+NodeType* AVLTree<Key, Value, Compare, NodeType>::rotateLeft(NodeType* x)
+{
+    NodeType* y = x->getRight();
+    NodeType* parent = x->getParent();
     
     // Perform rotation
     x->setRight(y->getLeft());
@@ -502,6 +859,8 @@ AVLNode<Key, Value>* AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* x)
     y->setLeft(x);
     x->setParent(y);
     y->setParent(parent);
+    x->updateSize();
+    y->updateSize();
     
     // Update parent pointers
     if (parent == nullptr) {
@@ -515,11 +874,11 @@ AVLNode<Key, Value>* AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* x)
     return y;
 }
 
-template<class Key, class Value>
-AVLNode<Key, Value>* AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* y)
+template<class Key, class Value, class Compare, class NodeType>
+NodeType* AVLTree<Key, Value, Compare, NodeType>::rotateRight(NodeType* y)
 {
-    AVLNode<Key, Value>* x = y->getLeft();
-    AVLNode<Key, Value>* parent = y->getParent();
+    NodeType* x = y->getLeft();
+    NodeType* parent = y->getParent();
     
     // Perform rotation
     y->setLeft(x->getRight());
@@ -530,6 +889,8 @@ AVLNode<Key, Value>* AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* y)
     x->setRight(y);
     y->setParent(x);
     x->setParent(parent);
+    y->updateSize();
+    x->updateSize();
     
     // Update parent pointers
     if (parent == nullptr) {
@@ -543,4 +904,812 @@ AVLNode<Key, Value>* AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* y)
     return x;
 }
 
-#endif
\ No newline at end of file
+/**
+* Checks every AVL invariant in one O(n) pass: keys in order, parent links,
+* the height balance of every subtree, and each node's stored balance (and
+* subtree size, if kept) against the actual heights of its subtrees, plus
+* the cached smallest and largest nodes.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+bool AVLTree<Key, Value, Compare, NodeType>::isValid() const
+{
+    if (this->root_ != nullptr && this->root_->getParent() != nullptr) return false;
+    if (this->smallest_ != this->getSmallestNode() || this->largest_ != this->getLargestNode()) return false;
+    return this->auditSubtree(this->root_, true, BalanceFactors()) != BinarySearchTree<Key, Value, Compare>::INVALID_HEIGHT;
+}
+
+/**
+* Returns the height of the tree in O(log n) by following the taller child
+* from the root, which the balance factors identify without visiting the
+* rest of the tree.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+int AVLTree<Key, Value, Compare, NodeType>::height() const
+{
+    int height = -1;
+    NodeType* curr = static_cast<NodeType*>(this->root_);
+    while (curr != nullptr) {
+        height++;
+        curr = (curr->getBalance() < 0) ? curr->getRight() : curr->getLeft();
+    }
+    return height;
+}
+
+/**
+* Recomputes the subtree sizes of node and all of its ancestors after a
+* node was linked below (or unlinked from below) it. Compiles away for
+* nodes that keep no size.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+void AVLTree<Key, Value, Compare, NodeType>::updateSizes(NodeType* node)
+{
+    if (!NodeType::hasSize) return;
+
+    for (; node != nullptr; node = node->getParent()) {
+        node->updateSize();
+    }
+}
+
+/**
+* Returns an iterator to the k-th smallest item (counting from 0), or the
+* end iterator if the tree has k or fewer items. O(log n).
+*/
+template<class Key, class Value, class Compare, class NodeType>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+AVLTree<Key, Value, Compare, NodeType>::select(size_t k) const
+{
+    static_assert(NodeType::hasSize, "select() needs RankedAVLNode (see OrderStatisticTree)");
+
+    NodeType* curr = static_cast<NodeType*>(this->root_);
+    while (curr != nullptr) {
+        size_t leftSize = (curr->getLeft() != nullptr) ? curr->getLeft()->getSize() : 0;
+        if (k < leftSize) {
+            curr = curr->getLeft();
+        } else if (k == leftSize) {
+            break;
+        } else {
+            k -= leftSize + 1;
+            curr = curr->getRight();
+        }
+    }
+    return this->makeIterator(curr);
+}
+
+/**
+* Returns the number of keys in the tree that are less than key. O(log n).
+*/
+template<class Key, class Value, class Compare, class NodeType>
+size_t AVLTree<Key, Value, Compare, NodeType>::rank(const Key& key) const
+{
+    static_assert(NodeType::hasSize, "rank() needs RankedAVLNode (see OrderStatisticTree)");
+
+    size_t below = 0;
+    NodeType* curr = static_cast<NodeType*>(this->root_);
+    while (curr != nullptr) {
+        if (compareKeys(this->comp_, curr->getKey(), key) < 0) {
+            below += 1 + ((curr->getLeft() != nullptr) ? curr->getLeft()->getSize() : 0);
+            curr = curr->getRight();
+        } else {
+            curr = curr->getLeft();
+        }
+    }
+    return below;
+}
+
+/**
+* Adds the items of other to the tree. Where both trees hold a key, the item
+* from other wins, as if each of its items had been insert()ed.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+void AVLTree<Key, Value, Compare, NodeType>::union_with(AVLTree&& other)
+{
+    if (&other == this) return;
+
+    int height = this->height() + 1;
+    NodeType* root = static_cast<NodeType*>(this->root_);
+    int otherHeight;
+    NodeType* otherRoot = takeNodes(other, otherHeight);
+    setRoot(unionOf(root, height, otherRoot, otherHeight, height));
+}
+
+/**
+* Keeps only the items whose keys are also in other.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+void AVLTree<Key, Value, Compare, NodeType>::intersect_with(AVLTree&& other)
+{
+    if (&other == this) return;
+
+    int height = this->height() + 1;
+    NodeType* root = static_cast<NodeType*>(this->root_);
+    int otherHeight;
+    NodeType* otherRoot = takeNodes(other, otherHeight);
+    setRoot(intersectionOf(root, height, otherRoot, otherHeight, height));
+}
+
+/**
+* Removes every item whose key is in other.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+void AVLTree<Key, Value, Compare, NodeType>::difference(AVLTree&& other)
+{
+    if (&other == this) {
+        this->clear();
+        return;
+    }
+
+    int height = this->height() + 1;
+    NodeType* root = static_cast<NodeType*>(this->root_);
+    int otherHeight;
+    NodeType* otherRoot = takeNodes(other, otherHeight);
+    setRoot(differenceOf(root, height, otherRoot, otherHeight, height));
+}
+
+/**
+* Moves every item with a key not less than key into a new tree, which is
+* returned; the items with smaller keys stay. Nodes are relinked, never copied
+* or allocated. O(log n). A plain AVLTree keeps no subtree sizes, so each
+* half counts its items on its first size() call instead.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+AVLTree<Key, Value, Compare, NodeType> AVLTree<Key, Value, Compare, NodeType>::split(const Key& key)
+{
+    AVLTree right(this->comp_);
+    right.pool_.share(this->pool_);
+
+    NodeType *l, *r;
+    int hl, hr;
+    NodeType* found = splitSubtree(static_cast<NodeType*>(this->root_), this->height() + 1, key, l, hl, r, hr);
+    if (found != nullptr) {
+        int height;
+        r = joinSubtrees(nullptr, 0, found, r, hr, height);
+    }
+    setRoot(l);
+    right.setRoot(r);
+
+    resetSize(std::integral_constant<bool, NodeType::hasSize>());
+    right.resetSize(std::integral_constant<bool, NodeType::hasSize>());
+    return right;
+}
+
+/**
+* Sets size() after split() left the tree with a new root, reading it off
+* the subtree size of the root.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+void AVLTree<Key, Value, Compare, NodeType>::resetSize(std::true_type hasSize)
+{
+    this->size_ = (this->root_ != nullptr) ? static_cast<NodeType*>(this->root_)->getSize() : 0;
+    this->sizeKnown_ = true;
+}
+
+/**
+* Same as above for nodes without subtree sizes, which leaves the count to
+* the first size() call.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+void AVLTree<Key, Value, Compare, NodeType>::resetSize(std::false_type hasSize)
+{
+    this->sizeKnown_ = false;
+}
+
+/**
+* Appends the items of right, whose keys must all be greater than every key
+* in the tree, and leaves right empty. Nodes are relinked, never copied or
+* allocated. O(log n). Throws std::invalid_argument (leaving both trees
+* unchanged) if the key ranges overlap.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+void AVLTree<Key, Value, Compare, NodeType>::join(AVLTree&& right)
+{
+    if (right.empty()) return;
+    if (&right == this ||
+        (!this->empty() && compareKeys(this->comp_, this->largest_->getKey(), right.smallest_->getKey()) >= 0)) {
+        throw std::invalid_argument("Trees to join have overlapping keys");
+    }
+
+    int height = this->height() + 1;
+    NodeType* root = static_cast<NodeType*>(this->root_);
+    int rightHeight;
+    NodeType* rightRoot = takeNodes(right, rightHeight);
+    setRoot(concatSubtrees(root, height, rightRoot, rightHeight, height));
+}
+
+/**
+* Inserts the key/value pairs of a range (in any order) using up to threads
+* threads. As with insert(), later items overwrite earlier ones with the
+* same key. The items are sorted in parallel, the tree is cut by key into
+* one piece per run of sorted items, every piece is merged with its run
+* (built into a balanced tree, then union_with()) on whichever thread is
+* free next, and the pieces are joined back together. Small batches just
+* use insert().
+*/
+template<class Key, class Value, class Compare, class NodeType>
+template<typename ForwardIt>
+void AVLTree<Key, Value, Compare, NodeType>::insert_parallel(ForwardIt first, ForwardIt last, unsigned threads)
+{
+    std::vector<std::pair<Key, Value> > items(first, last);
+    size_t pieceTotal = pieceCount(items.size(), threads);
+    if (pieceTotal <= 1) {
+        for (size_t i = 0; i < items.size(); ++i) {
+            this->insert(std::move(items[i]));
+        }
+        return;
+    }
+
+    sortParallel(items, threads, [this](const std::pair<Key, Value>& a, const std::pair<Key, Value>& b) {
+        return compareKeys(this->comp_, a.first, b.first) < 0;
+    });
+    // Keep only the last item of every run with equal keys
+    size_t kept = 0;
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (kept > 0 && compareKeys(this->comp_, items[kept - 1].first, items[i].first) == 0) {
+            items[kept - 1] = std::move(items[i]);
+        }
+        else {
+            if (kept != i) items[kept] = std::move(items[i]);
+            kept++;
+        }
+    }
+    items.erase(items.begin() + kept, items.end());
+
+    pieceTotal = pieceCount(items.size(), threads);
+    std::vector<size_t> bounds(pieceTotal + 1);
+    std::vector<const Key*> cuts;
+    for (size_t i = 0; i <= pieceTotal; ++i) {
+        bounds[i] = items.size() * i / pieceTotal;
+        if (i > 0 && i < pieceTotal) cuts.push_back(&items[bounds[i]].first);
+    }
+
+    std::vector<AVLTree> pieces;
+    cutInto(pieces, cuts);
+    std::exception_ptr error = forEachParallel(pieceTotal, threads, [&](size_t i) {
+        AVLTree run(this->comp_);
+        run.assign(items.begin() + bounds[i], items.begin() + bounds[i + 1]);
+        pieces[i].union_with(std::move(run));
+    });
+    gather(pieces);
+    if (error) std::rethrow_exception(error);
+}
+
+/**
+* Removes the keys of a range (in any order) using up to threads threads:
+* the keys are sorted in parallel, the tree is cut by key into one piece per
+* run of sorted keys, every piece removes its run on whichever thread is
+* free next, and the pieces are joined back together. Small batches just
+* use remove().
+*/
+template<class Key, class Value, class Compare, class NodeType>
+template<typename ForwardIt>
+void AVLTree<Key, Value, Compare, NodeType>::erase_parallel(ForwardIt first, ForwardIt last, unsigned threads)
+{
+    std::vector<Key> keys(first, last);
+    size_t pieceTotal = pieceCount(keys.size(), threads);
+    if (pieceTotal <= 1) {
+        for (size_t i = 0; i < keys.size(); ++i) {
+            remove(keys[i]);
+        }
+        return;
+    }
+
+    sortParallel(keys, threads, [this](const Key& a, const Key& b) {
+        return compareKeys(this->comp_, a, b) < 0;
+    });
+    keys.erase(std::unique(keys.begin(), keys.end(), [this](const Key& a, const Key& b) {
+        return compareKeys(this->comp_, a, b) == 0;
+    }), keys.end());
+
+    pieceTotal = pieceCount(keys.size(), threads);
+    std::vector<size_t> bounds(pieceTotal + 1);
+    std::vector<const Key*> cuts;
+    for (size_t i = 0; i <= pieceTotal; ++i) {
+        bounds[i] = keys.size() * i / pieceTotal;
+        if (i > 0 && i < pieceTotal) cuts.push_back(&keys[bounds[i]]);
+    }
+
+    std::vector<AVLTree> pieces;
+    cutInto(pieces, cuts);
+    std::exception_ptr error = forEachParallel(pieceTotal, threads, [&](size_t i) {
+        for (size_t k = bounds[i]; k < bounds[i + 1]; ++k) {
+            pieces[i].remove(keys[k]);
+        }
+    });
+    gather(pieces);
+    if (error) std::rethrow_exception(error);
+}
+
+/**
+* Returns how many pieces a parallel bulk edit of the given number of items
+* should cut the tree into: a few per thread so that a slow piece does not
+* hold up the rest, but never so many that a piece gets too small to pay
+* for its thread hand-off.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+size_t AVLTree<Key, Value, Compare, NodeType>::pieceCount(size_t items, unsigned threads)
+{
+    size_t pieces = std::max(threads, 1u) * size_t(4);
+    return std::min(pieces, items / MIN_ITEMS_PER_PIECE);
+}
+
+/**
+* Runs task(0) ... task(tasks - 1) on up to threads threads (the calling
+* one included). Each thread claims the next unclaimed task as soon as it
+* is free, so uneven tasks still keep every thread busy. Returns the first
+* exception thrown by a task, once every thread has finished.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+template<typename Fn>
+std::exception_ptr AVLTree<Key, Value, Compare, NodeType>::forEachParallel(size_t tasks, unsigned threads, Fn task)
+{
+    size_t workers = std::min<size_t>(std::max(threads, 1u), tasks);
+    std::atomic<size_t> next(0);
+    std::vector<std::exception_ptr> errors(workers);
+    auto work = [&](size_t worker) {
+        try {
+            for (size_t i = next++; i < tasks; i = next++) {
+                task(i);
+            }
+        }
+        catch (...) {
+            errors[worker] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t w = 1; w < workers; ++w) {
+        pool.push_back(std::thread(work, w));
+    }
+    work(0);
+    for (size_t w = 0; w < pool.size(); ++w) {
+        pool[w].join();
+    }
+    for (size_t w = 0; w < workers; ++w) {
+        if (errors[w]) return errors[w];
+    }
+    return std::exception_ptr();
+}
+
+/**
+* Stable-sorts items with up to threads threads: equal chunks are sorted
+* concurrently, then merged pairwise, each round of merges in parallel.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+template<typename T, typename Less>
+void AVLTree<Key, Value, Compare, NodeType>::sortParallel(std::vector<T>& items, unsigned threads, Less less)
+{
+    size_t chunks = std::min<size_t>(std::max(threads, 1u), items.size());
+    std::vector<size_t> bounds(chunks + 1);
+    for (size_t i = 0; i <= chunks; ++i) {
+        bounds[i] = items.size() * i / chunks;
+    }
+
+    std::exception_ptr error = forEachParallel(chunks, threads, [&](size_t i) {
+        std::stable_sort(items.begin() + bounds[i], items.begin() + bounds[i + 1], less);
+    });
+    for (size_t width = 1; !error && width < chunks; width *= 2) {
+        size_t merges = (chunks + 2 * width - 1) / (2 * width);
+        error = forEachParallel(merges, threads, [&](size_t m) {
+            size_t lo = 2 * width * m;
+            size_t mid = std::min(lo + width, chunks);
+            size_t hi = std::min(lo + 2 * width, chunks);
+            std::inplace_merge(items.begin() + bounds[lo], items.begin() + bounds[mid], items.begin() + bounds[hi], less);
+        });
+    }
+    if (error) std::rethrow_exception(error);
+}
+
+/**
+* Cuts the tree into cuts.size() + 1 pieces at the given (increasing) keys,
+* leaving the tree empty: piece i holds the keys from *cuts[i - 1] up to but
+* excluding *cuts[i]. Each piece gets an arena of its own, so pieces can be
+* edited on different threads; gather() puts everything back. While cut
+* off, a piece counts the items it gains or loses in size(), starting at 0.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+void AVLTree<Key, Value, Compare, NodeType>::cutInto(std::vector<AVLTree>& pieces, const std::vector<const Key*>& cuts)
+{
+    pieces.reserve(cuts.size() + 1);
+    for (size_t i = 0; i <= cuts.size(); ++i) {
+        pieces.push_back(AVLTree(this->comp_));
+    }
+
+    NodeType* rest = static_cast<NodeType*>(this->root_);
+    int restHeight = this->height() + 1;
+    for (size_t i = cuts.size(); i > 0; --i) {
+        NodeType *l, *r;
+        int hl, hr;
+        NodeType* found = splitSubtree(rest, restHeight, *cuts[i - 1], l, hl, r, hr);
+        if (found != nullptr) {
+            int height;
+            r = joinSubtrees(nullptr, 0, found, r, hr, height);
+        }
+        pieces[i].setRoot(r);
+        rest = l;
+        restHeight = hl;
+    }
+    pieces[0].setRoot(rest);
+
+    this->root_ = nullptr;
+    this->resetBounds();
+}
+
+/**
+* Joins the pieces made by cutInto() back into the tree, in order, and takes
+* their arenas back along with any nodes they allocated.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+void AVLTree<Key, Value, Compare, NodeType>::gather(std::vector<AVLTree>& pieces)
+{
+    NodeType* root = nullptr;
+    int height = 0;
+    for (size_t i = 0; i < pieces.size(); ++i) {
+        // Each piece's size() holds its change in size, which takeNodes() adds
+        int pieceHeight;
+        NodeType* pieceRoot = takeNodes(pieces[i], pieceHeight);
+        root = concatSubtrees(root, height, pieceRoot, pieceHeight, height);
+    }
+    setRoot(root);
+}
+
+/**
+* Returns the height of the left subtree of a node of the given height.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+int AVLTree<Key, Value, Compare, NodeType>::leftChildHeight(NodeType* node, int height)
+{
+    return (node->getBalance() < 0) ? height - 2 : height - 1;
+}
+
+/**
+* Returns the height of the right subtree of a node of the given height.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+int AVLTree<Key, Value, Compare, NodeType>::rightChildHeight(NodeType* node, int height)
+{
+    return (node->getBalance() > 0) ? height - 2 : height - 1;
+}
+
+/**
+* Makes left and right the children of mid, whose heights must differ by at
+* most one, and reports the height of the resulting subtree.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+NodeType* AVLTree<Key, Value, Compare, NodeType>::attach(NodeType* left, int leftHeight, NodeType* mid,
+                                                         NodeType* right, int rightHeight, int& height)
+{
+    mid->setLeft(left);
+    mid->setRight(right);
+    if (left != nullptr) left->setParent(mid);
+    if (right != nullptr) right->setParent(mid);
+    mid->setBalance(leftHeight - rightHeight);
+    mid->updateSize();
+    height = std::max(leftHeight, rightHeight) + 1;
+    return mid;
+}
+
+/**
+* Joins two AVL subtrees and a middle node, where every key in left is less
+* than mid's and every key in right is greater. Takes O(|leftHeight - rightHeight| + 1).
+*/
+template<class Key, class Value, class Compare, class NodeType>
+NodeType* AVLTree<Key, Value, Compare, NodeType>::joinSubtrees(NodeType* left, int leftHeight, NodeType* mid,
+                                                       NodeType* right, int rightHeight, int& height)
+{
+    if (leftHeight > rightHeight + 1) {
+        return joinRight(left, leftHeight, mid, right, rightHeight, height);
+    }
+    if (rightHeight > leftHeight + 1) {
+        return joinLeft(left, leftHeight, mid, right, rightHeight, height);
+    }
+    return attach(left, leftHeight, mid, right, rightHeight, height);
+}
+
+/**
+* joinSubtrees() when left is the taller subtree: walks down its right spine
+* to a subtree about as tall as right, attaches there and rebalances on the
+* way up.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+NodeType* AVLTree<Key, Value, Compare, NodeType>::joinRight(NodeType* left, int leftHeight, NodeType* mid,
+                                                            NodeType* right, int rightHeight, int& height)
+{
+    NodeType* l = left->getLeft();
+    NodeType* r = left->getRight();
+    int hl = leftChildHeight(left, leftHeight);
+    int hr = rightChildHeight(left, leftHeight);
+
+    if (hr <= rightHeight + 1) {
+        NodeType* x1 = (r != nullptr) ? r->getLeft() : nullptr;
+        NodeType* x2 = (r != nullptr) ? r->getRight() : nullptr;
+        int h1 = (r != nullptr) ? leftChildHeight(r, hr) : 0;
+        int h2 = (r != nullptr) ? rightChildHeight(r, hr) : 0;
+
+        int th;
+        NodeType* t = attach(r, hr, mid, right, rightHeight, th);
+        if (th <= hl + 1) {
+            return attach(l, hl, left, t, th, height);
+        }
+        // t leans left by too much: double rotation around r
+        int ha, hb;
+        NodeType* a = attach(l, hl, left, x1, h1, ha);
+        NodeType* b = attach(x2, h2, mid, right, rightHeight, hb);
+        return attach(a, ha, r, b, hb, height);
+    }
+
+    int th;
+    NodeType* t = joinRight(r, hr, mid, right, rightHeight, th);
+    if (th <= hl + 1) {
+        return attach(l, hl, left, t, th, height);
+    }
+    // Single left rotation
+    NodeType* t1 = t->getLeft();
+    NodeType* t2 = t->getRight();
+    int h1 = leftChildHeight(t, th);
+    int h2 = rightChildHeight(t, th);
+    int ha;
+    NodeType* a = attach(l, hl, left, t1, h1, ha);
+    return attach(a, ha, t, t2, h2, height);
+}
+
+/**
+* joinSubtrees() when right is the taller subtree. Mirror image of joinRight().
+*/
+template<class Key, class Value, class Compare, class NodeType>
+NodeType* AVLTree<Key, Value, Compare, NodeType>::joinLeft(NodeType* left, int leftHeight, NodeType* mid,
+                                                           NodeType* right, int rightHeight, int& height)
+{
+    NodeType* l = right->getLeft();
+    NodeType* r = right->getRight();
+    int hl = leftChildHeight(right, rightHeight);
+    int hr = rightChildHeight(right, rightHeight);
+
+    if (hl <= leftHeight + 1) {
+        NodeType* x1 = (l != nullptr) ? l->getLeft() : nullptr;
+        NodeType* x2 = (l != nullptr) ? l->getRight() : nullptr;
+        int h1 = (l != nullptr) ? leftChildHeight(l, hl) : 0;
+        int h2 = (l != nullptr) ? rightChildHeight(l, hl) : 0;
+
+        int th;
+        NodeType* t = attach(left, leftHeight, mid, l, hl, th);
+        if (th <= hr + 1) {
+            return attach(t, th, right, r, hr, height);
+        }
+        // t leans right by too much: double rotation around l
+        int ha, hb;
+        NodeType* a = attach(left, leftHeight, mid, x1, h1, ha);
+        NodeType* b = attach(x2, h2, right, r, hr, hb);
+        return attach(a, ha, l, b, hb, height);
+    }
+
+    int th;
+    NodeType* t = joinLeft(left, leftHeight, mid, l, hl, th);
+    if (th <= hr + 1) {
+        return attach(t, th, right, r, hr, height);
+    }
+    // Single right rotation
+    NodeType* t1 = t->getLeft();
+    NodeType* t2 = t->getRight();
+    int h1 = leftChildHeight(t, th);
+    int h2 = rightChildHeight(t, th);
+    int hb;
+    NodeType* b = attach(t2, h2, right, r, hr, hb);
+    return attach(t1, h1, t, b, hb, height);
+}
+
+/**
+* Joins two AVL subtrees without a middle node, using the largest node of
+* left as the middle one.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+NodeType* AVLTree<Key, Value, Compare, NodeType>::concatSubtrees(NodeType* left, int leftHeight,
+                                                                 NodeType* right, int rightHeight, int& height)
+{
+    if (left == nullptr) {
+        height = rightHeight;
+        return right;
+    }
+    NodeType* last;
+    int restHeight;
+    NodeType* rest = splitLast(left, leftHeight, last, restHeight);
+    return joinSubtrees(rest, restHeight, last, right, rightHeight, height);
+}
+
+/**
+* Detaches the largest node of a subtree and returns what is left of it.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+NodeType* AVLTree<Key, Value, Compare, NodeType>::splitLast(NodeType* root, int height, NodeType*& last, int& restHeight)
+{
+    NodeType* l = root->getLeft();
+    NodeType* r = root->getRight();
+    int hl = leftChildHeight(root, height);
+    if (r == nullptr) {
+        last = root;
+        restHeight = hl;
+        return l;
+    }
+    int th;
+    NodeType* t = splitLast(r, rightChildHeight(root, height), last, th);
+    return joinSubtrees(l, hl, root, t, th, restHeight);
+}
+
+/**
+* Splits a subtree into the keys less than key (left) and greater than key
+* (right). Returns the node holding key, detached from both, or NULL if
+* there is none. O(height).
+*/
+template<class Key, class Value, class Compare, class NodeType>
+NodeType* AVLTree<Key, Value, Compare, NodeType>::splitSubtree(NodeType* root, int height, const Key& key,
+                                                        NodeType*& left, int& leftHeight, NodeType*& right, int& rightHeight)
+{
+    if (root == nullptr) {
+        left = right = nullptr;
+        leftHeight = rightHeight = 0;
+        return nullptr;
+    }
+
+    NodeType* l = root->getLeft();
+    NodeType* r = root->getRight();
+    int hl = leftChildHeight(root, height);
+    int hr = rightChildHeight(root, height);
+    int cmp = compareKeys(this->comp_, key, root->getKey());
+
+    if (cmp == 0) {
+        left = l;
+        leftHeight = hl;
+        right = r;
+        rightHeight = hr;
+        return root;
+    }
+    NodeType* found;
+    NodeType* rest;
+    int restHeight;
+    if (cmp < 0) {
+        found = splitSubtree(l, hl, key, left, leftHeight, rest, restHeight);
+        right = joinSubtrees(rest, restHeight, root, r, hr, rightHeight);
+    }
+    else {
+        found = splitSubtree(r, hr, key, rest, restHeight, right, rightHeight);
+        left = joinSubtrees(l, hl, root, rest, restHeight, leftHeight);
+    }
+    return found;
+}
+
+/**
+* Returns the union of two detached subtrees, splitting a around each root
+* of b. Where both hold a key, b's node is kept and a's is destroyed.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+NodeType* AVLTree<Key, Value, Compare, NodeType>::unionOf(NodeType* a, int aHeight, NodeType* b, int bHeight, int& height)
+{
+    if (a == nullptr) {
+        height = bHeight;
+        return b;
+    }
+    if (b == nullptr) {
+        height = aHeight;
+        return a;
+    }
+
+    NodeType* bl = b->getLeft();
+    NodeType* br = b->getRight();
+    int hbl = leftChildHeight(b, bHeight);
+    int hbr = rightChildHeight(b, bHeight);
+    NodeType *al, *ar;
+    int hal, har;
+    NodeType* duplicate = splitSubtree(a, aHeight, b->getKey(), al, hal, ar, har);
+    if (duplicate != nullptr) {
+        this->destroyNode(duplicate);
+        this->size_--;
+    }
+
+    int hl, hr;
+    NodeType* l = unionOf(al, hal, bl, hbl, hl);
+    NodeType* r = unionOf(ar, har, br, hbr, hr);
+    return joinSubtrees(l, hl, b, r, hr, height);
+}
+
+/**
+* Returns the nodes of a whose keys are also in b, destroying all others.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+NodeType* AVLTree<Key, Value, Compare, NodeType>::intersectionOf(NodeType* a, int aHeight, NodeType* b, int bHeight, int& height)
+{
+    if (a == nullptr || b == nullptr) {
+        this->size_ -= this->destroySubtree(a) + this->destroySubtree(b);
+        height = 0;
+        return nullptr;
+    }
+
+    NodeType* bl = b->getLeft();
+    NodeType* br = b->getRight();
+    int hbl = leftChildHeight(b, bHeight);
+    int hbr = rightChildHeight(b, bHeight);
+    NodeType *al, *ar;
+    int hal, har;
+    NodeType* found = splitSubtree(a, aHeight, b->getKey(), al, hal, ar, har);
+    this->destroyNode(b);
+    this->size_--;
+
+    int hl, hr;
+    NodeType* l = intersectionOf(al, hal, bl, hbl, hl);
+    NodeType* r = intersectionOf(ar, har, br, hbr, hr);
+    if (found != nullptr) {
+        return joinSubtrees(l, hl, found, r, hr, height);
+    }
+    return concatSubtrees(l, hl, r, hr, height);
+}
+
+/**
+* Returns the nodes of a whose keys are not in b, destroying all others.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+NodeType* AVLTree<Key, Value, Compare, NodeType>::differenceOf(NodeType* a, int aHeight, NodeType* b, int bHeight, int& height)
+{
+    if (a == nullptr || b == nullptr) {
+        this->size_ -= this->destroySubtree(b);
+        height = (a == nullptr) ? 0 : aHeight;
+        return a;
+    }
+
+    NodeType* bl = b->getLeft();
+    NodeType* br = b->getRight();
+    int hbl = leftChildHeight(b, bHeight);
+    int hbr = rightChildHeight(b, bHeight);
+    NodeType *al, *ar;
+    int hal, har;
+    NodeType* found = splitSubtree(a, aHeight, b->getKey(), al, hal, ar, har);
+    this->destroyNode(b);
+    this->size_--;
+    if (found != nullptr) {
+        this->destroyNode(found);
+        this->size_--;
+    }
+
+    int hl, hr;
+    NodeType* l = differenceOf(al, hal, bl, hbl, hl);
+    NodeType* r = differenceOf(ar, har, br, hbr, hr);
+    return concatSubtrees(l, hl, r, hr, height);
+}
+
+/**
+* Moves every node of other (and the arena memory they live in) over to this
+* tree, leaving other empty. Returns other's old root and its height. The
+* caller must link the nodes into this tree; they are already counted in size().
+*/
+template<class Key, class Value, class Compare, class NodeType>
+NodeType* AVLTree<Key, Value, Compare, NodeType>::takeNodes(AVLTree& other, int& height)
+{
+    height = other.height() + 1;
+    NodeType* root = static_cast<NodeType*>(other.root_);
+
+    this->pool_.adopt(other.pool_);
+    this->size_ += other.size_;
+    this->sizeKnown_ = this->sizeKnown_ && other.sizeKnown_;
+    other.root_ = nullptr;
+    other.size_ = 0;
+    other.sizeKnown_ = true;
+    other.resetBounds();
+    return root;
+}
+
+/**
+* Installs the result of a set operation as the whole tree.
+*/
+template<class Key, class Value, class Compare, class NodeType>
+void AVLTree<Key, Value, Compare, NodeType>::setRoot(NodeType* root)
+{
+    if (root != nullptr) {
+        root->setParent(nullptr);
+    }
+    this->root_ = root;
+    this->resetBounds();
+}
+
+/**
+* An AVLTree that keeps subtree sizes so it can answer select() and rank().
+*/
+template <class Key, class Value, class Compare = ThreeWayCompare<Key> >
+using OrderStatisticTree = AVLTree<Key, Value, Compare, RankedAVLNode<Key, Value> >;
+
+#endif
@@ -0,0 +1,42 @@
+#include <chrono>
+#include <vector>
+#include "equal-paths.h"
+#include "bst-bench.h"
+
+using namespace std;
+
+// Links pool[first, last) into a balanced tree and returns its root
+static Node* buildBalanced(vector<Node>& pool, size_t first, size_t last)
+{
+    if (first == last) return nullptr;
+    size_t middle = first + (last - first) / 2;
+    pool[middle].left = buildBalanced(pool, first, middle);
+    pool[middle].right = buildBalanced(pool, middle + 1, last);
+    return &pool[middle];
+}
+
+Measurement benchEqualPaths(size_t nodes, size_t count)
+{
+    vector<Node> pool;
+    pool.reserve(nodes);
+    for (size_t i = 0; i < nodes; ++i) {
+        pool.push_back(Node(static_cast<int>(i)));
+    }
+    Node* root = buildBalanced(pool, 0, nodes);
+
+    // Every call visits the whole tree, so each one is a latency sample
+    size_t calls = (nodes == 0) ? 1 : (count + nodes - 1) / nodes;
+    Measurement result;
+    result.count = calls * nodes;
+    result.seconds = 0;
+    volatile bool sink = false;
+    for (size_t i = 0; i < calls; ++i) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        sink = equalPaths(root);
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        result.seconds += elapsed.count();
+        result.latencies.push_back(elapsed.count());
+    }
+    (void)sink;
+    return result;
+}
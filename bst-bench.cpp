@@ -0,0 +1,486 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "bst.h"
+#include "avlbst.h"
+#include "bst-bench.h"
+
+using namespace std;
+
+/**
+* Micro-benchmarks for BinarySearchTree, AVLTree and std::map, printed as
+* JSON on stdout. Every combination of tree, key type, key order and size
+* is timed on insert, find, iteration, remove and clear, and equalPaths()
+* is timed on a balanced tree of each size. Run with --help for options.
+*/
+
+static const size_t LATENCY_SAMPLES = 1000;
+
+struct Options {
+    vector<size_t> sizes;
+    vector<string> trees;
+    vector<string> keys;
+    vector<string> orders;
+    size_t degenerateLimit;
+    double zipfSkew;
+    unsigned seed;
+};
+
+struct Result {
+    string tree;
+    string key;
+    string order;
+    size_t size;
+    string operation;
+    Measurement measurement;
+    bool skipped;
+};
+
+typedef chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start)
+{
+    return chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+* Runs op(0) through op(count - 1), timing the whole loop and, on its own,
+* every stride-th call so that about LATENCY_SAMPLES latencies are kept.
+*/
+template<typename Op>
+Measurement measure(size_t count, Op op)
+{
+    size_t stride = max<size_t>(1, count / LATENCY_SAMPLES);
+    Measurement result;
+    result.count = count;
+    result.latencies.reserve(count / stride + 1);
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        if (i % stride == 0) {
+            Clock::time_point begin = Clock::now();
+            op(i);
+            result.latencies.push_back(secondsSince(begin));
+        }
+        else {
+            op(i);
+        }
+    }
+    result.seconds = secondsSince(start);
+    return result;
+}
+
+/**
+* Times one call that handles count items, such as a full scan.
+*/
+template<typename Op>
+Measurement measureOnce(size_t count, Op op)
+{
+    Measurement result;
+    result.count = count;
+    Clock::time_point start = Clock::now();
+    op();
+    result.seconds = secondsSince(start);
+    result.latencies.push_back(result.seconds);
+    return result;
+}
+
+/**
+* Draws ranks 0..n-1 from a Zipfian distribution with the given skew, by
+* the rejection-free method of Gray et al., "Quickly Generating
+* Billion-Record Synthetic Databases" (as used by YCSB).
+*/
+class ZipfianGenerator
+{
+public:
+    ZipfianGenerator(size_t n, double skew) :
+        n_(n),
+        theta_(skew)
+    {
+        zetaN_ = 0;
+        for (size_t i = 1; i <= n; ++i) {
+            zetaN_ += 1.0 / pow(static_cast<double>(i), theta_);
+        }
+        double zeta2 = 1.0 + 1.0 / pow(2.0, theta_);
+        alpha_ = 1.0 / (1.0 - theta_);
+        eta_ = (1.0 - pow(2.0 / n, 1.0 - theta_)) / (1.0 - zeta2 / zetaN_);
+    }
+
+    template<typename Rng>
+    size_t operator()(Rng& rng)
+    {
+        double u = uniform_real_distribution<double>(0.0, 1.0)(rng);
+        double uz = u * zetaN_;
+        if (uz < 1.0) return 0;
+        if (uz < 1.0 + pow(0.5, theta_)) return min<size_t>(1, n_ - 1);
+        size_t rank = static_cast<size_t>(n_ * pow(eta_ * u - eta_ + 1.0, alpha_));
+        return min(rank, n_ - 1);
+    }
+
+private:
+    size_t n_;
+    double theta_;
+    double zetaN_;
+    double alpha_;
+    double eta_;
+};
+
+/**
+* Returns the n keys to insert, in the given order, as integers in [0, n):
+*   sequential:  0, 1, 2, ...
+*   random:      a random permutation
+*   zipfian:     n Zipfian draws, so popular keys repeat (and overwrite)
+*                and the tree ends up smaller than n; popular ranks are
+*                scattered over the key range
+*   adversarial: 0, n-1, 1, n-2, ..., a zig-zag that makes a plain BST
+*                one long path and forces AVLTree into double rotations
+*/
+static vector<int> insertOrder(const string& order, size_t n, const Options& options, mt19937& rng)
+{
+    vector<int> keys(n);
+    if (order == "sequential" || order == "random") {
+        for (size_t i = 0; i < n; ++i) keys[i] = static_cast<int>(i);
+        if (order == "random") shuffle(keys.begin(), keys.end(), rng);
+    }
+    else if (order == "zipfian") {
+        ZipfianGenerator zipf(n, options.zipfSkew);
+        for (size_t i = 0; i < n; ++i) {
+            keys[i] = static_cast<int>((zipf(rng) * 2654435761u) % n);
+        }
+    }
+    else {
+        size_t low = 0;
+        size_t high = n;
+        for (size_t i = 0; i < n; ++i) {
+            keys[i] = static_cast<int>((i % 2 == 0) ? low++ : --high);
+        }
+    }
+    return keys;
+}
+
+/**
+* Returns the keys to look up: the same order as the inserts, which for
+* zipfian means lookups are skewed towards the popular keys too.
+*/
+static vector<int> findOrder(const string& order, const vector<int>& inserted, mt19937& rng)
+{
+    vector<int> keys(inserted);
+    if (order == "random" || order == "zipfian") shuffle(keys.begin(), keys.end(), rng);
+    return keys;
+}
+
+// Turns integer keys into the key type under test
+static int makeKey(int key, int*)
+{
+    return key;
+}
+
+static string makeKey(int key, string*)
+{
+    // Zero-padded, so strings sort in the same order as the integers
+    char buffer[24];
+    snprintf(buffer, sizeof(buffer), "key:%012d", key);
+    return buffer;
+}
+
+// Removes a key from the tree under test
+template<typename Key>
+void removeKey(map<Key, int>& tree, const Key& key)
+{
+    tree.erase(key);
+}
+
+template<typename Tree, typename Key>
+void removeKey(Tree& tree, const Key& key)
+{
+    tree.remove(key);
+}
+
+/**
+* Times every operation on one kind of tree for one workload, appending
+* the results.
+*/
+template<typename Tree, typename Key>
+void benchTree(const string& treeName, const string& keyName, const string& order, size_t n,
+               const Options& options, vector<Result>& results)
+{
+    Result base;
+    base.tree = treeName;
+    base.key = keyName;
+    base.order = order;
+    base.size = n;
+    base.skipped = false;
+
+    // A plain BST fed sorted or zig-zag keys degenerates into a list, so
+    // every operation is O(n): skip sizes that would take hours
+    if (treeName == "bst" && (order == "sequential" || order == "adversarial") && n > options.degenerateLimit) {
+        const char* operations[] = {"insert", "find", "iterate", "remove", "clear"};
+        for (const char* operation : operations) {
+            Result result = base;
+            result.operation = operation;
+            result.skipped = true;
+            results.push_back(result);
+        }
+        return;
+    }
+
+    mt19937 rng(options.seed);
+    vector<Key> inserts;
+    vector<Key> finds;
+    {
+        vector<int> order1 = insertOrder(order, n, options, rng);
+        vector<int> order2 = findOrder(order, order1, rng);
+        inserts.reserve(n);
+        finds.reserve(n);
+        for (size_t i = 0; i < n; ++i) {
+            inserts.push_back(makeKey(order1[i], static_cast<Key*>(nullptr)));
+            finds.push_back(makeKey(order2[i], static_cast<Key*>(nullptr)));
+        }
+    }
+    volatile size_t sink = 0;
+
+    {
+        Tree tree;
+        Result result = base;
+        result.operation = "insert";
+        result.measurement = measure(n, [&](size_t i) { tree.insert(make_pair(inserts[i], static_cast<int>(i))); });
+        results.push_back(result);
+
+        result.operation = "find";
+        result.measurement = measure(n, [&](size_t i) { sink += (tree.find(finds[i]) != tree.end()); });
+        results.push_back(result);
+
+        result.operation = "iterate";
+        result.measurement = measureOnce(tree.size(), [&]() {
+            size_t sum = 0;
+            for (typename Tree::iterator it = tree.begin(); it != tree.end(); ++it) {
+                sum += static_cast<size_t>(it->second);
+            }
+            sink += sum;
+        });
+        results.push_back(result);
+
+        result.operation = "remove";
+        result.measurement = measure(n, [&](size_t i) { removeKey(tree, finds[i]); });
+        results.push_back(result);
+    }
+    {
+        Tree tree;
+        for (size_t i = 0; i < n; ++i) {
+            tree.insert(make_pair(inserts[i], static_cast<int>(i)));
+        }
+        Result result = base;
+        result.operation = "clear";
+        result.measurement = measureOnce(tree.size(), [&]() { tree.clear(); });
+        results.push_back(result);
+    }
+    (void)sink;
+}
+
+template<typename Key>
+void benchKey(const string& keyName, const string& order, size_t n, const Options& options, vector<Result>& results)
+{
+    for (size_t t = 0; t < options.trees.size(); ++t) {
+        const string& tree = options.trees[t];
+        if (tree == "bst") {
+            benchTree<BinarySearchTree<Key, int>, Key>(tree, keyName, order, n, options, results);
+        }
+        else if (tree == "avl") {
+            benchTree<AVLTree<Key, int>, Key>(tree, keyName, order, n, options, results);
+        }
+        else {
+            benchTree<map<Key, int>, Key>(tree, keyName, order, n, options, results);
+        }
+    }
+}
+
+static double percentile(const vector<double>& sorted, double fraction)
+{
+    if (sorted.empty()) return 0;
+    size_t index = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+static void printResult(ostream& out, Result& result)
+{
+    out << "    {\"structure\": \"" << result.tree << "\", \"key\": \"" << result.key
+        << "\", \"order\": \"" << result.order << "\", \"size\": " << result.size
+        << ", \"operation\": \"" << result.operation << "\"";
+    if (result.skipped) {
+        out << ", \"skipped\": \"degenerate plain BST above --degenerate-limit\"}";
+        return;
+    }
+    Measurement& m = result.measurement;
+    sort(m.latencies.begin(), m.latencies.end());
+    double perOp = (m.count == 0) ? 0 : m.seconds / m.count;
+    out << ", \"count\": " << m.count
+        << ", \"seconds\": " << m.seconds
+        << ", \"ops_per_sec\": " << ((m.seconds > 0) ? m.count / m.seconds : 0)
+        << ", \"ns_per_op\": " << perOp * 1e9;
+    if (m.latencies.size() > 1) {
+        out << ", \"latency_ns\": {\"p50\": " << percentile(m.latencies, 0.50) * 1e9
+            << ", \"p90\": " << percentile(m.latencies, 0.90) * 1e9
+            << ", \"p99\": " << percentile(m.latencies, 0.99) * 1e9
+            << ", \"max\": " << m.latencies.back() * 1e9 << "}";
+    }
+    out << "}";
+}
+
+template<typename T>
+static void printList(ostream& out, const vector<T>& items, bool quoted)
+{
+    out << "[";
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (i > 0) out << ", ";
+        if (quoted) out << "\"" << items[i] << "\"";
+        else out << items[i];
+    }
+    out << "]";
+}
+
+static vector<string> splitList(const string& text)
+{
+    vector<string> items;
+    stringstream stream(text);
+    string item;
+    while (getline(stream, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+// Parses a size such as 1000, 10K, 1M or 100M
+static size_t parseSize(const string& text)
+{
+    char* end;
+    double value = strtod(text.c_str(), &end);
+    string suffix(end);
+    if (suffix == "K" || suffix == "k") value *= 1e3;
+    else if (suffix == "M" || suffix == "m") value *= 1e6;
+    else if (!suffix.empty() || value < 1) {
+        cerr << "Bad size: " << text << endl;
+        exit(1);
+    }
+    return static_cast<size_t>(value);
+}
+
+static void usage()
+{
+    cerr << "usage: bst-bench [options] > results.json\n"
+         << "  --sizes LIST            item counts, e.g. 1K,10K,100K,1M,10M,100M (default 1K,10K,100K,1M)\n"
+         << "  --trees LIST            any of bst,avl,map (default all)\n"
+         << "  --keys LIST             any of int,string (default all)\n"
+         << "  --orders LIST           any of sequential,random,zipfian,adversarial (default all)\n"
+         << "  --degenerate-limit N    largest size to run a plain BST on sorted or zig-zag keys (default 20K)\n"
+         << "  --zipf-skew S           skew of the zipfian order (default 0.99)\n"
+         << "  --seed N                random seed (default 1)\n";
+}
+
+static bool isAllowed(const vector<string>& items, const char* const* allowed, size_t count)
+{
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (find(allowed, allowed + count, items[i]) == allowed + count) return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    static const char* const TREES[] = {"bst", "avl", "map"};
+    static const char* const KEYS[] = {"int", "string"};
+    static const char* const ORDERS[] = {"sequential", "random", "zipfian", "adversarial"};
+
+    Options options;
+    options.sizes = {1000, 10000, 100000, 1000000};
+    options.trees.assign(TREES, TREES + 3);
+    options.keys.assign(KEYS, KEYS + 2);
+    options.orders.assign(ORDERS, ORDERS + 4);
+    options.degenerateLimit = 20000;
+    options.zipfSkew = 0.99;
+    options.seed = 1;
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--help" || i + 1 == argc) {
+            usage();
+            return (arg == "--help") ? 0 : 1;
+        }
+        string value = argv[++i];
+        if (arg == "--sizes") {
+            options.sizes.clear();
+            vector<string> sizes = splitList(value);
+            for (size_t j = 0; j < sizes.size(); ++j) options.sizes.push_back(parseSize(sizes[j]));
+        }
+        else if (arg == "--trees") options.trees = splitList(value);
+        else if (arg == "--keys") options.keys = splitList(value);
+        else if (arg == "--orders") options.orders = splitList(value);
+        else if (arg == "--degenerate-limit") options.degenerateLimit = parseSize(value);
+        else if (arg == "--zipf-skew") options.zipfSkew = atof(value.c_str());
+        else if (arg == "--seed") options.seed = static_cast<unsigned>(atoi(value.c_str()));
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if (!isAllowed(options.trees, TREES, 3) || !isAllowed(options.keys, KEYS, 2) ||
+        !isAllowed(options.orders, ORDERS, 4) || options.zipfSkew <= 0 || options.zipfSkew >= 1) {
+        usage();
+        return 1;
+    }
+
+    vector<Result> results;
+    for (size_t s = 0; s < options.sizes.size(); ++s) {
+        size_t n = options.sizes[s];
+        for (size_t k = 0; k < options.keys.size(); ++k) {
+            for (size_t o = 0; o < options.orders.size(); ++o) {
+                cerr << "size " << n << ", " << options.keys[k] << " keys, " << options.orders[o] << " order" << endl;
+                if (options.keys[k] == "int") {
+                    benchKey<int>(options.keys[k], options.orders[o], n, options, results);
+                }
+                else {
+                    benchKey<string>(options.keys[k], options.orders[o], n, options, results);
+                }
+            }
+        }
+
+        Result paths;
+        paths.tree = "equal-paths";
+        paths.key = "int";
+        paths.order = "balanced";
+        paths.size = n;
+        paths.operation = "equalPaths";
+        paths.measurement = benchEqualPaths(n, max<size_t>(n, 1000000));
+        paths.skipped = false;
+        results.push_back(paths);
+    }
+
+    cout << "{\n  \"benchmark\": \"bst-bench\",\n";
+#ifdef __VERSION__
+    cout << "  \"compiler\": \"" << __VERSION__ << "\",\n";
+#endif
+    cout << "  \"config\": {\"sizes\": ";
+    printList(cout, options.sizes, false);
+    cout << ", \"trees\": ";
+    printList(cout, options.trees, true);
+    cout << ", \"keys\": ";
+    printList(cout, options.keys, true);
+    cout << ", \"orders\": ";
+    printList(cout, options.orders, true);
+    cout << ", \"degenerate_limit\": " << options.degenerateLimit
+         << ", \"zipf_skew\": " << options.zipfSkew
+         << ", \"seed\": " << options.seed << "},\n";
+    cout << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        printResult(cout, results[i]);
+        cout << ((i + 1 < results.size()) ? ",\n" : "\n");
+    }
+    cout << "  ]\n}\n";
+    return 0;
+}
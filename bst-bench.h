@@ -0,0 +1,24 @@
+#ifndef BST_BENCH_H
+#define BST_BENCH_H
+
+#include <cstddef>
+#include <vector>
+
+/**
+* The timing of one operation of the benchmark, run count times: the total,
+* and the latencies of a sample of single runs, sorted.
+*/
+struct Measurement {
+    size_t count;
+    double seconds;
+    std::vector<double> latencies;
+};
+
+/**
+* Times equalPaths() on a tree of the given number of nodes, repeated until
+* at least count nodes have been visited. Lives in its own translation unit,
+* since equal-paths.h declares a Node struct that clashes with bst.h's.
+*/
+Measurement benchEqualPaths(size_t nodes, size_t count);
+
+#endif
@@ -3,23 +3,36 @@
 
 #include <iostream>
 #include <exception>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
 #include <utility>
+#include <iterator>
+#include <stdexcept>
+#include <new>
+#include <type_traits>
+#include <vector>
+#include <string>
+#include "node_arena.h"
 
 using namespace std;
 /**
  * A templated class for a Node in a search tree.
- * The getters for parent/left/right are virtual so
- * that they can be overridden for future kinds of
- * search trees, such as Red Black trees, Splay trees,
- * and AVL trees.
+ * The getters for parent/left/right are not virtual, so
+ * every child-pointer load on the search paths can be
+ * inlined and nodes carry no vtable pointer. Nodes for
+ * other kinds of search trees, such as AVL trees, redefine
+ * the getters to return their own node type.
  */
 template <typename Key, typename Value>
 class Node
 {
 public:
     Node(const Key& key, const Value& value, Node<Key, Value>* parent);
-    virtual ~Node();
+    Node(Key&& key, Value&& value, Node<Key, Value>* parent);
+    ~Node();
 
     const std::pair<const Key, Value>& getItem() const;
     std::pair<const Key, Value>& getItem();
@@ -27,9 +40,9 @@ public:
     const Value& getValue() const;
     Value& getValue();
 
-    virtual Node<Key, Value>* getParent() const;
-    virtual Node<Key, Value>* getLeft() const;
-    virtual Node<Key, Value>* getRight() const;
+    Node<Key, Value>* getParent() const;
+    Node<Key, Value>* getLeft() const;
+    Node<Key, Value>* getRight() const;
 
     void setParent(Node<Key, Value>* parent);
     void setLeft(Node<Key, Value>* left);
@@ -62,6 +75,19 @@ Node<Key, Value>::Node(const Key& key, const Value& value, Node<Key, Value>* par
 
 }
 
+/**
+* Constructor that moves the key and value into the node.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>::Node(Key&& key, Value&& value, Node<Key, Value>* parent) :
+    item_(std::move(key), std::move(value)),
+    parent_(parent),
+    left_(nullptr),
+    right_(nullptr)
+{
+
+}
+
 /**
 * Destructor, which does not need to do anything since the pointers inside of a node
 * are only used as references to existing nodes. The nodes pointed to by parent/left/right
@@ -119,7 +145,7 @@ Value& Node<Key, Value>::getValue()
 }
 
 /**
-* An implementation of the virtual function for retreiving the parent.
+* A getter for the parent.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getParent() const
@@ -128,7 +154,7 @@ Node<Key, Value>* Node<Key, Value>::getParent() const
 }
 
 /**
-* An implementation of the virtual function for retreiving the left child.
+* A getter for the left child.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getLeft() const
@@ -137,7 +163,7 @@ Node<Key, Value>* Node<Key, Value>::getLeft() const
 }
 
 /**
-* An implementation of the virtual function for retreiving the right child.
+* A getter for the right child.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getRight() const
@@ -187,24 +213,144 @@ void Node<Key, Value>::setValue(const Value& value)
   ---------------------------------------
 */
 
+/**
+* The default key comparison for the search trees. It is three-way: it returns
+* a negative number, zero or a positive number when a is less than, equal to or
+* greater than b, so a descent needs one comparison per level. It is also
+* transparent, so lookups can take any type that compares with Key (such as a
+* const char* for std::string keys) without building a temporary Key.
+*
+* The trees accept any comparator. One returning bool is treated as a strict
+* "less than", like std::less, and costs up to two calls per level.
+*/
+template <typename Key>
+struct ThreeWayCompare
+{
+    typedef void is_transparent;
+
+    template<typename A, typename B>
+    int operator()(const A& a, const B& b) const
+    {
+        return (a < b) ? -1 : ((b < a) ? 1 : 0);
+    }
+};
+
+/**
+* Strings already know how to compare themselves three ways in a single pass.
+*/
+template <>
+struct ThreeWayCompare<std::string>
+{
+    typedef void is_transparent;
+
+    int operator()(const std::string& a, const std::string& b) const
+    {
+        return a.compare(b);
+    }
+    int operator()(const std::string& a, const char* b) const
+    {
+        return a.compare(b);
+    }
+    int operator()(const char* a, const std::string& b) const
+    {
+        int c = b.compare(a);
+        return (c < 0) - (c > 0);
+    }
+};
+
+/**
+* Asks the CPU to start loading the cache line holding address, so a search
+* can overlap the miss with other work. Only a hint: it never faults, and
+* does nothing on compilers without the builtin.
+*/
+inline void prefetchRead(const void* address)
+{
+#if defined(__GNUC__)
+    __builtin_prefetch(address, 0, 3);
+#else
+    (void)address;
+#endif
+}
+
+/**
+* Compares two keys with comp and returns a negative number, zero or a
+* positive number like a three-way comparison. A comparator that returns
+* bool is taken to mean "less than" and may be called twice. Every tree in
+* this repo compares its keys through this.
+*/
+template<typename Compare, typename A, typename B>
+int compareKeys(const Compare& comp, const A& a, const B& b, std::true_type lessThan)
+{
+    if (comp(a, b)) return -1;
+    return comp(b, a) ? 1 : 0;
+}
+
+template<typename Compare, typename A, typename B>
+int compareKeys(const Compare& comp, const A& a, const B& b, std::false_type lessThan)
+{
+    return comp(a, b);
+}
+
+template<typename Compare, typename A, typename B>
+int compareKeys(const Compare& comp, const A& a, const B& b)
+{
+    return compareKeys(comp, a, b, typename std::is_same<decltype(comp(a, b)), bool>::type());
+}
+
 /**
 * A templated unbalanced binary search tree.
 */
-template <typename Key, typename Value>
+template <typename Key, typename Value, typename Compare = ThreeWayCompare<Key> >
 class BinarySearchTree
 {
 public:
+    class iterator;
+
     BinarySearchTree(); //TODO
+    explicit BinarySearchTree(const Compare& comp);
+    template<typename ForwardIt>
+    BinarySearchTree(ForwardIt first, ForwardIt last, const Compare& comp = Compare());
+    BinarySearchTree(BinarySearchTree&& other);
+    BinarySearchTree& operator=(BinarySearchTree&& other);
     virtual ~BinarySearchTree(); //TODO
-    virtual void insert(const std::pair<const Key, Value>& keyValuePair); //TODO
+    virtual std::pair<iterator, bool> insert(const std::pair<const Key, Value>& keyValuePair); //TODO
+    template<typename P, typename = typename std::enable_if<std::is_constructible<std::pair<Key, Value>, P&&>::value>::type>
+    std::pair<iterator, bool> insert(P&& keyValuePair);
+    iterator insert(iterator hint, const std::pair<const Key, Value>& keyValuePair);
+    template<typename P, typename = typename std::enable_if<std::is_constructible<std::pair<Key, Value>, P&&>::value>::type>
+    iterator insert(iterator hint, P&& keyValuePair);
+    template<typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args);
+    template<typename M>
+    std::pair<iterator, bool> insert_or_assign(const Key& key, M&& value);
+    template<typename M>
+    std::pair<iterator, bool> insert_or_assign(Key&& key, M&& value);
+    template<typename Fn>
+    std::pair<iterator, bool> upsert(const Key& key, Fn update);
+    template<typename Fn>
+    std::pair<iterator, bool> upsert(Key&& key, Fn update);
     virtual void remove(const Key& key); //TODO
+    template<typename ForwardIt>
+    void assign(ForwardIt first, ForwardIt last);
+    void save(const std::string& path) const;
+    void load(const std::string& path);
+    // Writes a snapshot from items handed over one at a time (see below)
+    class SnapshotWriter;
     void clear(); //TODO
     bool isBalanced() const; //TODO
+    virtual bool isValid() const;
+    virtual int height() const;
     void print() const;
     bool empty() const;
+    size_t size() const;
+    Compare key_comp() const;
 
-    template<typename PPKey, typename PPValue>
-    friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue> & tree);
+    template<typename PPKey, typename PPValue, typename PPCompare>
+    friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue, PPCompare> & tree);
 public:
     /**
     * An internal iterator class for traversing the contents of the BST.
@@ -212,6 +358,12 @@ public:
     class iterator  // TODO
     {
     public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef value_type* pointer;
+        typedef value_type& reference;
+
         iterator();
 
         std::pair<const Key,Value>& operator*() const;
@@ -221,23 +373,69 @@ public:
         bool operator!=(const iterator& rhs) const;
 
         iterator& operator++();
+        iterator operator++(int);
+        iterator& operator--();
+        iterator operator--(int);
 
     protected:
-        friend class BinarySearchTree<Key, Value>;
-        iterator(Node<Key,Value>* ptr);
+        friend class BinarySearchTree<Key, Value, Compare>;
+        iterator(Node<Key,Value>* ptr, const BinarySearchTree* tree);
         Node<Key, Value> *current_;
+        // The tree iterated over, so that end() can step back to the largest item
+        const BinarySearchTree* tree_;
+    };
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+
+    /**
+    * A view of the items with keys in a half-open interval, as returned by range().
+    */
+    class Range
+    {
+    public:
+        Range(iterator first, iterator last);
+
+        iterator begin() const;
+        iterator end() const;
+        bool empty() const;
+
+    private:
+        iterator first_;
+        iterator last_;
     };
 
 public:
     iterator begin() const;
     iterator end() const;
+    reverse_iterator rbegin() const;
+    reverse_iterator rend() const;
+    template<typename Fn>
+    void for_each(Fn visit) const;
     iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    std::pair<iterator, iterator> equal_range(const Key& key) const;
+    Range range(const Key& lo, const Key& hi) const;
+    template<typename ForwardIt, typename OutputIt>
+    OutputIt find_batch(ForwardIt first, ForwardIt last, OutputIt out) const;
+
+    // Heterogeneous lookups, available when Compare is transparent
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator find(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator lower_bound(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator upper_bound(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    std::pair<iterator, iterator> equal_range(const K& key) const;
     Value& operator[](const Key& key);
     Value const & operator[](const Key& key) const;
 
 protected:
     // Mandatory helper functions
-    Node<Key, Value>* internalFind(const Key& k) const; // TODO
+    template<typename K>
+    Node<Key, Value>* internalFind(const K& k) const; // TODO
+    // Number of searches find_batch() keeps in flight at once
+    static const size_t BATCH_WIDTH = 16;
     Node<Key, Value> *getSmallestNode() const;  // TODO
     static Node<Key, Value>* predecessor(Node<Key, Value>* current); // TODO
     // Note:  static means these functions don't have a "this" pointer
@@ -251,12 +449,82 @@ protected:
     Node<Key, Value> *getLargestNode() const;  // TODO
     bool balanced(Node<Key, Value>* current) const;
     int height(Node<Key, Value>* current) const;
+    template<typename NodeCheck>
+    int auditSubtree(Node<Key, Value>* root, bool checkLinks, NodeCheck check) const;
+
+    // Per-node checks for auditSubtree()
+    static const int INVALID_HEIGHT = -2;
+    struct AnyShape {
+        bool operator()(Node<Key, Value>* node, int leftHeight, int rightHeight) const { return true; }
+    };
+    struct HeightBalanced {
+        bool operator()(Node<Key, Value>* node, int leftHeight, int rightHeight) const { return abs(leftHeight - rightHeight) <= 1; }
+    };
     static Node<Key, Value>* succesor(Node<Key, Value>* current); // TODO
-    void clearHelper(Node<Key, Value>* node);
+    template<typename NodeType> void clearHelper(Node<Key, Value>* node);
+    template<typename ForwardIt>
+    Node<Key, Value>* buildSorted(ForwardIt& next, size_t count, int& height);
+    virtual void buildFix(Node<Key, Value>* node, int leftHeight, int rightHeight);
+    size_t destroySubtree(Node<Key, Value>* node);
+    iterator makeIterator(Node<Key, Value>* node) const;
+
+    // The snapshot format of save() and load(): this header, the items in
+    // key order as packed key and value bytes, then a checksum of all of it
+    struct SnapshotHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t keyBytes;
+        uint32_t valueBytes;
+        uint32_t byteOrder;
+        uint64_t count;
+    };
+    class SnapshotRecords;
+    static const uint32_t SNAPSHOT_VERSION = 1;
+    static const size_t SNAPSHOT_BUFFER_BYTES = 1 << 20;
+    static SnapshotHeader snapshotHeader(uint64_t count);
+    static uint64_t snapshotChecksum(uint64_t hash, const char* data, size_t bytes);
+
+    template<typename K>
+    Node<Key, Value>* lowerBoundNode(const K& k) const;
+    template<typename K>
+    Node<Key, Value>* upperBoundNode(const K& k) const;
+
+    // Single-descent insertion shared by every insert flavour
+    template<typename K>
+    Node<Key, Value>* findSlot(const K& key, Node<Key, Value>*& parent, int& side) const;
+    template<typename K>
+    Node<Key, Value>* findSlot(const K& key, Node<Key, Value>* hint, Node<Key, Value>*& parent, int& side) const;
+    void linkNode(Node<Key, Value>* node, Node<Key, Value>* parent, int side);
+    virtual void linkFix(Node<Key, Value>* node);
+    template<typename K, typename... Args>
+    std::pair<iterator, bool> tryEmplaceHelper(K&& key, Args&&... args);
+    template<typename K, typename M>
+    std::pair<iterator, bool> insertOrAssignHelper(K&& key, M&& value);
+    template<typename K, typename M>
+    std::pair<iterator, bool> assignOrLink(Node<Key, Value>* node, Node<Key, Value>* parent, int side, K&& key, M&& value);
+    template<typename K, typename Fn>
+    std::pair<iterator, bool> upsertHelper(K&& key, Fn& update);
+    void unlinkBounds(Node<Key, Value>* node);
+    void resetBounds();
+
+    // Node storage, shared with derived trees. Since nodes have no virtual
+    // destructor, each tree destroys its nodes as the type it created them as.
+    virtual Node<Key, Value>* createNode(const Key& key, const Value& value, Node<Key, Value>* parent);
+    virtual Node<Key, Value>* createNode(Key&& key, Value&& value, Node<Key, Value>* parent);
+    virtual void destroyNode(Node<Key, Value>* node);
+    virtual void destroyAllNodes();
 
 protected:
     Node<Key, Value>* root_;
-    // You should not need other data members
+    // size_ is exact unless sizeKnown_ is false (after splitting a tree
+    // that keeps no subtree sizes), in which case size() counts the items
+    mutable size_t size_;
+    mutable bool sizeKnown_;
+    // Cached ends of the tree, so hinted inserts at either end need no descent
+    Node<Key, Value>* smallest_;
+    Node<Key, Value>* largest_;
+    NodeArena pool_;
+    Compare comp_;
 };
 
 /*
@@ -266,22 +534,25 @@ Begin implementations for the BinarySearchTree::iterator class.
 */
 
 /**
-* Explicit constructor that initializes an iterator with a given node pointer.
+* Explicit constructor that initializes an iterator with a given node pointer
+* into tree.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator(Node<Key,Value> *ptr)
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::iterator::iterator(Node<Key,Value> *ptr, const BinarySearchTree* tree)
 {
     // TODO
     current_ = ptr;
+    tree_ = tree;
 }
 
 /**
 * A default constructor that initializes the iterator to NULL.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator() 
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::iterator::iterator() 
 {
     current_ = nullptr;
+    tree_ = nullptr;
     // TODO
 
 }
@@ -289,9 +560,9 @@ BinarySearchTree<Key, Value>::iterator::iterator()
 /**
 * Provides access to the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 std::pair<const Key,Value> &
-BinarySearchTree<Key, Value>::iterator::operator*() const
+BinarySearchTree<Key, Value, Compare>::iterator::operator*() const
 {
     return current_->getItem();
 }
@@ -299,9 +570,9 @@ BinarySearchTree<Key, Value>::iterator::operator*() const
 /**
 * Provides access to the address of the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 std::pair<const Key,Value> *
-BinarySearchTree<Key, Value>::iterator::operator->() const
+BinarySearchTree<Key, Value, Compare>::iterator::operator->() const
 {
     return &(current_->getItem());
 }
@@ -310,10 +581,10 @@ BinarySearchTree<Key, Value>::iterator::operator->() const
 * Checks if 'this' iterator's internals have the same value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 bool
-BinarySearchTree<Key, Value>::iterator::operator==(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, Compare>::iterator::operator==(
+    const BinarySearchTree<Key, Value, Compare>::iterator& rhs) const
 {
     // TODO
     return current_ == rhs.current_;
@@ -323,10 +594,10 @@ BinarySearchTree<Key, Value>::iterator::operator==(
 * Checks if 'this' iterator's internals have a different value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 bool
-BinarySearchTree<Key, Value>::iterator::operator!=(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, Compare>::iterator::operator!=(
+    const BinarySearchTree<Key, Value, Compare>::iterator& rhs) const
 {
     // TODO
     return current_ != rhs.current_;
@@ -336,14 +607,49 @@ BinarySearchTree<Key, Value>::iterator::operator!=(
 /**
 * Advances the iterator's location using an in-order sequencing
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator&
-BinarySearchTree<Key, Value>::iterator::operator++()
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator&
+BinarySearchTree<Key, Value, Compare>::iterator::operator++()
 {
     current_ = succesor(current_);
     return *this;
 }
 
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::iterator::operator++(int)
+{
+    iterator before = *this;
+    ++(*this);
+    return before;
+}
+
+/**
+* Moves the iterator back to the previous item in order. Stepping back
+* from end() lands on the largest item, which the tree keeps at hand.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator&
+BinarySearchTree<Key, Value, Compare>::iterator::operator--()
+{
+    if (current_ == nullptr) {
+        current_ = tree_->largest_;
+    }
+    else {
+        current_ = predecessor(current_);
+    }
+    return *this;
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::iterator::operator--(int)
+{
+    iterator before = *this;
+    --(*this);
+    return before;
+}
+
 /*
 -------------------------------------------------------------
 End implementations for the BinarySearchTree::iterator class.
@@ -351,258 +657,1397 @@ End implementations for the BinarySearchTree::iterator class.
 */
 
 /*
------------------------------------------------------
-Begin implementations for the BinarySearchTree class.
------------------------------------------------------
+-----------------------------------------------------------
+Begin implementations for the BinarySearchTree::Range class.
+-----------------------------------------------------------
 */
 
 /**
-* Default constructor for a BinarySearchTree, which sets the root to NULL.
+* Constructs a view of the items from first up to (not including) last.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::BinarySearchTree() 
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::Range::Range(iterator first, iterator last) :
+    first_(first),
+    last_(last)
 {
-    root_ = nullptr;
-    // TODO
+
 }
 
-template<typename Key, typename Value>
-BinarySearchTree<Key, Value>::~BinarySearchTree()
+/**
+* Returns an iterator to the first item in the view.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::Range::begin() const
 {
-    clear();
-    // TODO
+    return first_;
 }
 
 /**
- * Returns true if tree is empty
+* Returns an iterator one past the last item in the view.
 */
-template<class Key, class Value>
-bool BinarySearchTree<Key, Value>::empty() const
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::Range::end() const
 {
-    return root_ == nullptr;
+    return last_;
 }
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::print() const
+/**
+* Returns true if the view holds no items.
+*/
+template<class Key, class Value, class Compare>
+bool BinarySearchTree<Key, Value, Compare>::Range::empty() const
 {
-    printRoot(root_);
-    std::cout << "\n";
+    return first_ == last_;
 }
 
+/*
+---------------------------------------------------------
+End implementations for the BinarySearchTree::Range class.
+---------------------------------------------------------
+*/
+
 /**
-* Returns an iterator to the "smallest" item in the tree
+* A forward iterator over the packed records of a snapshot, which decodes
+* each one as it is read, so load() can hand them straight to assign().
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::begin() const
+template<typename Key, typename Value, typename Compare>
+class BinarySearchTree<Key, Value, Compare>::SnapshotRecords
 {
-    BinarySearchTree<Key, Value>::iterator begin(getSmallestNode());
-    return begin;
-}
+public:
+    struct Record {
+        Key first;
+        Value second;
+    };
+
+    explicit SnapshotRecords(const char* position);
+
+    const Record* operator->() const;
+    SnapshotRecords& operator++();
+    bool operator!=(const SnapshotRecords& rhs) const;
+
+private:
+    const char* position_;
+    mutable typename std::aligned_storage<sizeof(Record), alignof(Record)>::type record_;
+};
+
+/*
+--------------------------------------------------------------------
+Begin implementations for the BinarySearchTree::SnapshotRecords class.
+--------------------------------------------------------------------
+*/
 
 /**
-* Returns an iterator whose value means INVALID
+* Explicit constructor for the record starting at position.
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::end() const
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::SnapshotRecords::SnapshotRecords(const char* position) :
+    position_(position)
 {
-    BinarySearchTree<Key, Value>::iterator end(nullptr);
-    return end;
+
 }
 
 /**
-* Returns an iterator to the item with the given key, k
-* or the end iterator if k does not exist in the tree
+* Decodes the current record and provides access to its key and value.
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::find(const Key & k) const
+template<class Key, class Value, class Compare>
+const typename BinarySearchTree<Key, Value, Compare>::SnapshotRecords::Record*
+BinarySearchTree<Key, Value, Compare>::SnapshotRecords::operator->() const
 {
-    Node<Key, Value> *curr = internalFind(k);
-    BinarySearchTree<Key, Value>::iterator it(curr);
-    return it;
+    Record* record = reinterpret_cast<Record*>(&record_);
+    std::memcpy(&record->first, position_, sizeof(Key));
+    std::memcpy(&record->second, position_ + sizeof(Key), sizeof(Value));
+    return record;
 }
 
 /**
- * @precondition The key exists in the map
- * Returns the value associated with the key
- */
-template<class Key, class Value>
-Value& BinarySearchTree<Key, Value>::operator[](const Key& key)
+* Moves on to the next record.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::SnapshotRecords&
+BinarySearchTree<Key, Value, Compare>::SnapshotRecords::operator++()
 {
-    Node<Key, Value> *curr = internalFind(key);
-    if(curr == nullptr) throw std::out_of_range("Invalid key");
-    return curr->getValue();
+    position_ += sizeof(Key) + sizeof(Value);
+    return *this;
 }
-template<class Key, class Value>
-Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
+
+template<class Key, class Value, class Compare>
+bool BinarySearchTree<Key, Value, Compare>::SnapshotRecords::operator!=(const SnapshotRecords& rhs) const
 {
-    Node<Key, Value> *curr = internalFind(key);
-    if(curr == nullptr) throw std::out_of_range("Invalid key");
-    return curr->getValue();
+    return position_ != rhs.position_;
 }
 
+/*
+------------------------------------------------------------------
+End implementations for the BinarySearchTree::SnapshotRecords class.
+------------------------------------------------------------------
+*/
+
 /**
-* An insert method to insert into a Binary Search Tree.
-*
+* Writes a snapshot file in the format of save() and load() out of items
+* handed to it one at a time in increasing key order, so items held outside
+* a tree can be saved without building one first. save() writes through it.
 */
-template<class Key, class Value>
-void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair)
+template<typename Key, typename Value, typename Compare>
+class BinarySearchTree<Key, Value, Compare>::SnapshotWriter
 {
-  Node<Key, Value>* curr = root_;
-  Node<Key, Value>* parent = nullptr;
-  
-  while (curr != nullptr) {
-    parent = curr;
-    if (curr->getKey() < keyValuePair.first) {
-      curr = curr->getRight();
-    } else if (curr->getKey() > keyValuePair.first) {
-      curr = curr->getLeft();
-    } else {
-      curr->setValue(keyValuePair.second);
-      return;
-    }
-  }
-  Node<Key, Value>* newNode = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, parent);
-  if (parent == nullptr) {
-    root_ = newNode;
-  } else if (keyValuePair.first < parent->getKey()) {
-    parent->setLeft(newNode);
-  } else {
-    parent->setRight(newNode);
-  }
-}
+public:
+    SnapshotWriter(const std::string& path, uint64_t count);
+
+    void write(const Key& key, const Value& value);
+    void finish();
+
+    SnapshotWriter(const SnapshotWriter& other) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter& other) = delete;
+
+private:
+    std::string path_;
+    std::ofstream out_;
+    std::unique_ptr<char[]> buffer_;
+    size_t used_;
+    uint64_t hash_;
+    uint64_t remaining_;    // items still to write
+};
+
+/*
+-------------------------------------------------------------------
+Begin implementations for the BinarySearchTree::SnapshotWriter class.
+-------------------------------------------------------------------
+*/
 
 /**
-* A remove method to remove a specific key from a Binary Search Tree.
-* Recall: The writeup specifies that if a node has 2 children you
-* should swap with the predecessor and then remove.
+* Constructor, which opens a snapshot file of count items at path,
+* replacing any file there. Throws std::runtime_error if it cannot.
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::remove(const Key& key)
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::SnapshotWriter::SnapshotWriter(const std::string& path, uint64_t count) :
+    path_(path),
+    out_(path.c_str(), std::ios::binary | std::ios::trunc),
+    buffer_(new char[SNAPSHOT_BUFFER_BYTES + sizeof(Key) + sizeof(Value)]),
+    used_(sizeof(SnapshotHeader)),
+    hash_(0),
+    remaining_(count)
 {
-    // TODO
-    Node<Key, Value> *curr = internalFind(key);
-    if (curr == nullptr) return;
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                  "save() needs trivially copyable keys and values");
+    if (!out_) throw std::runtime_error("Cannot open " + path + " for writing");
 
-    Node<Key, Value>* parent = curr->getParent();
+    SnapshotHeader header = snapshotHeader(count);
+    std::memcpy(buffer_.get(), &header, sizeof(header));
+}
 
-    if (curr->getLeft() != nullptr && curr->getRight() != nullptr) {
-        Node<Key, Value>* pred = predecessor(curr);
-        nodeSwap(pred, curr);
-        parent = curr->getParent();
-    }
-    
-    // Now curr has at most one child
-    Node<Key, Value>* child = (curr->getLeft() != nullptr) ? curr->getLeft() : curr->getRight();
-    
-    if (child != nullptr) {
-        child->setParent(parent);
-    }
-    
-    if (parent == nullptr) {
-        root_ = child;
-    } else if (parent->getLeft() == curr) {
-        parent->setLeft(child);
-    } else {
-        parent->setRight(child);
+/**
+* Appends the next item. Records are gathered in a buffer, which is
+* checksummed and written out a multiple of 8 bytes at a time whenever it
+* fills up. Throws std::logic_error if the file already holds as many
+* items as it was opened for.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::SnapshotWriter::write(const Key& key, const Value& value)
+{
+    if (remaining_ == 0) throw std::logic_error("Too many items for the snapshot " + path_);
+    remaining_--;
+
+    std::memcpy(buffer_.get() + used_, &key, sizeof(Key));
+    std::memcpy(buffer_.get() + used_ + sizeof(Key), &value, sizeof(Value));
+    used_ += sizeof(Key) + sizeof(Value);
+    if (used_ >= SNAPSHOT_BUFFER_BYTES) {
+        size_t whole = used_ / 8 * 8;
+        hash_ = snapshotChecksum(hash_, buffer_.get(), whole);
+        out_.write(buffer_.get(), whole);
+        std::memmove(buffer_.get(), buffer_.get() + whole, used_ - whole);
+        used_ -= whole;
     }
-    
-    delete curr;
 }
 
-template<class Key, class Value>
-Node<Key, Value>*
-BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
+/**
+* Writes out the rest of the items and the checksum, and closes the file.
+* Throws std::logic_error if fewer items were written than the file was
+* opened for, and std::runtime_error if the file could not be written.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::SnapshotWriter::finish()
 {
-    // TODO
-    if (current == nullptr) return nullptr;
-    if (current->getLeft() != nullptr) {
-        Node<Key, Value>* temp = current->getLeft();
-        while (temp->getRight() != nullptr) {
-          temp = temp->getRight();
-        }
-        return temp;
-    } 
+    if (remaining_ != 0) throw std::logic_error("Too few items for the snapshot " + path_);
 
-    Node<Key, Value>* parent = current->getParent();
-    while (parent != nullptr && current == parent->getLeft()) {
-      current = parent;
-      parent = current->getParent();
-    }
-    
-    return parent;
+    hash_ = snapshotChecksum(hash_, buffer_.get(), used_);
+    out_.write(buffer_.get(), used_);
+    out_.write(reinterpret_cast<const char*>(&hash_), sizeof(hash_));
+    out_.close();
+    if (!out_) throw std::runtime_error("Failed writing " + path_);
 }
 
-template<class Key, class Value>
-Node<Key, Value>*
-BinarySearchTree<Key, Value>::succesor(Node<Key, Value>* current)
+/*
+-----------------------------------------------------------------
+End implementations for the BinarySearchTree::SnapshotWriter class.
+-----------------------------------------------------------------
+*/
+
+/*
+-----------------------------------------------------
+Begin implementations for the BinarySearchTree class.
+-----------------------------------------------------
+*/
+
+/**
+* Default constructor for a BinarySearchTree, which sets the root to NULL.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree() 
 {
+    root_ = nullptr;
+    size_ = 0;
+    sizeKnown_ = true;
+    smallest_ = nullptr;
+    largest_ = nullptr;
     // TODO
-    if (current == nullptr) return nullptr;
-    if (current->getRight() != nullptr) {
-        Node<Key, Value>* temp = current->getRight();
-        while (temp->getLeft() != nullptr) {
-          temp = temp->getLeft();
-        }
-        return temp;
-    } 
-    Node<Key, Value>* parent = current->getParent();
-    while (parent != nullptr && current == parent->getRight()) {
-      current = parent;
-      parent = current->getParent();
-    }
-    
-    return parent;
 }
 
 /**
-* A method to remove all contents of the tree and
-* reset the values in the tree for use again.
+* Constructor for an empty tree that orders its keys with the given comparator.
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::clear()
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree(const Compare& comp) :
+    comp_(comp)
 {
-  clearHelper(root_);
-  root_ = nullptr;
+    root_ = nullptr;
+    size_ = 0;
+    sizeKnown_ = true;
+    smallest_ = nullptr;
+    largest_ = nullptr;
 }
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::clearHelper(Node<Key, Value>* node)
+/**
+* Constructs a balanced tree from a range of key/value pairs sorted by
+* strictly increasing key. See assign().
+*/
+template<class Key, class Value, class Compare>
+template<typename ForwardIt>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree(ForwardIt first, ForwardIt last, const Compare& comp) :
+    comp_(comp)
 {
-  if (node == nullptr) return;
-  
-  clearHelper(node->getLeft());
-  clearHelper(node->getRight());
-  delete node;
+    root_ = nullptr;
+    size_ = 0;
+    sizeKnown_ = true;
+    smallest_ = nullptr;
+    largest_ = nullptr;
+    assign(first, last);
 }
 
 /**
-* A helper function to find the smallest node in the tree.
+* Move constructor, which takes over the nodes of other and leaves it empty.
 */
-template<typename Key, typename Value>
-Node<Key, Value>*
-BinarySearchTree<Key, Value>::getSmallestNode() const
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree(BinarySearchTree&& other) :
+    comp_(other.comp_)
 {
-    // TODO
-    if (root_ == nullptr) return nullptr;
-    
-    Node<Key, Value>* curr = root_;
-    while (curr->getLeft() != nullptr) {
-        curr = curr->getLeft();
-    }
-    return curr;
+    root_ = other.root_;
+    size_ = other.size_;
+    sizeKnown_ = other.sizeKnown_;
+    smallest_ = other.smallest_;
+    largest_ = other.largest_;
+    pool_.adopt(other.pool_);
+
+    other.root_ = nullptr;
+    other.size_ = 0;
+    other.sizeKnown_ = true;
+    other.smallest_ = nullptr;
+    other.largest_ = nullptr;
 }
 
 /**
-* A helper function to find the largest node in the tree.
+* Move assignment, which clears the tree and takes over the nodes of other.
 */
-template<typename Key, typename Value>
-Node<Key, Value>*
-BinarySearchTree<Key, Value>::getLargestNode() const
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>& BinarySearchTree<Key, Value, Compare>::operator=(BinarySearchTree&& other)
 {
-    // TODO
+    if (&other == this) return *this;
+
+    clear();
+    root_ = other.root_;
+    size_ = other.size_;
+    sizeKnown_ = other.sizeKnown_;
+    smallest_ = other.smallest_;
+    largest_ = other.largest_;
+    comp_ = other.comp_;
+    pool_.adopt(other.pool_);
+
+    other.root_ = nullptr;
+    other.size_ = 0;
+    other.sizeKnown_ = true;
+    other.smallest_ = nullptr;
+    other.largest_ = nullptr;
+    return *this;
+}
+
+template<typename Key, typename Value, typename Compare>
+BinarySearchTree<Key, Value, Compare>::~BinarySearchTree()
+{
+    clear();
+    // TODO
+}
+
+/**
+ * Returns true if tree is empty
+*/
+template<class Key, class Value, class Compare>
+bool BinarySearchTree<Key, Value, Compare>::empty() const
+{
+    return root_ == nullptr;
+}
+
+/**
+ * Returns the number of items in the tree. After the tree came out of a
+ * split() that could not count its items in O(log n), the first call counts
+ * them in O(n) and keeps the count; like any call that fills in a cache, it
+ * must not run alongside other reads of the tree.
+*/
+template<class Key, class Value, class Compare>
+size_t BinarySearchTree<Key, Value, Compare>::size() const
+{
+    if (!sizeKnown_) {
+        size_t count = 0;
+        for (iterator it = begin(); it != end(); ++it) {
+            count++;
+        }
+        size_ = count;
+        sizeKnown_ = true;
+    }
+    return size_;
+}
+
+/**
+ * Returns a copy of the comparator that orders the keys
+*/
+template<class Key, class Value, class Compare>
+Compare BinarySearchTree<Key, Value, Compare>::key_comp() const
+{
+    return comp_;
+}
+
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::print() const
+{
+    printRoot(root_);
+    std::cout << "\n";
+}
+
+/**
+* Returns an iterator to the "smallest" item in the tree, in O(1) time
+* since the tree keeps track of it
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::begin() const
+{
+    BinarySearchTree<Key, Value, Compare>::iterator begin(smallest_, this);
+    return begin;
+}
+
+/**
+* Returns an iterator whose value means INVALID
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::end() const
+{
+    BinarySearchTree<Key, Value, Compare>::iterator end(nullptr, this);
+    return end;
+}
+
+/**
+* Returns a reverse iterator to the "largest" item in the tree, in O(1) time
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::reverse_iterator
+BinarySearchTree<Key, Value, Compare>::rbegin() const
+{
+    return reverse_iterator(end());
+}
+
+/**
+* Returns the reverse iterator past the "smallest" item
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::reverse_iterator
+BinarySearchTree<Key, Value, Compare>::rend() const
+{
+    return reverse_iterator(begin());
+}
+
+/**
+* Calls visit on every item, in order. Faster than a loop over the
+* iterators for a full scan of a large tree: it keeps the path down in a
+* stack instead of climbing parent links, and prefetches the right child of
+* every node on the way down, so the node is usually in cache by the time
+* the scan turns right there.
+*/
+template<class Key, class Value, class Compare>
+template<typename Fn>
+void BinarySearchTree<Key, Value, Compare>::for_each(Fn visit) const
+{
+    std::vector<Node<Key, Value>*> pending;
+    Node<Key, Value>* node = root_;
+    while (true) {
+        for (; node != nullptr; node = node->getLeft()) {
+            prefetchRead(node->getRight());
+            pending.push_back(node);
+        }
+        if (pending.empty()) break;
+
+        node = pending.back();
+        pending.pop_back();
+        visit(node->getItem());
+        node = node->getRight();
+    }
+}
+
+/**
+* Returns an iterator to the item with the given key, k
+* or the end iterator if k does not exist in the tree
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::find(const Key & k) const
+{
+    Node<Key, Value> *curr = internalFind(k);
+    BinarySearchTree<Key, Value, Compare>::iterator it(curr, this);
+    return it;
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than k,
+* or the end iterator if there is none. Descends the tree once.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::lower_bound(const Key& k) const
+{
+    return iterator(lowerBoundNode(k), this);
+}
+
+/**
+* Returns an iterator to the first item whose key is greater than k,
+* or the end iterator if there is none. Descends the tree once.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::upper_bound(const Key& k) const
+{
+    return iterator(upperBoundNode(k), this);
+}
+
+/**
+* Returns the pair (lower_bound(k), upper_bound(k)), which spans the item
+* with key k if there is one and is empty otherwise.
+*/
+template<class Key, class Value, class Compare>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, typename BinarySearchTree<Key, Value, Compare>::iterator>
+BinarySearchTree<Key, Value, Compare>::equal_range(const Key& k) const
+{
+    iterator first = lower_bound(k);
+    iterator last = first;
+    if (last != end() && compareKeys(comp_, k, last->first) == 0) {
+        ++last;
+    }
+    return std::make_pair(first, last);
+}
+
+/**
+* Heterogeneous versions of find(), lower_bound(), upper_bound() and
+* equal_range(). They compare k directly against the stored keys.
+*/
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::find(const K& k) const
+{
+    return iterator(internalFind(k), this);
+}
+
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::lower_bound(const K& k) const
+{
+    return iterator(lowerBoundNode(k), this);
+}
+
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::upper_bound(const K& k) const
+{
+    return iterator(upperBoundNode(k), this);
+}
+
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, typename BinarySearchTree<Key, Value, Compare>::iterator>
+BinarySearchTree<Key, Value, Compare>::equal_range(const K& k) const
+{
+    iterator first = iterator(lowerBoundNode(k), this);
+    iterator last = first;
+    if (last != end() && compareKeys(comp_, k, last->first) == 0) {
+        ++last;
+    }
+    return std::make_pair(first, last);
+}
+
+/**
+* Returns a view of the items with keys in [lo, hi), in order. Finding the
+* start and end takes O(log n); walking the view takes O(k) more for k items.
+* The view is empty if hi is not greater than lo.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::Range
+BinarySearchTree<Key, Value, Compare>::range(const Key& lo, const Key& hi) const
+{
+    iterator first = lower_bound(lo);
+    if (compareKeys(comp_, lo, hi) >= 0) {
+        return Range(first, first);
+    }
+    return Range(first, lower_bound(hi));
+}
+
+/**
+* Looks up every key in [first, last) and writes, in the same order, an
+* iterator to its item (or end() if it is missing) to out. Returns out
+* advanced past the last iterator written.
+*
+* Up to BATCH_WIDTH searches advance in lockstep, one level each per round,
+* and each one prefetches the node it will visit next. By the time a round
+* comes back to a search, its node has usually arrived, so the cache misses
+* of different searches overlap instead of each find() stalling on its own
+* one level at a time. This pays off once the tree no longer fits in cache.
+*/
+template<class Key, class Value, class Compare>
+template<typename ForwardIt, typename OutputIt>
+OutputIt BinarySearchTree<Key, Value, Compare>::find_batch(ForwardIt first, ForwardIt last, OutputIt out) const
+{
+    const Key* keys[BATCH_WIDTH];
+    Node<Key, Value>* current[BATCH_WIDTH];
+    Node<Key, Value>* found[BATCH_WIDTH];
+
+    while (first != last) {
+        size_t width = 0;
+        for (; width < BATCH_WIDTH && first != last; ++width, ++first) {
+            keys[width] = &*first;
+            current[width] = root_;
+            found[width] = nullptr;
+        }
+
+        size_t searching = (root_ == nullptr) ? 0 : width;
+        while (searching > 0) {
+            for (size_t i = 0; i < width; ++i) {
+                Node<Key, Value>* node = current[i];
+                if (node == nullptr) continue;
+
+                int cmp = compareKeys(comp_, *keys[i], node->getKey());
+                if (cmp == 0) {
+                    found[i] = node;
+                    node = nullptr;
+                }
+                else {
+                    node = (cmp < 0) ? node->getLeft() : node->getRight();
+                }
+                current[i] = node;
+                if (node == nullptr) {
+                    searching--;
+                }
+                else {
+                    prefetchRead(node);
+                }
+            }
+        }
+
+        for (size_t i = 0; i < width; ++i) {
+            *out = iterator(found[i], this);
+            ++out;
+        }
+    }
+    return out;
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value, class Compare>
+Value& BinarySearchTree<Key, Value, Compare>::operator[](const Key& key)
+{
+    Node<Key, Value> *curr = internalFind(key);
+    if(curr == nullptr) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+template<class Key, class Value, class Compare>
+Value const & BinarySearchTree<Key, Value, Compare>::operator[](const Key& key) const
+{
+    Node<Key, Value> *curr = internalFind(key);
+    if(curr == nullptr) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+
+/**
+* An insert method to insert into a Binary Search Tree.
+* If the key is already in the tree, its value is overwritten.
+* Returns an iterator to the item and whether a new item was added.
+*/
+template<class Key, class Value, class Compare>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::insert(const std::pair<const Key, Value> &keyValuePair)
+{
+  return insertOrAssignHelper(keyValuePair.first, keyValuePair.second);
+}
+
+/**
+* Like insert() above, but moves the key and value out of an rvalue pair
+* (or converts them from any pair the item can be built from).
+*/
+template<class Key, class Value, class Compare>
+template<typename P, typename>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::insert(P&& keyValuePair)
+{
+  return insertOrAssignHelper(std::forward<P>(keyValuePair).first, std::forward<P>(keyValuePair).second);
+}
+
+/**
+* Inserts an item, using hint to skip the descent from the root when the key
+* belongs right next to it: if the key fits between the hint and one of its
+* neighbours, the new node is attached there directly. Passing the iterator
+* returned by the previous insert makes near-sorted streams cheap, and
+* passing end() (or begin()) makes appends (or prepends) O(1) before any
+* rebalancing. A wrong hint only costs the usual descent. As with insert(),
+* an existing value is overwritten. Returns an iterator to the item.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::insert(iterator hint, const std::pair<const Key, Value> &keyValuePair)
+{
+  Node<Key, Value>* parent;
+  int side;
+  Node<Key, Value>* node = findSlot(keyValuePair.first, hint.current_, parent, side);
+  return assignOrLink(node, parent, side, keyValuePair.first, keyValuePair.second).first;
+}
+
+template<class Key, class Value, class Compare>
+template<typename P, typename>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::insert(iterator hint, P&& keyValuePair)
+{
+  Node<Key, Value>* parent;
+  int side;
+  Node<Key, Value>* node = findSlot(keyValuePair.first, hint.current_, parent, side);
+  return assignOrLink(node, parent, side, std::forward<P>(keyValuePair).first,
+                      std::forward<P>(keyValuePair).second).first;
+}
+
+/**
+* Builds a key/value pair from args and inserts it if its key is not in
+* the tree yet. An existing item is left alone.
+*/
+template<class Key, class Value, class Compare>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::emplace(Args&&... args)
+{
+  std::pair<Key, Value> keyValuePair(std::forward<Args>(args)...);
+  return tryEmplaceHelper(std::move(keyValuePair.first), std::move(keyValuePair.second));
+}
+
+/**
+* Inserts key with a value built from args, unless key is already in the
+* tree, in which case nothing (not even the value) is constructed.
+*/
+template<class Key, class Value, class Compare>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::try_emplace(const Key& key, Args&&... args)
+{
+  return tryEmplaceHelper(key, std::forward<Args>(args)...);
+}
+
+template<class Key, class Value, class Compare>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::try_emplace(Key&& key, Args&&... args)
+{
+  return tryEmplaceHelper(std::move(key), std::forward<Args>(args)...);
+}
+
+/**
+* Assigns value to key, inserting key if it is not in the tree yet.
+*/
+template<class Key, class Value, class Compare>
+template<typename M>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::insert_or_assign(const Key& key, M&& value)
+{
+  return insertOrAssignHelper(key, std::forward<M>(value));
+}
+
+template<class Key, class Value, class Compare>
+template<typename M>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::insert_or_assign(Key&& key, M&& value)
+{
+  return insertOrAssignHelper(std::move(key), std::forward<M>(value));
+}
+
+/**
+* Calls update(value) on the value stored under key, first inserting key
+* with a value-initialized Value if it is not in the tree yet. Handy for
+* read-modify-write patterns such as counters, with a single descent.
+*/
+template<class Key, class Value, class Compare>
+template<typename Fn>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::upsert(const Key& key, Fn update)
+{
+  return upsertHelper(key, update);
+}
+
+template<class Key, class Value, class Compare>
+template<typename Fn>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::upsert(Key&& key, Fn update)
+{
+  return upsertHelper(std::move(key), update);
+}
+
+/**
+* Descends once looking for key. Returns its node if it is in the tree.
+* Otherwise returns NULL and reports where a new node would go: under
+* parent (NULL for the root), on the left if side < 0 and on the right if not.
+*/
+template<class Key, class Value, class Compare>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::findSlot(const K& key, Node<Key, Value>*& parent, int& side) const
+{
+  Node<Key, Value>* curr = root_;
+  parent = nullptr;
+  side = 0;
+
+  while (curr != nullptr) {
+    int cmp = compareKeys(comp_, key, curr->getKey());
+    if (cmp == 0) return curr;
+    parent = curr;
+    side = cmp;
+    curr = (cmp < 0) ? curr->getLeft() : curr->getRight();
+  }
+  return nullptr;
+}
+
+/**
+* Same as above, but first tries the slot next to hint (the end of the tree
+* if hint is NULL): if key falls between hint and its in-order neighbour, the
+* slot is the empty child between the two and no descent is needed.
+*/
+template<class Key, class Value, class Compare>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::findSlot(const K& key, Node<Key, Value>* hint, Node<Key, Value>*& parent, int& side) const
+{
+  if (hint == nullptr) {
+    hint = largest_;
+  }
+  if (hint == nullptr) {
+    return findSlot(key, parent, side);
+  }
+
+  int cmp = compareKeys(comp_, key, hint->getKey());
+  if (cmp == 0) return hint;
+
+  if (cmp > 0) {
+    // The largest node has no successor, so skip the walk up the right spine
+    Node<Key, Value>* next = (hint == largest_) ? nullptr : succesor(hint);
+    int nextCmp = (next == nullptr) ? -1 : compareKeys(comp_, key, next->getKey());
+    if (nextCmp == 0) return next;
+    if (nextCmp < 0) {
+      if (hint->getRight() == nullptr) {
+        parent = hint;
+        side = 1;
+      } else {
+        parent = next;
+        side = -1;
+      }
+      return nullptr;
+    }
+  } else {
+    Node<Key, Value>* prev = (hint == smallest_) ? nullptr : predecessor(hint);
+    int prevCmp = (prev == nullptr) ? 1 : compareKeys(comp_, key, prev->getKey());
+    if (prevCmp == 0) return prev;
+    if (prevCmp > 0) {
+      if (hint->getLeft() == nullptr) {
+        parent = hint;
+        side = -1;
+      } else {
+        parent = prev;
+        side = 1;
+      }
+      return nullptr;
+    }
+  }
+  return findSlot(key, parent, side);
+}
+
+/**
+* Links a new node into the slot found by findSlot() and lets the tree
+* rebalance through linkFix().
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::linkNode(Node<Key, Value>* node, Node<Key, Value>* parent, int side)
+{
+  if (parent == nullptr) {
+    root_ = node;
+    smallest_ = node;
+    largest_ = node;
+  } else if (side < 0) {
+    parent->setLeft(node);
+    if (parent == smallest_) smallest_ = node;
+  } else {
+    parent->setRight(node);
+    if (parent == largest_) largest_ = node;
+  }
+  size_++;
+  linkFix(node);
+}
+
+/**
+* Moves the cached smallest and largest nodes off a node that is about to be
+* unlinked from the tree. Must be called while the node is still linked.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::unlinkBounds(Node<Key, Value>* node)
+{
+  if (node == smallest_) smallest_ = succesor(node);
+  if (node == largest_) largest_ = predecessor(node);
+}
+
+/**
+* Recomputes the cached smallest and largest nodes from scratch.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::resetBounds()
+{
+  smallest_ = getSmallestNode();
+  largest_ = getLargestNode();
+}
+
+/**
+* Hook called after a new leaf is linked into the tree. A plain BST
+* does not rebalance.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::linkFix(Node<Key, Value>* node)
+{
+
+}
+
+template<class Key, class Value, class Compare>
+template<typename K, typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::tryEmplaceHelper(K&& key, Args&&... args)
+{
+  Node<Key, Value>* parent;
+  int side;
+  Node<Key, Value>* node = findSlot(key, parent, side);
+  if (node != nullptr) {
+    return std::make_pair(iterator(node, this), false);
+  }
+  node = createNode(Key(std::forward<K>(key)), Value(std::forward<Args>(args)...), parent);
+  linkNode(node, parent, side);
+  return std::make_pair(iterator(node, this), true);
+}
+
+template<class Key, class Value, class Compare>
+template<typename K, typename M>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::insertOrAssignHelper(K&& key, M&& value)
+{
+  Node<Key, Value>* parent;
+  int side;
+  Node<Key, Value>* node = findSlot(key, parent, side);
+  return assignOrLink(node, parent, side, std::forward<K>(key), std::forward<M>(value));
+}
+
+/**
+* Finishes an insert_or_assign() once findSlot() has run: assigns to node if
+* the key was found, and otherwise links a new node into the slot.
+*/
+template<class Key, class Value, class Compare>
+template<typename K, typename M>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::assignOrLink(Node<Key, Value>* node, Node<Key, Value>* parent, int side, K&& key, M&& value)
+{
+  if (node != nullptr) {
+    node->getValue() = std::forward<M>(value);
+    return std::make_pair(iterator(node, this), false);
+  }
+  node = createNode(Key(std::forward<K>(key)), Value(std::forward<M>(value)), parent);
+  linkNode(node, parent, side);
+  return std::make_pair(iterator(node, this), true);
+}
+
+template<class Key, class Value, class Compare>
+template<typename K, typename Fn>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::upsertHelper(K&& key, Fn& update)
+{
+  Node<Key, Value>* parent;
+  int side;
+  Node<Key, Value>* node = findSlot(key, parent, side);
+  bool inserted = false;
+  if (node == nullptr) {
+    node = createNode(Key(std::forward<K>(key)), Value(), parent);
+    linkNode(node, parent, side);
+    inserted = true;
+  }
+  update(node->getValue());
+  return std::make_pair(iterator(node, this), inserted);
+}
+
+/**
+* A remove method to remove a specific key from a Binary Search Tree.
+* Recall: The writeup specifies that if a node has 2 children you
+* should swap with the predecessor and then remove.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::remove(const Key& key)
+{
+    // TODO
+    Node<Key, Value> *curr = internalFind(key);
+    if (curr == nullptr) return;
+
+    Node<Key, Value>* parent = curr->getParent();
+
+    if (curr->getLeft() != nullptr && curr->getRight() != nullptr) {
+        Node<Key, Value>* pred = predecessor(curr);
+        nodeSwap(pred, curr);
+        parent = curr->getParent();
+    }
+    
+    // Now curr has at most one child
+    unlinkBounds(curr);
+    Node<Key, Value>* child = (curr->getLeft() != nullptr) ? curr->getLeft() : curr->getRight();
+    
+    if (child != nullptr) {
+        child->setParent(parent);
+    }
+    
+    if (parent == nullptr) {
+        root_ = child;
+    } else if (parent->getLeft() == curr) {
+        parent->setLeft(child);
+    } else {
+        parent->setRight(child);
+    }
+    
+    destroyNode(curr);
+    size_--;
+}
+
+template<class Key, class Value, class Compare>
+Node<Key, Value>*
+BinarySearchTree<Key, Value, Compare>::predecessor(Node<Key, Value>* current)
+{
+    // TODO
+    if (current == nullptr) return nullptr;
+    if (current->getLeft() != nullptr) {
+        Node<Key, Value>* temp = current->getLeft();
+        while (temp->getRight() != nullptr) {
+          temp = temp->getRight();
+        }
+        return temp;
+    } 
+
+    Node<Key, Value>* parent = current->getParent();
+    while (parent != nullptr && current == parent->getLeft()) {
+      current = parent;
+      parent = current->getParent();
+    }
+    
+    return parent;
+}
+
+template<class Key, class Value, class Compare>
+Node<Key, Value>*
+BinarySearchTree<Key, Value, Compare>::succesor(Node<Key, Value>* current)
+{
+    // TODO
+    if (current == nullptr) return nullptr;
+    if (current->getRight() != nullptr) {
+        Node<Key, Value>* temp = current->getRight();
+        while (temp->getLeft() != nullptr) {
+          temp = temp->getLeft();
+        }
+        return temp;
+    } 
+    Node<Key, Value>* parent = current->getParent();
+    while (parent != nullptr && current == parent->getRight()) {
+      current = parent;
+      parent = current->getParent();
+    }
+    
+    return parent;
+}
+
+/**
+* A method to remove all contents of the tree and
+* reset the values in the tree for use again.
+* The nodes are destroyed one by one (or not at all when they
+* hold nothing to destroy), and their memory goes back in bulk
+* when the arena releases its slabs.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::clear()
+{
+  destroyAllNodes();
+  root_ = nullptr;
+  size_ = 0;
+  sizeKnown_ = true;
+  smallest_ = nullptr;
+  largest_ = nullptr;
+  pool_.release();
+}
+
+/**
+* Destroys every node of the subtree without returning its memory to the arena.
+* Right rotations flatten the tree into a right spine as it is consumed, so it runs
+* in O(n) time and O(1) space whatever the shape of the tree and never reads a
+* parent pointer. If the items are trivially destructible there is nothing to do.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename NodeType>
+void BinarySearchTree<Key, Value, Compare>::clearHelper(Node<Key, Value>* node)
+{
+  if (std::is_trivially_destructible<std::pair<const Key, Value> >::value) return;
+
+  while (node != nullptr) {
+    Node<Key, Value>* left = node->getLeft();
+    if (left != nullptr) {
+      // Rotate right so the left subtree moves onto the spine
+      node->setLeft(left->getRight());
+      left->setRight(node);
+      node = left;
+    } else {
+      Node<Key, Value>* right = node->getRight();
+      static_cast<NodeType*>(node)->~NodeType();
+      node = right;
+    }
+  }
+}
+
+/**
+* Replaces the contents of the tree with a range of key/value pairs sorted
+* by strictly increasing key. The tree is built perfectly balanced in linear
+* time without any comparisons beyond checking that the range is sorted.
+* Throws std::invalid_argument (leaving the tree unchanged) if it is not.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename ForwardIt>
+void BinarySearchTree<Key, Value, Compare>::assign(ForwardIt first, ForwardIt last)
+{
+    size_t count = 0;
+    for (ForwardIt prev = first, it = first; it != last; prev = it, ++it, ++count) {
+        if (count > 0 && compareKeys(comp_, prev->first, it->first) >= 0) {
+            throw std::invalid_argument("Range is not sorted by strictly increasing key");
+        }
+    }
+
+    clear();
+    int height;
+    root_ = buildSorted(first, count, height);
+    size_ = count;
+    sizeKnown_ = true;
+    resetBounds();
+}
+
+/**
+* Writes the tree to a binary snapshot file at path, replacing any file
+* there. Items go out in key order as the raw bytes of their keys and
+* values, so both must be trivially copyable. The file also records the
+* format version, the key and value sizes and the byte order, and ends with
+* a checksum over everything before it. Throws std::runtime_error if the
+* file cannot be written.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::save(const std::string& path) const
+{
+    SnapshotWriter writer(path, size());
+    for_each([&writer](const std::pair<const Key, Value>& item) {
+        writer.write(item.first, item.second);
+    });
+    writer.finish();
+}
+
+/**
+* Replaces the contents of the tree with a snapshot written by save().
+* The items are read in one pass and linked into a perfectly balanced tree
+* in linear time, as assign() does, so no rebalancing is needed and an AVL
+* tree gets its balances straight away. Throws std::runtime_error, and
+* leaves the tree unchanged, if the file cannot be read, was written for
+* other key or value types or another byte order, fails its checksum, or
+* holds its items out of this tree's key order (as a file saved by a tree
+* with another comparator does).
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::load(const std::string& path)
+{
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                  "load() needs trivially copyable keys and values");
+
+    std::ifstream in(path.c_str(), std::ios::binary);
+    if (!in) throw std::runtime_error("Cannot open " + path);
+
+    SnapshotHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        throw std::runtime_error(path + " is not a tree snapshot");
+    }
+    SnapshotHeader expected = snapshotHeader(header.count);
+    if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0) {
+        throw std::runtime_error(path + " is not a tree snapshot");
+    }
+    if (header.byteOrder != expected.byteOrder) {
+        throw std::runtime_error(path + " was written with another byte order");
+    }
+    if (header.version != expected.version) {
+        throw std::runtime_error(path + " has an unsupported snapshot version");
+    }
+    if (header.keyBytes != expected.keyBytes || header.valueBytes != expected.valueBytes) {
+        throw std::runtime_error(path + " holds keys or values of another type");
+    }
+
+    const size_t recordBytes = sizeof(Key) + sizeof(Value);
+    if (header.count > SIZE_MAX / recordBytes) {
+        throw std::runtime_error(path + " is corrupt");
+    }
+    size_t payloadBytes = header.count * recordBytes;
+    // Check the count against the size of the file before trusting it with
+    // an allocation, so a corrupt header cannot ask for any amount of memory
+    std::streampos start = in.tellg();
+    in.seekg(0, std::ios::end);
+    std::streamoff remaining = in.tellg() - start;
+    in.seekg(start);
+    if (!in || remaining < static_cast<std::streamoff>(sizeof(uint64_t)) ||
+        static_cast<uint64_t>(remaining) - sizeof(uint64_t) < payloadBytes) {
+        throw std::runtime_error(path + " is truncated");
+    }
+    std::unique_ptr<char[]> payload(new char[payloadBytes + 1]);
+    uint64_t stored;
+    if (!in.read(payload.get(), payloadBytes) ||
+        !in.read(reinterpret_cast<char*>(&stored), sizeof(stored))) {
+        throw std::runtime_error(path + " is truncated");
+    }
+    uint64_t hash = snapshotChecksum(0, reinterpret_cast<const char*>(&header), sizeof(header));
+    if (snapshotChecksum(hash, payload.get(), payloadBytes) != stored) {
+        throw std::runtime_error(path + " is corrupt");
+    }
+
+    try {
+        assign(SnapshotRecords(payload.get()), SnapshotRecords(payload.get() + payloadBytes));
+    }
+    catch (const std::invalid_argument&) {
+        throw std::runtime_error(path + " is corrupt");
+    }
+}
+
+/**
+* Returns the header of a snapshot of count items of this tree's types.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::SnapshotHeader
+BinarySearchTree<Key, Value, Compare>::snapshotHeader(uint64_t count)
+{
+    SnapshotHeader header;
+    std::memcpy(header.magic, "BSTSNAP", sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.keyBytes = sizeof(Key);
+    header.valueBytes = sizeof(Value);
+    header.byteOrder = 0x01020304;
+    header.count = count;
+    return header;
+}
+
+/**
+* Continues a checksum over the next bytes of a stream: an FNV-1a style
+* hash taken 8 bytes at a time. Every chunk but the last must be a
+* multiple of 8 bytes long.
+*/
+template<class Key, class Value, class Compare>
+uint64_t BinarySearchTree<Key, Value, Compare>::snapshotChecksum(uint64_t hash, const char* data, size_t bytes)
+{
+    const uint64_t prime = 0x100000001b3ULL;
+    size_t i = 0;
+    for (; i + 8 <= bytes; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 32;
+    }
+    for (; i < bytes; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * prime;
+    }
+    return hash;
+}
+
+/**
+* Builds a perfectly balanced subtree out of the next count items of the
+* range, consuming them in order, and reports the height of the subtree.
+* The root of the returned subtree has no parent yet.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename ForwardIt>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::buildSorted(ForwardIt& next, size_t count, int& height)
+{
+    if (count == 0) {
+        height = -1;
+        return nullptr;
+    }
+
+    int leftHeight, rightHeight;
+    Node<Key, Value>* left = buildSorted(next, count / 2, leftHeight);
+    Node<Key, Value>* node = nullptr;
+    try {
+        node = createNode(next->first, next->second, nullptr);
+    }
+    catch (...) {
+        destroySubtree(left);
+        throw;
+    }
+    ++next;
+    node->setLeft(left);
+    if (left != nullptr) left->setParent(node);
+
+    Node<Key, Value>* right = nullptr;
+    try {
+        right = buildSorted(next, count - count / 2 - 1, rightHeight);
+    }
+    catch (...) {
+        destroySubtree(node);
+        throw;
+    }
+    node->setRight(right);
+    if (right != nullptr) right->setParent(node);
+
+    buildFix(node, leftHeight, rightHeight);
+    height = max(leftHeight, rightHeight) + 1;
+    return node;
+}
+
+/**
+* Hook called on each node built by assign() once both of its subtrees are
+* in place. A plain BST has nothing to record.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::buildFix(Node<Key, Value>* node, int leftHeight, int rightHeight)
+{
+
+}
+
+/**
+* Destroys a detached subtree node by node and returns how many nodes it had.
+*/
+template<typename Key, typename Value, typename Compare>
+size_t BinarySearchTree<Key, Value, Compare>::destroySubtree(Node<Key, Value>* node)
+{
+    if (node == nullptr) return 0;
+
+    size_t count = destroySubtree(node->getLeft());
+    count += destroySubtree(node->getRight());
+    destroyNode(node);
+    return count + 1;
+}
+
+/**
+* Wraps a node pointer in an iterator for derived trees, which cannot
+* use the iterator's protected constructor.
+*/
+template<typename Key, typename Value, typename Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::makeIterator(Node<Key, Value>* node) const
+{
+    return iterator(node, this);
+}
+
+/**
+* Allocates a node from the tree's arena and constructs it in place.
+* Derived trees override this to create their own kind of node.
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::createNode(const Key& key, const Value& value, Node<Key, Value>* parent)
+{
+    void* block = pool_.allocate(sizeof(Node<Key, Value>));
+    try {
+        return new (block) Node<Key, Value>(key, value, parent);
+    }
+    catch (...) {
+        pool_.deallocate(block);
+        throw;
+    }
+}
+
+/**
+* Same as above, but moves the key and value into the node.
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::createNode(Key&& key, Value&& value, Node<Key, Value>* parent)
+{
+    void* block = pool_.allocate(sizeof(Node<Key, Value>));
+    try {
+        return new (block) Node<Key, Value>(std::move(key), std::move(value), parent);
+    }
+    catch (...) {
+        pool_.deallocate(block);
+        throw;
+    }
+}
+
+/**
+* Destroys a single node and puts its memory on the arena's freelist.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::destroyNode(Node<Key, Value>* node)
+{
+    node->~Node();
+    pool_.deallocate(node);
+}
+
+/**
+* Destroys every node in the tree without returning the memory to the arena.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::destroyAllNodes()
+{
+    clearHelper<Node<Key, Value> >(root_);
+}
+
+/**
+* A helper function to find the smallest node in the tree.
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>*
+BinarySearchTree<Key, Value, Compare>::getSmallestNode() const
+{
+    // TODO
+    if (root_ == nullptr) return nullptr;
+    
+    Node<Key, Value>* curr = root_;
+    while (curr->getLeft() != nullptr) {
+        curr = curr->getLeft();
+    }
+    return curr;
+}
+
+/**
+* A helper function to find the largest node in the tree.
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>*
+BinarySearchTree<Key, Value, Compare>::getLargestNode() const
+{
+    // TODO
     if (root_ == nullptr) return nullptr;
     
     Node<Key, Value>* curr = root_;
@@ -617,16 +2062,18 @@ BinarySearchTree<Key, Value>::getLargestNode() const
 * return a pointer to it or NULL if no item with that key
 * exists
 */
-template<typename Key, typename Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) const
+template<typename Key, typename Value, typename Compare>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::internalFind(const K& key) const
 {
     // TODO
     Node<Key, Value>* curr = root_;
     
     while (curr != nullptr) {
-      if (curr->getKey() < key) {
+      int cmp = compareKeys(comp_, key, curr->getKey());
+      if (cmp > 0) {
         curr = curr->getRight();
-      } else if (curr->getKey() > key) {
+      } else if (cmp < 0) {
         curr = curr->getLeft();
       } else {
         return curr;
@@ -635,39 +2082,145 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) con
     return nullptr;
 }
 
+/**
+* Helper function returning the first node whose key is not less than k,
+* or NULL if there is none.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::lowerBoundNode(const K& k) const
+{
+    Node<Key, Value>* curr = root_;
+    Node<Key, Value>* bound = nullptr;
+    while (curr != nullptr) {
+        if (compareKeys(comp_, curr->getKey(), k) < 0) {
+            curr = curr->getRight();
+        } else {
+            bound = curr;
+            curr = curr->getLeft();
+        }
+    }
+    return bound;
+}
+
+/**
+* Helper function returning the first node whose key is greater than k,
+* or NULL if there is none.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::upperBoundNode(const K& k) const
+{
+    Node<Key, Value>* curr = root_;
+    Node<Key, Value>* bound = nullptr;
+    while (curr != nullptr) {
+        if (compareKeys(comp_, k, curr->getKey()) < 0) {
+            bound = curr;
+            curr = curr->getLeft();
+        } else {
+            curr = curr->getRight();
+        }
+    }
+    return bound;
+}
+
 /**
  * Return true iff the BST is balanced.
  */
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::isBalanced() const
+template<typename Key, typename Value, typename Compare>
+bool BinarySearchTree<Key, Value, Compare>::isBalanced() const
 {
     // TODO
     return balanced(root_); 
 }
 
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::balanced(Node<Key, Value>* current) const {
-  if (current == nullptr) return true;
+/**
+ * Return true iff the tree is a valid BST: keys strictly increase in
+ * order, every child points back at its parent, and the cached smallest
+ * and largest nodes are the right ones.
+ */
+template<typename Key, typename Value, typename Compare>
+bool BinarySearchTree<Key, Value, Compare>::isValid() const
+{
+    if (smallest_ != getSmallestNode() || largest_ != getLargestNode()) return false;
+    return auditSubtree(root_, true, AnyShape()) != INVALID_HEIGHT;
+}
 
-  int leftHeight = height(current->getLeft());
-  int rightHeight = height(current->getRight());
+/**
+ * Return the height of the tree (-1 when empty).
+ */
+template<typename Key, typename Value, typename Compare>
+int BinarySearchTree<Key, Value, Compare>::height() const
+{
+    return height(root_);
+}
 
-  if (abs(leftHeight - rightHeight) > 1) return false;
-  
-  return balanced(current->getLeft()) && balanced(current->getRight());
+template<typename Key, typename Value, typename Compare>
+bool BinarySearchTree<Key, Value, Compare>::balanced(Node<Key, Value>* current) const {
+  return auditSubtree(current, false, HeightBalanced()) != INVALID_HEIGHT;
 }
 
-template<typename Key, typename Value>
-int BinarySearchTree<Key, Value>::height(Node<Key, Value>* current) const {
-  if (current == nullptr) return -1;
-  int lHeight = height(current->getLeft());
-  int rHeight = height(current->getRight());
+template<typename Key, typename Value, typename Compare>
+int BinarySearchTree<Key, Value, Compare>::height(Node<Key, Value>* current) const {
+  return auditSubtree(current, false, AnyShape());
+}
 
-  return max(lHeight, rHeight) + 1;
+/**
+ * Computes the height of a subtree in a single post-order pass, calling
+ * check(node, leftHeight, rightHeight) on every node. Returns INVALID_HEIGHT
+ * as soon as a check fails or, if checkLinks is set, as soon as a key is out
+ * of order or a child's parent pointer is wrong. The pass uses an explicit
+ * stack, so it is O(n) time and safe on trees of any depth.
+ */
+template<typename Key, typename Value, typename Compare>
+template<typename NodeCheck>
+int BinarySearchTree<Key, Value, Compare>::auditSubtree(Node<Key, Value>* root, bool checkLinks, NodeCheck check) const
+{
+  struct Frame {
+    Node<Key, Value>* node;
+    int leftHeight;
+    bool leftDone;
+  };
+  std::vector<Frame> stack;
+  Node<Key, Value>* prev = nullptr;  // last node visited in order
+  Node<Key, Value>* curr = root;
+
+  while (true) {
+    // Go down the left spine of the current subtree
+    while (curr != nullptr) {
+      if (checkLinks && curr->getLeft() != nullptr && curr->getLeft()->getParent() != curr) {
+        return INVALID_HEIGHT;
+      }
+      Frame frame = { curr, -1, false };
+      stack.push_back(frame);
+      curr = curr->getLeft();
+    }
+
+    // Finish every node whose right subtree is done
+    int height = -1;
+    while (!stack.empty() && stack.back().leftDone) {
+      Frame& top = stack.back();
+      if (!check(top.node, top.leftHeight, height)) return INVALID_HEIGHT;
+      height = max(top.leftHeight, height) + 1;
+      stack.pop_back();
+    }
+    if (stack.empty()) return height;
+
+    // The left subtree is done: visit the node and move to its right
+    Frame& top = stack.back();
+    top.leftHeight = height;
+    top.leftDone = true;
+    if (checkLinks) {
+      if (prev != nullptr && compareKeys(comp_, prev->getKey(), top.node->getKey()) >= 0) return INVALID_HEIGHT;
+      if (top.node->getRight() != nullptr && top.node->getRight()->getParent() != top.node) return INVALID_HEIGHT;
+      prev = top.node;
+    }
+    curr = top.node->getRight();
+  }
 }
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
 {
     if((n1 == n2) || (n1 == nullptr) || (n2 == nullptr) ) {
         return;
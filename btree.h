@@ -0,0 +1,818 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "bst.h"
+#include "node_arena.h"
+
+/**
+* An ordered map stored as a B+ tree, with the same interface as
+* BinarySearchTree (insert, remove, find, iterator, operator[], ...).
+*
+* Each node holds a few cache lines worth of keys, stored contiguously, so a
+* lookup takes one or two cache misses per level instead of one per key
+* compared and the tree is about log_32 n levels deep rather than log_2 n.
+* All items live in the leaves, which are chained together for iteration.
+* Nodes are split on the way down during insert and topped up (by borrowing
+* from or merging with a sibling) on the way down during remove, so neither
+* ever has to walk back up.
+*
+* Keys and values are kept in separate arrays and must be default
+* constructible and move assignable. Since no std::pair is stored, *it gives
+* an item with first and second members referring into the leaf rather than
+* a std::pair reference.
+*/
+template <class Key, class Value, class Compare = ThreeWayCompare<Key> >
+class BTreeMap
+{
+protected:
+    // Node sizes: about NODE_BYTES of keys per node
+    static const int NODE_BYTES = 256;
+    static const int MAX_KEYS = (NODE_BYTES / sizeof(Key) < 4) ? 4 : NODE_BYTES / sizeof(Key);
+    static const int MIN_KEYS = (MAX_KEYS - 1) / 2;
+
+    struct BNode {
+        explicit BNode(bool isLeaf) : leaf(isLeaf), count(0) {}
+        bool leaf;
+        int count;
+        Key keys[MAX_KEYS];
+    };
+    struct Leaf : BNode {
+        Leaf() : BNode(true), next(nullptr), prev(nullptr) {}
+        Value values[MAX_KEYS];
+        Leaf* next;
+        Leaf* prev;
+    };
+    struct Inner : BNode {
+        Inner() : BNode(false) {}
+        // count keys separate count + 1 children: every key in children[i]
+        // is less than keys[i], which is not greater than any in children[i + 1]
+        BNode* children[MAX_KEYS + 1];
+    };
+
+public:
+    BTreeMap();
+    explicit BTreeMap(const Compare& comp);
+    ~BTreeMap();
+
+    /**
+    * An iterator over the items in key order. *it and it-> give an item
+    * whose first and second members refer to the key and value in the tree.
+    */
+    class iterator
+    {
+    public:
+        struct Item {
+            const Key& first;
+            Value& second;
+        };
+        struct ItemPointer {
+            Item item;
+            const Item* operator->() const { return &item; }
+        };
+
+        iterator();
+
+        Item operator*() const;
+        ItemPointer operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class BTreeMap<Key, Value, Compare>;
+        iterator(Leaf* leaf, int index);
+        Leaf* leaf_;
+        int index_;
+    };
+
+    std::pair<iterator, bool> insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+    size_t size() const;
+    int height() const;
+    bool isValid() const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+    // Not copyable
+    BTreeMap(const BTreeMap& other) = delete;
+    BTreeMap& operator=(const BTreeMap& other) = delete;
+
+protected:
+    int lowerIndex(const BNode* node, const Key& key) const;
+    int upperIndex(const BNode* node, const Key& key) const;
+    Leaf* findLeaf(const Key& key) const;
+    void splitChild(Inner* parent, int i);
+    void fixChild(Inner* parent, int i);
+    void mergeChildren(Inner* parent, int i);
+    int audit(const BNode* node, const Key* lo, const Key* hi, Leaf*& prevLeaf, size_t& items) const;
+
+    Leaf* createLeaf();
+    Inner* createInner();
+    void destroyNode(BNode* node);
+    void destroySubtree(BNode* node);
+
+protected:
+    BNode* root_;
+    Leaf* first_;
+    size_t size_;
+    NodeArena leafPool_;
+    NodeArena innerPool_;
+    Compare comp_;
+};
+
+/*
+  -------------------------------------------------------
+  Begin implementations for the BTreeMap::iterator class.
+  -------------------------------------------------------
+*/
+
+/**
+* A default constructor that makes an end iterator.
+*/
+template<class Key, class Value, class Compare>
+BTreeMap<Key, Value, Compare>::iterator::iterator() :
+    leaf_(nullptr),
+    index_(0)
+{
+
+}
+
+/**
+* Explicit constructor for the item at index in leaf.
+*/
+template<class Key, class Value, class Compare>
+BTreeMap<Key, Value, Compare>::iterator::iterator(Leaf* leaf, int index) :
+    leaf_(leaf),
+    index_(index)
+{
+
+}
+
+/**
+* Provides access to the item.
+*/
+template<class Key, class Value, class Compare>
+typename BTreeMap<Key, Value, Compare>::iterator::Item
+BTreeMap<Key, Value, Compare>::iterator::operator*() const
+{
+    Item item = { leaf_->keys[index_], leaf_->values[index_] };
+    return item;
+}
+
+/**
+* Provides access to the members of the item.
+*/
+template<class Key, class Value, class Compare>
+typename BTreeMap<Key, Value, Compare>::iterator::ItemPointer
+BTreeMap<Key, Value, Compare>::iterator::operator->() const
+{
+    ItemPointer pointer = { { leaf_->keys[index_], leaf_->values[index_] } };
+    return pointer;
+}
+
+/**
+* Checks if 'this' iterator's internals have the same value as 'rhs'.
+*/
+template<class Key, class Value, class Compare>
+bool BTreeMap<Key, Value, Compare>::iterator::operator==(const iterator& rhs) const
+{
+    return leaf_ == rhs.leaf_ && index_ == rhs.index_;
+}
+
+/**
+* Checks if 'this' iterator's internals have a different value as 'rhs'.
+*/
+template<class Key, class Value, class Compare>
+bool BTreeMap<Key, Value, Compare>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Advances the iterator to the next item, moving on to the next leaf at
+* the end of this one.
+*/
+template<class Key, class Value, class Compare>
+typename BTreeMap<Key, Value, Compare>::iterator&
+BTreeMap<Key, Value, Compare>::iterator::operator++()
+{
+    if (++index_ == leaf_->count) {
+        leaf_ = leaf_->next;
+        index_ = 0;
+    }
+    return *this;
+}
+
+/*
+  -----------------------------------------------------
+  End implementations for the BTreeMap::iterator class.
+  -----------------------------------------------------
+*/
+
+/*
+  ---------------------------------------------
+  Begin implementations for the BTreeMap class.
+  ---------------------------------------------
+*/
+
+/**
+* Default constructor for an empty map.
+*/
+template<class Key, class Value, class Compare>
+BTreeMap<Key, Value, Compare>::BTreeMap() :
+    root_(nullptr),
+    first_(nullptr),
+    size_(0)
+{
+
+}
+
+/**
+* Constructor for an empty map that orders its keys with the given comparator.
+*/
+template<class Key, class Value, class Compare>
+BTreeMap<Key, Value, Compare>::BTreeMap(const Compare& comp) :
+    root_(nullptr),
+    first_(nullptr),
+    size_(0),
+    comp_(comp)
+{
+
+}
+
+template<class Key, class Value, class Compare>
+BTreeMap<Key, Value, Compare>::~BTreeMap()
+{
+    clear();
+}
+
+/**
+* Inserts an item, overwriting the value of an existing key. Returns an
+* iterator to the item and whether a new item was added.
+*/
+template<class Key, class Value, class Compare>
+std::pair<typename BTreeMap<Key, Value, Compare>::iterator, bool>
+BTreeMap<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    const Key& key = keyValuePair.first;
+    if (root_ == nullptr) {
+        first_ = createLeaf();
+        root_ = first_;
+    }
+    else if (root_->count == MAX_KEYS) {
+        // Grow a new root above the full one, then split it
+        Inner* root = createInner();
+        root->children[0] = root_;
+        root_ = root;
+        splitChild(root, 0);
+    }
+
+    // Split full nodes on the way down, so there is always room below
+    BNode* node = root_;
+    while (!node->leaf) {
+        Inner* inner = static_cast<Inner*>(node);
+        int i = upperIndex(inner, key);
+        if (inner->children[i]->count == MAX_KEYS) {
+            splitChild(inner, i);
+            if (compareKeys(comp_, key, inner->keys[i]) >= 0) i++;
+        }
+        node = inner->children[i];
+    }
+
+    Leaf* leaf = static_cast<Leaf*>(node);
+    int i = lowerIndex(leaf, key);
+    if (i < leaf->count && compareKeys(comp_, key, leaf->keys[i]) == 0) {
+        leaf->values[i] = keyValuePair.second;
+        return std::make_pair(iterator(leaf, i), false);
+    }
+    std::move_backward(leaf->keys + i, leaf->keys + leaf->count, leaf->keys + leaf->count + 1);
+    std::move_backward(leaf->values + i, leaf->values + leaf->count, leaf->values + leaf->count + 1);
+    leaf->keys[i] = key;
+    leaf->values[i] = keyValuePair.second;
+    leaf->count++;
+    size_++;
+    return std::make_pair(iterator(leaf, i), true);
+}
+
+/**
+* Removes key from the map, if it is there. Every node on the way down is
+* given more than the minimum number of keys first, so the leaf can lose
+* one without any fixing up afterwards.
+*/
+template<class Key, class Value, class Compare>
+void BTreeMap<Key, Value, Compare>::remove(const Key& key)
+{
+    if (root_ == nullptr) return;
+
+    BNode* node = root_;
+    while (!node->leaf) {
+        Inner* inner = static_cast<Inner*>(node);
+        int i = upperIndex(inner, key);
+        if (inner->children[i]->count <= MIN_KEYS) {
+            fixChild(inner, i);
+            if (inner == root_ && inner->count == 0) {
+                // The root's last two children were merged: drop a level
+                root_ = inner->children[0];
+                destroyNode(inner);
+                node = root_;
+                continue;
+            }
+            i = upperIndex(inner, key);
+        }
+        node = inner->children[i];
+    }
+
+    Leaf* leaf = static_cast<Leaf*>(node);
+    int i = lowerIndex(leaf, key);
+    if (i == leaf->count || compareKeys(comp_, key, leaf->keys[i]) != 0) return;
+
+    std::move(leaf->keys + i + 1, leaf->keys + leaf->count, leaf->keys + i);
+    std::move(leaf->values + i + 1, leaf->values + leaf->count, leaf->values + i);
+    leaf->count--;
+    size_--;
+    if (size_ == 0) {
+        clear();
+    }
+}
+
+/**
+* Removes every item from the map and frees all of its memory.
+*/
+template<class Key, class Value, class Compare>
+void BTreeMap<Key, Value, Compare>::clear()
+{
+    destroySubtree(root_);
+    root_ = nullptr;
+    first_ = nullptr;
+    size_ = 0;
+    leafPool_.release();
+    innerPool_.release();
+}
+
+/**
+* Returns true if the map is empty
+*/
+template<class Key, class Value, class Compare>
+bool BTreeMap<Key, Value, Compare>::empty() const
+{
+    return size_ == 0;
+}
+
+/**
+* Returns the number of items in the map
+*/
+template<class Key, class Value, class Compare>
+size_t BTreeMap<Key, Value, Compare>::size() const
+{
+    return size_;
+}
+
+/**
+* Returns the number of levels below the root: -1 for an empty map and 0
+* when the root is a leaf.
+*/
+template<class Key, class Value, class Compare>
+int BTreeMap<Key, Value, Compare>::height() const
+{
+    int height = -1;
+    for (BNode* node = root_; node != nullptr; ) {
+        height++;
+        node = node->leaf ? nullptr : static_cast<Inner*>(node)->children[0];
+    }
+    return height;
+}
+
+/**
+* Returns true iff the tree is well formed: keys sorted and within their
+* separators, every non-root node at least half full, all leaves at the
+* same depth and chained in order, and size() right. Takes O(n) time;
+* meant for tests.
+*/
+template<class Key, class Value, class Compare>
+bool BTreeMap<Key, Value, Compare>::isValid() const
+{
+    if (root_ == nullptr) return size_ == 0 && first_ == nullptr;
+
+    Leaf* prevLeaf = nullptr;
+    size_t items = 0;
+    if (audit(root_, nullptr, nullptr, prevLeaf, items) < 0) return false;
+    return items == size_ && prevLeaf->next == nullptr;
+}
+
+/**
+* Returns an iterator to the "smallest" item in the map
+*/
+template<class Key, class Value, class Compare>
+typename BTreeMap<Key, Value, Compare>::iterator
+BTreeMap<Key, Value, Compare>::begin() const
+{
+    return iterator(first_, 0);
+}
+
+/**
+* Returns an iterator whose value means INVALID
+*/
+template<class Key, class Value, class Compare>
+typename BTreeMap<Key, Value, Compare>::iterator
+BTreeMap<Key, Value, Compare>::end() const
+{
+    return iterator();
+}
+
+/**
+* Returns an iterator to the item with the given key,
+* or the end iterator if key does not exist in the map
+*/
+template<class Key, class Value, class Compare>
+typename BTreeMap<Key, Value, Compare>::iterator
+BTreeMap<Key, Value, Compare>::find(const Key& key) const
+{
+    Leaf* leaf = findLeaf(key);
+    if (leaf == nullptr) return end();
+
+    int i = lowerIndex(leaf, key);
+    if (i == leaf->count || compareKeys(comp_, key, leaf->keys[i]) != 0) return end();
+    return iterator(leaf, i);
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than key,
+* or the end iterator if there is none.
+*/
+template<class Key, class Value, class Compare>
+typename BTreeMap<Key, Value, Compare>::iterator
+BTreeMap<Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    Leaf* leaf = findLeaf(key);
+    if (leaf == nullptr) return end();
+
+    int i = lowerIndex(leaf, key);
+    if (i == leaf->count) return iterator(leaf->next, 0);
+    return iterator(leaf, i);
+}
+
+/**
+* Returns an iterator to the first item whose key is greater than key,
+* or the end iterator if there is none.
+*/
+template<class Key, class Value, class Compare>
+typename BTreeMap<Key, Value, Compare>::iterator
+BTreeMap<Key, Value, Compare>::upper_bound(const Key& key) const
+{
+    Leaf* leaf = findLeaf(key);
+    if (leaf == nullptr) return end();
+
+    int i = upperIndex(leaf, key);
+    if (i == leaf->count) return iterator(leaf->next, 0);
+    return iterator(leaf, i);
+}
+
+/**
+* Returns the value stored under key. Throws std::out_of_range if key is
+* not in the map.
+*/
+template<class Key, class Value, class Compare>
+Value& BTreeMap<Key, Value, Compare>::operator[](const Key& key)
+{
+    iterator it = find(key);
+    if (it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+template<class Key, class Value, class Compare>
+Value const & BTreeMap<Key, Value, Compare>::operator[](const Key& key) const
+{
+    iterator it = find(key);
+    if (it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+/**
+* Returns the index of the first key in node that is not less than key.
+*/
+template<class Key, class Value, class Compare>
+int BTreeMap<Key, Value, Compare>::lowerIndex(const BNode* node, const Key& key) const
+{
+    int lo = 0, hi = node->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (compareKeys(comp_, node->keys[mid], key) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/**
+* Returns the index of the first key in node that is greater than key,
+* which for an inner node is the child that key belongs under.
+*/
+template<class Key, class Value, class Compare>
+int BTreeMap<Key, Value, Compare>::upperIndex(const BNode* node, const Key& key) const
+{
+    int lo = 0, hi = node->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (compareKeys(comp_, node->keys[mid], key) <= 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/**
+* Returns the leaf key belongs in, or NULL if the map is empty.
+*/
+template<class Key, class Value, class Compare>
+typename BTreeMap<Key, Value, Compare>::Leaf*
+BTreeMap<Key, Value, Compare>::findLeaf(const Key& key) const
+{
+    BNode* node = root_;
+    if (node == nullptr) return nullptr;
+
+    while (!node->leaf) {
+        Inner* inner = static_cast<Inner*>(node);
+        node = inner->children[upperIndex(inner, key)];
+    }
+    return static_cast<Leaf*>(node);
+}
+
+/**
+* Splits the full child i of parent, which must have room for one more
+* key, into two halves. A leaf copies its middle key up as the separator;
+* an inner node moves it up.
+*/
+template<class Key, class Value, class Compare>
+void BTreeMap<Key, Value, Compare>::splitChild(Inner* parent, int i)
+{
+    BNode* child = parent->children[i];
+    BNode* sibling;
+    Key separator;
+
+    if (child->leaf) {
+        Leaf* left = static_cast<Leaf*>(child);
+        Leaf* right = createLeaf();
+        int half = MAX_KEYS / 2;
+        right->count = MAX_KEYS - half;
+        std::move(left->keys + half, left->keys + MAX_KEYS, right->keys);
+        std::move(left->values + half, left->values + MAX_KEYS, right->values);
+        left->count = half;
+
+        right->next = left->next;
+        right->prev = left;
+        if (left->next != nullptr) left->next->prev = right;
+        left->next = right;
+        separator = right->keys[0];
+        sibling = right;
+    }
+    else {
+        Inner* left = static_cast<Inner*>(child);
+        Inner* right = createInner();
+        int half = MAX_KEYS / 2;
+        right->count = MAX_KEYS - half - 1;
+        std::move(left->keys + half + 1, left->keys + MAX_KEYS, right->keys);
+        std::copy(left->children + half + 1, left->children + MAX_KEYS + 1, right->children);
+        separator = std::move(left->keys[half]);
+        left->count = half;
+        sibling = right;
+    }
+
+    std::move_backward(parent->keys + i, parent->keys + parent->count, parent->keys + parent->count + 1);
+    std::copy_backward(parent->children + i + 1, parent->children + parent->count + 1, parent->children + parent->count + 2);
+    parent->keys[i] = std::move(separator);
+    parent->children[i + 1] = sibling;
+    parent->count++;
+}
+
+/**
+* Gives child i of parent more than the minimum number of keys, by
+* borrowing one from a sibling that can spare it or else merging it with
+* a sibling (which takes a key from parent).
+*/
+template<class Key, class Value, class Compare>
+void BTreeMap<Key, Value, Compare>::fixChild(Inner* parent, int i)
+{
+    BNode* child = parent->children[i];
+    BNode* left = (i > 0) ? parent->children[i - 1] : nullptr;
+    BNode* right = (i < parent->count) ? parent->children[i + 1] : nullptr;
+
+    if (left != nullptr && left->count > MIN_KEYS) {
+        // Borrow the last item of the left sibling
+        std::move_backward(child->keys, child->keys + child->count, child->keys + child->count + 1);
+        if (child->leaf) {
+            Leaf* c = static_cast<Leaf*>(child);
+            Leaf* l = static_cast<Leaf*>(left);
+            std::move_backward(c->values, c->values + c->count, c->values + c->count + 1);
+            c->keys[0] = std::move(l->keys[l->count - 1]);
+            c->values[0] = std::move(l->values[l->count - 1]);
+            parent->keys[i - 1] = c->keys[0];
+        }
+        else {
+            Inner* c = static_cast<Inner*>(child);
+            Inner* l = static_cast<Inner*>(left);
+            std::copy_backward(c->children, c->children + c->count + 1, c->children + c->count + 2);
+            c->keys[0] = std::move(parent->keys[i - 1]);
+            c->children[0] = l->children[l->count];
+            parent->keys[i - 1] = std::move(l->keys[l->count - 1]);
+        }
+        left->count--;
+        child->count++;
+    }
+    else if (right != nullptr && right->count > MIN_KEYS) {
+        // Borrow the first item of the right sibling
+        if (child->leaf) {
+            Leaf* c = static_cast<Leaf*>(child);
+            Leaf* r = static_cast<Leaf*>(right);
+            c->keys[c->count] = std::move(r->keys[0]);
+            c->values[c->count] = std::move(r->values[0]);
+            std::move(r->keys + 1, r->keys + r->count, r->keys);
+            std::move(r->values + 1, r->values + r->count, r->values);
+            parent->keys[i] = r->keys[0];
+        }
+        else {
+            Inner* c = static_cast<Inner*>(child);
+            Inner* r = static_cast<Inner*>(right);
+            c->keys[c->count] = std::move(parent->keys[i]);
+            c->children[c->count + 1] = r->children[0];
+            parent->keys[i] = std::move(r->keys[0]);
+            std::move(r->keys + 1, r->keys + r->count, r->keys);
+            std::copy(r->children + 1, r->children + r->count + 1, r->children);
+        }
+        right->count--;
+        child->count++;
+    }
+    else if (left != nullptr) {
+        mergeChildren(parent, i - 1);
+    }
+    else {
+        mergeChildren(parent, i);
+    }
+}
+
+/**
+* Merges child i + 1 of parent into child i and drops the key between them.
+* Both children must have the minimum number of keys.
+*/
+template<class Key, class Value, class Compare>
+void BTreeMap<Key, Value, Compare>::mergeChildren(Inner* parent, int i)
+{
+    BNode* left = parent->children[i];
+    BNode* right = parent->children[i + 1];
+
+    if (left->leaf) {
+        Leaf* l = static_cast<Leaf*>(left);
+        Leaf* r = static_cast<Leaf*>(right);
+        std::move(r->keys, r->keys + r->count, l->keys + l->count);
+        std::move(r->values, r->values + r->count, l->values + l->count);
+        l->count += r->count;
+        l->next = r->next;
+        if (r->next != nullptr) r->next->prev = l;
+    }
+    else {
+        Inner* l = static_cast<Inner*>(left);
+        Inner* r = static_cast<Inner*>(right);
+        l->keys[l->count] = std::move(parent->keys[i]);
+        std::move(r->keys, r->keys + r->count, l->keys + l->count + 1);
+        std::copy(r->children, r->children + r->count + 1, l->children + l->count + 1);
+        l->count += r->count + 1;
+    }
+
+    std::move(parent->keys + i + 1, parent->keys + parent->count, parent->keys + i);
+    std::copy(parent->children + i + 2, parent->children + parent->count + 1, parent->children + i + 1);
+    parent->count--;
+    destroyNode(right);
+}
+
+/**
+* Checks the subtree rooted at node (see isValid()), whose keys must lie in
+* [lo, hi) where given. Also checks that its leaves follow prevLeaf in the
+* leaf chain, and counts its items. Returns the depth of its leaves, or -1
+* if something is wrong.
+*/
+template<class Key, class Value, class Compare>
+int BTreeMap<Key, Value, Compare>::audit(const BNode* node, const Key* lo, const Key* hi, Leaf*& prevLeaf, size_t& items) const
+{
+    if (node->count > MAX_KEYS) return -1;
+    if (node != root_ && node->count < MIN_KEYS) return -1;
+    for (int i = 0; i < node->count; ++i) {
+        if (i > 0 && compareKeys(comp_, node->keys[i - 1], node->keys[i]) >= 0) return -1;
+        if (lo != nullptr && compareKeys(comp_, node->keys[i], *lo) < 0) return -1;
+        if (hi != nullptr && compareKeys(comp_, node->keys[i], *hi) >= 0) return -1;
+    }
+
+    if (node->leaf) {
+        Leaf* leaf = const_cast<Leaf*>(static_cast<const Leaf*>(node));
+        if (node != root_ && node->count == 0) return -1;
+        if (leaf->prev != prevLeaf) return -1;
+        if (prevLeaf == nullptr ? first_ != leaf : prevLeaf->next != leaf) return -1;
+        prevLeaf = leaf;
+        items += leaf->count;
+        return 0;
+    }
+
+    const Inner* inner = static_cast<const Inner*>(node);
+    int depth = -1;
+    for (int i = 0; i <= inner->count; ++i) {
+        const Key* childLo = (i > 0) ? &inner->keys[i - 1] : lo;
+        const Key* childHi = (i < inner->count) ? &inner->keys[i] : hi;
+        int d = audit(inner->children[i], childLo, childHi, prevLeaf, items);
+        if (d < 0 || (depth >= 0 && d != depth)) return -1;
+        depth = d;
+    }
+    return depth + 1;
+}
+
+/**
+* Creates an empty leaf in the leaf arena.
+*/
+template<class Key, class Value, class Compare>
+typename BTreeMap<Key, Value, Compare>::Leaf*
+BTreeMap<Key, Value, Compare>::createLeaf()
+{
+    void* block = leafPool_.allocate(sizeof(Leaf));
+    try {
+        return new (block) Leaf();
+    }
+    catch (...) {
+        leafPool_.deallocate(block);
+        throw;
+    }
+}
+
+/**
+* Creates an empty inner node in the inner node arena.
+*/
+template<class Key, class Value, class Compare>
+typename BTreeMap<Key, Value, Compare>::Inner*
+BTreeMap<Key, Value, Compare>::createInner()
+{
+    void* block = innerPool_.allocate(sizeof(Inner));
+    try {
+        return new (block) Inner();
+    }
+    catch (...) {
+        innerPool_.deallocate(block);
+        throw;
+    }
+}
+
+/**
+* Destroys a single node and puts its memory on its arena's freelist.
+*/
+template<class Key, class Value, class Compare>
+void BTreeMap<Key, Value, Compare>::destroyNode(BNode* node)
+{
+    if (node->leaf) {
+        static_cast<Leaf*>(node)->~Leaf();
+        leafPool_.deallocate(node);
+    }
+    else {
+        static_cast<Inner*>(node)->~Inner();
+        innerPool_.deallocate(node);
+    }
+}
+
+/**
+* Destroys every node of a subtree.
+*/
+template<class Key, class Value, class Compare>
+void BTreeMap<Key, Value, Compare>::destroySubtree(BNode* node)
+{
+    if (node == nullptr) return;
+
+    if (!node->leaf) {
+        Inner* inner = static_cast<Inner*>(node);
+        for (int i = 0; i <= inner->count; ++i) {
+            destroySubtree(inner->children[i]);
+        }
+    }
+    destroyNode(node);
+}
+
+/*
+  -------------------------------------------
+  End implementations for the BTreeMap class.
+  -------------------------------------------
+*/
+
+#endif
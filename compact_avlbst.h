@@ -0,0 +1,629 @@
+#ifndef COMPACT_AVLBST_H
+#define COMPACT_AVLBST_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "bst.h"
+#include "linked_avlbst.h"
+
+/**
+* An AVL tree with the same interface as AVLTree, whose nodes are packed
+* for memory footprint. Nodes live in fixed-size chunks and link to each
+* other by 32-bit slot indices instead of pointers, and the balance factor
+* sits in the top two bits of the parent index. A node is the item plus 12
+* bytes, so an int/int node takes 20 bytes against 40 for an AVLNode, and
+* twice as many of them fit in each level of cache.
+*
+* Chunks never move once allocated, so iterators and references to items
+* stay valid until their item is removed. The tree holds at most 2^30 - 1
+* items. The rebalancing is that of LinkedAVLTree, shared with
+* MappedAVLTree.
+*/
+template <class Key, class Value, class Compare = ThreeWayCompare<Key> >
+class CompactAVLTree : protected LinkedAVLTree<CompactAVLTree<Key, Value, Compare>, uint32_t>
+{
+public:
+    CompactAVLTree();
+    explicit CompactAVLTree(const Compare& comp);
+    ~CompactAVLTree();
+
+    /**
+    * An iterator over the items in key order.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        std::pair<const Key, Value>& operator*() const;
+        std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class CompactAVLTree<Key, Value, Compare>;
+        iterator(const CompactAVLTree* tree, uint32_t index);
+        const CompactAVLTree* tree_;
+        uint32_t index_;
+    };
+
+    std::pair<iterator, bool> insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+    size_t size() const;
+    int height() const;
+    bool isValid() const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+    // Not copyable
+    CompactAVLTree(const CompactAVLTree& other) = delete;
+    CompactAVLTree& operator=(const CompactAVLTree& other) = delete;
+
+protected:
+    friend class LinkedAVLTree<CompactAVLTree<Key, Value, Compare>, uint32_t>;
+
+    struct Slot {
+        Slot(const Key& key, const Value& value, uint32_t parent);
+        std::pair<const Key, Value> item;
+        uint32_t left;
+        uint32_t right;
+        uint32_t parentBalance;
+    };
+    // What an unused slot holds: the next one on the freelist
+    struct FreeSlot {
+        uint32_t next;
+    };
+
+    // Index 0 is never handed out and stands for "no node"
+    static const uint32_t NONE = 0;
+    static const uint32_t PARENT_MASK = (1u << 30) - 1;
+    static const int CHUNK_BITS = 12;
+    static const uint32_t CHUNK_MASK = (1u << CHUNK_BITS) - 1;
+
+    Slot& slot(uint32_t index) const;
+    uint32_t root() const;
+    uint32_t left(uint32_t index) const;
+    uint32_t right(uint32_t index) const;
+    uint32_t parent(uint32_t index) const;
+    int balance(uint32_t index) const;
+    void setRoot(uint32_t index);
+    void setLeft(uint32_t index, uint32_t left);
+    void setRight(uint32_t index, uint32_t right);
+    void setParent(uint32_t index, uint32_t parent);
+    void setBalance(uint32_t index, int balance);
+    bool isNode(uint32_t index) const;
+    int compareNodes(uint32_t a, uint32_t b) const;
+
+    uint32_t createSlot(const Key& key, const Value& value, uint32_t parent);
+    void destroySlot(uint32_t index);
+    void destroySubtree(uint32_t index);
+
+    uint32_t findIndex(const Key& key) const;
+
+protected:
+    std::vector<Slot*> chunks_;
+    uint32_t root_;
+    uint32_t unused_;   // first slot never handed out yet
+    uint32_t free_;     // head of the freelist of removed slots
+    size_t size_;
+    Compare comp_;
+};
+
+/*
+  ---------------------------------------------------------
+  Begin implementations for the CompactAVLTree::Slot class.
+  ---------------------------------------------------------
+*/
+
+/**
+* Explicit constructor for a balanced leaf under parent.
+*/
+template<class Key, class Value, class Compare>
+CompactAVLTree<Key, Value, Compare>::Slot::Slot(const Key& key, const Value& value, uint32_t parent) :
+    item(key, value),
+    left(NONE),
+    right(NONE),
+    parentBalance(parent | (1u << 30))
+{
+
+}
+
+/*
+  -------------------------------------------------------
+  End implementations for the CompactAVLTree::Slot class.
+  -------------------------------------------------------
+*/
+
+/*
+  -------------------------------------------------------------
+  Begin implementations for the CompactAVLTree::iterator class.
+  -------------------------------------------------------------
+*/
+
+/**
+* A default constructor that makes an end iterator.
+*/
+template<class Key, class Value, class Compare>
+CompactAVLTree<Key, Value, Compare>::iterator::iterator() :
+    tree_(nullptr),
+    index_(NONE)
+{
+
+}
+
+/**
+* Explicit constructor for the item in the given slot of tree.
+*/
+template<class Key, class Value, class Compare>
+CompactAVLTree<Key, Value, Compare>::iterator::iterator(const CompactAVLTree* tree, uint32_t index) :
+    tree_(index == NONE ? nullptr : tree),
+    index_(index)
+{
+
+}
+
+/**
+* Provides access to the item.
+*/
+template<class Key, class Value, class Compare>
+std::pair<const Key, Value>&
+CompactAVLTree<Key, Value, Compare>::iterator::operator*() const
+{
+    return tree_->slot(index_).item;
+}
+
+/**
+* Provides access to the address of the item.
+*/
+template<class Key, class Value, class Compare>
+std::pair<const Key, Value>*
+CompactAVLTree<Key, Value, Compare>::iterator::operator->() const
+{
+    return &(tree_->slot(index_).item);
+}
+
+/**
+* Checks if 'this' iterator's internals have the same value as 'rhs'.
+*/
+template<class Key, class Value, class Compare>
+bool CompactAVLTree<Key, Value, Compare>::iterator::operator==(const iterator& rhs) const
+{
+    return tree_ == rhs.tree_ && index_ == rhs.index_;
+}
+
+/**
+* Checks if 'this' iterator's internals have a different value as 'rhs'.
+*/
+template<class Key, class Value, class Compare>
+bool CompactAVLTree<Key, Value, Compare>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Advances the iterator to the next item in key order.
+*/
+template<class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator&
+CompactAVLTree<Key, Value, Compare>::iterator::operator++()
+{
+    index_ = tree_->successor(index_);
+    if (index_ == NONE) {
+        tree_ = nullptr;
+    }
+    return *this;
+}
+
+/*
+  -----------------------------------------------------------
+  End implementations for the CompactAVLTree::iterator class.
+  -----------------------------------------------------------
+*/
+
+/*
+  ---------------------------------------------------
+  Begin implementations for the CompactAVLTree class.
+  ---------------------------------------------------
+*/
+
+/**
+* Default constructor for an empty tree.
+*/
+template<class Key, class Value, class Compare>
+CompactAVLTree<Key, Value, Compare>::CompactAVLTree() :
+    root_(NONE),
+    unused_(1),
+    free_(NONE),
+    size_(0)
+{
+
+}
+
+/**
+* Constructor for an empty tree that orders its keys with the given comparator.
+*/
+template<class Key, class Value, class Compare>
+CompactAVLTree<Key, Value, Compare>::CompactAVLTree(const Compare& comp) :
+    root_(NONE),
+    unused_(1),
+    free_(NONE),
+    size_(0),
+    comp_(comp)
+{
+
+}
+
+template<class Key, class Value, class Compare>
+CompactAVLTree<Key, Value, Compare>::~CompactAVLTree()
+{
+    clear();
+}
+
+/**
+* Inserts an item, overwriting the value of an existing key. Returns an
+* iterator to the item and whether a new item was added.
+*/
+template<class Key, class Value, class Compare>
+std::pair<typename CompactAVLTree<Key, Value, Compare>::iterator, bool>
+CompactAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    uint32_t parentIndex = NONE;
+    uint32_t current = root_;
+    int cmp = 0;
+    while (current != NONE) {
+        cmp = compareKeys(comp_, keyValuePair.first, slot(current).item.first);
+        if (cmp == 0) {
+            slot(current).item.second = keyValuePair.second;
+            return std::make_pair(iterator(this, current), false);
+        }
+        parentIndex = current;
+        current = (cmp < 0) ? left(current) : right(current);
+    }
+
+    uint32_t node = createSlot(keyValuePair.first, keyValuePair.second, parentIndex);
+    size_++;
+    this->attach(parentIndex, node, cmp < 0);
+    return std::make_pair(iterator(this, node), true);
+}
+
+/**
+* Removes key from the tree, if it is there. A node with two children is
+* replaced by its predecessor, relinked into its place, so iterators to
+* other items stay valid.
+*/
+template<class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::remove(const Key& key)
+{
+    uint32_t node = findIndex(key);
+    if (node == NONE) return;
+
+    this->unlink(node);
+    destroySlot(node);
+    size_--;
+}
+
+/**
+* Removes every item from the tree and frees all of its memory.
+*/
+template<class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::clear()
+{
+    destroySubtree(root_);
+    for (size_t i = 0; i < chunks_.size(); ++i) {
+        ::operator delete(chunks_[i]);
+    }
+    chunks_.clear();
+    root_ = NONE;
+    unused_ = 1;
+    free_ = NONE;
+    size_ = 0;
+}
+
+/**
+* Returns true if the tree is empty
+*/
+template<class Key, class Value, class Compare>
+bool CompactAVLTree<Key, Value, Compare>::empty() const
+{
+    return size_ == 0;
+}
+
+/**
+* Returns the number of items in the tree
+*/
+template<class Key, class Value, class Compare>
+size_t CompactAVLTree<Key, Value, Compare>::size() const
+{
+    return size_;
+}
+
+/**
+* Returns the height of the tree (-1 when empty), following the taller
+* child at every level as told by the balance factors.
+*/
+template<class Key, class Value, class Compare>
+int CompactAVLTree<Key, Value, Compare>::height() const
+{
+    return this->treeHeight();
+}
+
+/**
+* Checks every AVL invariant in one O(n) pass: keys in order, parent links,
+* the height balance of every subtree, each node's stored balance, and
+* size(). Meant for tests.
+*/
+template<class Key, class Value, class Compare>
+bool CompactAVLTree<Key, Value, Compare>::isValid() const
+{
+    return this->isValidTree(size_);
+}
+
+/**
+* Returns an iterator to the "smallest" item in the tree
+*/
+template<class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator
+CompactAVLTree<Key, Value, Compare>::begin() const
+{
+    return iterator(this, this->first());
+}
+
+/**
+* Returns an iterator whose value means INVALID
+*/
+template<class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator
+CompactAVLTree<Key, Value, Compare>::end() const
+{
+    return iterator();
+}
+
+/**
+* Returns an iterator to the item with the given key,
+* or the end iterator if key does not exist in the tree
+*/
+template<class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator
+CompactAVLTree<Key, Value, Compare>::find(const Key& key) const
+{
+    return iterator(this, findIndex(key));
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than key,
+* or the end iterator if there is none.
+*/
+template<class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator
+CompactAVLTree<Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    uint32_t best = NONE;
+    uint32_t current = root_;
+    while (current != NONE) {
+        if (compareKeys(comp_, slot(current).item.first, key) < 0) {
+            current = right(current);
+        }
+        else {
+            best = current;
+            current = left(current);
+        }
+    }
+    return iterator(this, best);
+}
+
+/**
+* Returns the value stored under key. Throws std::out_of_range if key is
+* not in the tree.
+*/
+template<class Key, class Value, class Compare>
+Value& CompactAVLTree<Key, Value, Compare>::operator[](const Key& key)
+{
+    uint32_t node = findIndex(key);
+    if (node == NONE) throw std::out_of_range("Invalid key");
+    return slot(node).item.second;
+}
+
+template<class Key, class Value, class Compare>
+Value const & CompactAVLTree<Key, Value, Compare>::operator[](const Key& key) const
+{
+    uint32_t node = findIndex(key);
+    if (node == NONE) throw std::out_of_range("Invalid key");
+    return slot(node).item.second;
+}
+
+/**
+* Returns the slot with the given index.
+*/
+template<class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::Slot&
+CompactAVLTree<Key, Value, Compare>::slot(uint32_t index) const
+{
+    return chunks_[index >> CHUNK_BITS][index & CHUNK_MASK];
+}
+
+/**
+* Getters for the root and for the links of the node in a slot. Each
+* returns NONE if there is no such node.
+*/
+template<class Key, class Value, class Compare>
+uint32_t CompactAVLTree<Key, Value, Compare>::root() const
+{
+    return root_;
+}
+
+template<class Key, class Value, class Compare>
+uint32_t CompactAVLTree<Key, Value, Compare>::left(uint32_t index) const
+{
+    return slot(index).left;
+}
+
+template<class Key, class Value, class Compare>
+uint32_t CompactAVLTree<Key, Value, Compare>::right(uint32_t index) const
+{
+    return slot(index).right;
+}
+
+template<class Key, class Value, class Compare>
+uint32_t CompactAVLTree<Key, Value, Compare>::parent(uint32_t index) const
+{
+    return slot(index).parentBalance & PARENT_MASK;
+}
+
+/**
+* A getter for the balance (left height minus right height) of a node,
+* stored biased by one in the top two bits of its parent link.
+*/
+template<class Key, class Value, class Compare>
+int CompactAVLTree<Key, Value, Compare>::balance(uint32_t index) const
+{
+    return static_cast<int>(slot(index).parentBalance >> 30) - 1;
+}
+
+/**
+* Setters for the root and for the children of a node.
+*/
+template<class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::setRoot(uint32_t index)
+{
+    root_ = index;
+}
+
+template<class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::setLeft(uint32_t index, uint32_t left)
+{
+    slot(index).left = left;
+}
+
+template<class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::setRight(uint32_t index, uint32_t right)
+{
+    slot(index).right = right;
+}
+
+/**
+* A setter for the parent of a node, which keeps its balance.
+*/
+template<class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::setParent(uint32_t index, uint32_t parent)
+{
+    uint32_t& packed = slot(index).parentBalance;
+    packed = (packed & ~PARENT_MASK) | parent;
+}
+
+/**
+* A setter for the balance of a node, which keeps its parent.
+*/
+template<class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::setBalance(uint32_t index, int balance)
+{
+    uint32_t& packed = slot(index).parentBalance;
+    packed = (packed & PARENT_MASK) | (static_cast<uint32_t>(balance + 1) << 30);
+}
+
+/**
+* Returns true if index is that of a slot handed out at some point.
+*/
+template<class Key, class Value, class Compare>
+bool CompactAVLTree<Key, Value, Compare>::isNode(uint32_t index) const
+{
+    return index != NONE && index < unused_;
+}
+
+/**
+* Compares the keys of the nodes in two slots.
+*/
+template<class Key, class Value, class Compare>
+int CompactAVLTree<Key, Value, Compare>::compareNodes(uint32_t a, uint32_t b) const
+{
+    return compareKeys(comp_, slot(a).item.first, slot(b).item.first);
+}
+
+/**
+* Constructs a leaf in a free slot, reusing a removed one if there is one
+* and otherwise taking the next unused slot, and returns its index.
+*/
+template<class Key, class Value, class Compare>
+uint32_t CompactAVLTree<Key, Value, Compare>::createSlot(const Key& key, const Value& value, uint32_t parent)
+{
+    uint32_t index = free_;
+    if (index != NONE) {
+        uint32_t next = reinterpret_cast<FreeSlot*>(&slot(index))->next;
+        new (&slot(index)) Slot(key, value, parent);
+        free_ = next;
+        return index;
+    }
+
+    index = unused_;
+    if (index > PARENT_MASK) throw std::length_error("CompactAVLTree is full");
+    if ((index >> CHUNK_BITS) == chunks_.size()) {
+        chunks_.push_back(static_cast<Slot*>(::operator new(sizeof(Slot) << CHUNK_BITS)));
+    }
+    new (&slot(index)) Slot(key, value, parent);
+    unused_++;
+    return index;
+}
+
+/**
+* Destroys the node in a slot and puts the slot on the freelist.
+*/
+template<class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::destroySlot(uint32_t index)
+{
+    slot(index).~Slot();
+    new (&slot(index)) FreeSlot();
+    reinterpret_cast<FreeSlot*>(&slot(index))->next = free_;
+    free_ = index;
+}
+
+/**
+* Destroys every node of a subtree without freeing its slots.
+*/
+template<class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::destroySubtree(uint32_t index)
+{
+    if (index == NONE) return;
+
+    destroySubtree(left(index));
+    destroySubtree(right(index));
+    slot(index).~Slot();
+}
+
+/**
+* Returns the index of the node with the given key, or NONE.
+*/
+template<class Key, class Value, class Compare>
+uint32_t CompactAVLTree<Key, Value, Compare>::findIndex(const Key& key) const
+{
+    uint32_t current = root_;
+    while (current != NONE) {
+        int cmp = compareKeys(comp_, key, slot(current).item.first);
+        if (cmp == 0) return current;
+        current = (cmp < 0) ? left(current) : right(current);
+    }
+    return NONE;
+}
+
+/*
+  -------------------------------------------------
+  End implementations for the CompactAVLTree class.
+  -------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,384 @@
+#ifndef CONCURRENT_AVLBST_H
+#define CONCURRENT_AVLBST_H
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include "avlbst.h"
+
+/**
+* An AVLTree that many threads can read while one thread at a time writes,
+* using the Left-Right technique: the tree is kept twice, readers use one
+* copy while the writer edits the other, then the two swap roles and the
+* writer replays the edit on the copy the readers just left.
+*
+* Readers never block and never wait on each other or on the writer; they
+* only announce themselves on a per-thread slot of a striped counter, so
+* read throughput scales with cores even during writes. Every read sees
+* the tree as of some point between its start and end (reads and writes are
+* linearizable). Writers serialize on a mutex and wait for the readers of
+* the copy they are about to edit to leave it. The price is twice the
+* memory and every edit done twice.
+*/
+template <class Key, class Value, class Compare = ThreeWayCompare<Key> >
+class ConcurrentAVLTree
+{
+public:
+    typedef AVLTree<Key, Value, Compare> Tree;
+
+    ConcurrentAVLTree();
+    explicit ConcurrentAVLTree(const Compare& comp);
+
+    /**
+    * Read access to the tree, for as long as the view lives. Lookups and
+    * iteration through a view see one consistent version of the tree.
+    * Writers wait for views of the copy they need to edit, so keep views
+    * short-lived and never write from a thread that holds one.
+    */
+    class ReadView
+    {
+    public:
+        ReadView(ReadView&& other);
+        ~ReadView();
+
+        const Tree& operator*() const;
+        const Tree* operator->() const;
+
+        ReadView(const ReadView& other) = delete;
+        ReadView& operator=(const ReadView& other) = delete;
+
+    private:
+        friend class ConcurrentAVLTree<Key, Value, Compare>;
+        ReadView(const ConcurrentAVLTree* owner);
+        const ConcurrentAVLTree* owner_;
+        int version_;
+        // The counter slot this view was announced on, which may differ
+        // from the slot of the thread that ends up destroying it
+        size_t slot_;
+        const Tree* tree_;
+    };
+
+    // Reads, which never block
+    ReadView read() const;
+    bool find(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    size_t size() const;
+
+    // Writes, one thread at a time
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    template<typename Fn>
+    void modify(Fn edit);
+
+    // Not copyable
+    ConcurrentAVLTree(const ConcurrentAVLTree& other) = delete;
+    ConcurrentAVLTree& operator=(const ConcurrentAVLTree& other) = delete;
+
+protected:
+    size_t arrive(int version) const;
+    void depart(int version, size_t slot) const;
+    void restore(int index);
+    void waitForReaders(int version) const;
+    static size_t readerSlot();
+
+    // One counter per cache line, so readers on different cores do not
+    // contend for the same line
+    struct alignas(64) ReaderCount {
+        std::atomic<long> count;
+    };
+    static const size_t READER_SLOTS = 32;
+
+    Tree trees_[2];
+    std::atomic<int> readIndex_;
+    std::atomic<int> version_;
+    mutable ReaderCount readers_[2][READER_SLOTS];
+    std::mutex writeLock_;
+};
+
+/*
+  -------------------------------------------------------------
+  Begin implementations for the ConcurrentAVLTree::ReadView class.
+  -------------------------------------------------------------
+*/
+
+/**
+* Registers a reader with owner and picks the copy of the tree to read.
+*/
+template<class Key, class Value, class Compare>
+ConcurrentAVLTree<Key, Value, Compare>::ReadView::ReadView(const ConcurrentAVLTree* owner) :
+    owner_(owner),
+    version_(owner->version_.load())
+{
+    slot_ = owner_->arrive(version_);
+    tree_ = &owner_->trees_[owner_->readIndex_.load()];
+}
+
+/**
+* Move constructor, which takes over the registration of other.
+*/
+template<class Key, class Value, class Compare>
+ConcurrentAVLTree<Key, Value, Compare>::ReadView::ReadView(ReadView&& other) :
+    owner_(other.owner_),
+    version_(other.version_),
+    slot_(other.slot_),
+    tree_(other.tree_)
+{
+    other.owner_ = nullptr;
+}
+
+/**
+* Destructor, which lets the writer know this reader is done.
+*/
+template<class Key, class Value, class Compare>
+ConcurrentAVLTree<Key, Value, Compare>::ReadView::~ReadView()
+{
+    if (owner_ != nullptr) {
+        owner_->depart(version_, slot_);
+    }
+}
+
+/**
+* Provides access to the tree.
+*/
+template<class Key, class Value, class Compare>
+const typename ConcurrentAVLTree<Key, Value, Compare>::Tree&
+ConcurrentAVLTree<Key, Value, Compare>::ReadView::operator*() const
+{
+    return *tree_;
+}
+
+/**
+* Provides access to the members of the tree.
+*/
+template<class Key, class Value, class Compare>
+const typename ConcurrentAVLTree<Key, Value, Compare>::Tree*
+ConcurrentAVLTree<Key, Value, Compare>::ReadView::operator->() const
+{
+    return tree_;
+}
+
+/*
+  -----------------------------------------------------------
+  End implementations for the ConcurrentAVLTree::ReadView class.
+  -----------------------------------------------------------
+*/
+
+/*
+  ------------------------------------------------------
+  Begin implementations for the ConcurrentAVLTree class.
+  ------------------------------------------------------
+*/
+
+/**
+* Default constructor for an empty tree.
+*/
+template<class Key, class Value, class Compare>
+ConcurrentAVLTree<Key, Value, Compare>::ConcurrentAVLTree() :
+    readIndex_(0),
+    version_(0)
+{
+    for (size_t i = 0; i < READER_SLOTS; ++i) {
+        readers_[0][i].count.store(0);
+        readers_[1][i].count.store(0);
+    }
+}
+
+/**
+* Constructor for an empty tree that orders its keys with the given comparator.
+*/
+template<class Key, class Value, class Compare>
+ConcurrentAVLTree<Key, Value, Compare>::ConcurrentAVLTree(const Compare& comp) :
+    trees_{Tree(comp), Tree(comp)},
+    readIndex_(0),
+    version_(0)
+{
+    for (size_t i = 0; i < READER_SLOTS; ++i) {
+        readers_[0][i].count.store(0);
+        readers_[1][i].count.store(0);
+    }
+}
+
+/**
+* Returns a view for reading the tree. Never blocks.
+*/
+template<class Key, class Value, class Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::ReadView
+ConcurrentAVLTree<Key, Value, Compare>::read() const
+{
+    return ReadView(this);
+}
+
+/**
+* Copies the value stored under key into value and returns true, or returns
+* false if key is not in the tree. Never blocks.
+*/
+template<class Key, class Value, class Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::find(const Key& key, Value& value) const
+{
+    ReadView view(this);
+    typename Tree::iterator it = view->find(key);
+    if (it == view->end()) return false;
+    value = it->second;
+    return true;
+}
+
+/**
+* Returns true if key is in the tree. Never blocks.
+*/
+template<class Key, class Value, class Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::contains(const Key& key) const
+{
+    ReadView view(this);
+    return view->find(key) != view->end();
+}
+
+/**
+* Returns the number of items in the tree. Never blocks.
+*/
+template<class Key, class Value, class Compare>
+size_t ConcurrentAVLTree<Key, Value, Compare>::size() const
+{
+    ReadView view(this);
+    return view->size();
+}
+
+/**
+* Inserts an item, overwriting the value of an existing key as
+* AVLTree::insert() does.
+*/
+template<class Key, class Value, class Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    modify([&keyValuePair](Tree& tree) { tree.insert(keyValuePair); });
+}
+
+/**
+* Removes key from the tree, if it is there.
+*/
+template<class Key, class Value, class Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::remove(const Key& key)
+{
+    modify([&key](Tree& tree) { tree.remove(key); });
+}
+
+/**
+* Removes every item from the tree.
+*/
+template<class Key, class Value, class Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::clear()
+{
+    modify([](Tree& tree) { tree.clear(); });
+}
+
+/**
+* Applies edit, a function taking a Tree&, to the tree. It is called once
+* per copy, so it must make the same change to both; readers see either
+* none or all of it. This is how several edits are published as one.
+*
+* If edit throws, the copy it was editing is rebuilt from the other one in
+* O(n) before the exception is passed on, so the copies never diverge: a
+* throw from the first call leaves the tree as it was, and a throw from the
+* second leaves the edit published as the first call made it.
+*/
+template<class Key, class Value, class Compare>
+template<typename Fn>
+void ConcurrentAVLTree<Key, Value, Compare>::modify(Fn edit)
+{
+    std::lock_guard<std::mutex> lock(writeLock_);
+
+    // Edit the copy nobody reads, then send new readers to it
+    int readIndex = readIndex_.load();
+    try {
+        edit(trees_[1 - readIndex]);
+    }
+    catch (...) {
+        restore(1 - readIndex);
+        throw;
+    }
+    // Count the items now if edit split the tree, so readers never do
+    trees_[1 - readIndex].size();
+    readIndex_.store(1 - readIndex);
+
+    // Wait until no reader can still be on the old copy: drain the idle
+    // counter, move new arrivals onto it, then drain the old one
+    int version = version_.load();
+    waitForReaders(1 - version);
+    version_.store(1 - version);
+    waitForReaders(version);
+
+    try {
+        edit(trees_[readIndex]);
+    }
+    catch (...) {
+        restore(readIndex);
+        throw;
+    }
+}
+
+/**
+* Rebuilds the copy of the tree at index from the other copy, after an
+* edit of it failed part way. Only called by the writer, while no reader
+* uses that copy.
+*/
+template<class Key, class Value, class Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::restore(int index)
+{
+    const Tree& source = trees_[1 - index];
+    trees_[index].assign(source.begin(), source.end());
+}
+
+/**
+* Announces a reader on the counters of the given version, and returns the
+* slot it was counted on.
+*/
+template<class Key, class Value, class Compare>
+size_t ConcurrentAVLTree<Key, Value, Compare>::arrive(int version) const
+{
+    size_t slot = readerSlot();
+    readers_[version][slot].count.fetch_add(1);
+    return slot;
+}
+
+/**
+* Withdraws a reader announced by arrive() on the given slot, which need not
+* be the calling thread's own.
+*/
+template<class Key, class Value, class Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::depart(int version, size_t slot) const
+{
+    readers_[version][slot].count.fetch_sub(1);
+}
+
+/**
+* Spins until no reader is announced on the counters of the given version.
+*/
+template<class Key, class Value, class Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::waitForReaders(int version) const
+{
+    for (size_t i = 0; i < READER_SLOTS; ++i) {
+        while (readers_[version][i].count.load() != 0) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+/**
+* Returns the reader counter slot of the calling thread.
+*/
+template<class Key, class Value, class Compare>
+size_t ConcurrentAVLTree<Key, Value, Compare>::readerSlot()
+{
+    static thread_local size_t slot = std::hash<std::thread::id>()(std::this_thread::get_id()) % READER_SLOTS;
+    return slot;
+}
+
+/*
+  ----------------------------------------------------
+  End implementations for the ConcurrentAVLTree class.
+  ----------------------------------------------------
+*/
+
+#endif
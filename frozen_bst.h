@@ -0,0 +1,392 @@
+#ifndef FROZEN_BST_H
+#define FROZEN_BST_H
+
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "bst.h"
+
+/**
+* A read-only copy of a BinarySearchTree or AVLTree, as made by freeze().
+*
+* The keys are stored in one contiguous array in Eytzinger (breadth-first)
+* order: the children of the key at position k are at 2k and 2k + 1. The
+* array is the implicit layout of a perfectly balanced search tree, with no
+* pointers at all, and the values sit in a parallel array so searches only
+* touch keys. The top levels of every search share the first few cache lines.
+* The descent has no data-dependent branches: each level turns the
+* comparison into the next index arithmetically. It also prefetches the
+* cache line holding the keys a few levels further down, so the misses of
+* consecutive levels overlap instead of queueing.
+*
+* A frozen tree costs sizeof(Key) + sizeof(Value) per item, against the three
+* pointers (plus padding) each node of a tree adds.
+*/
+template <class Key, class Value, class Compare = ThreeWayCompare<Key> >
+class FrozenTree
+{
+public:
+    FrozenTree();
+    explicit FrozenTree(const BinarySearchTree<Key, Value, Compare>& tree);
+
+    /**
+    * An iterator over the items in key order. *it and it-> give an item
+    * whose first and second members refer to the key and value.
+    */
+    class iterator
+    {
+    public:
+        struct Item {
+            const Key& first;
+            const Value& second;
+        };
+        struct ItemPointer {
+            Item item;
+            const Item* operator->() const { return &item; }
+        };
+
+        iterator();
+
+        Item operator*() const;
+        ItemPointer operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class FrozenTree<Key, Value, Compare>;
+        iterator(const FrozenTree* tree, size_t position);
+        const FrozenTree* tree_;
+        size_t position_;
+    };
+
+    bool empty() const;
+    size_t size() const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    Value const & operator[](const Key& key) const;
+
+protected:
+    template<bool Inclusive>
+    size_t boundPosition(const Key& key) const;
+    size_t layout(const std::vector<const std::pair<const Key, Value>*>& items, std::vector<size_t>& ranks, size_t position, size_t rank) const;
+    static size_t successor(size_t position, size_t count);
+
+    // How many keys further down the prefetch reaches: one cache line's worth
+    static const size_t PREFETCH_STRIDE = (64 / sizeof(Key) < 1) ? 1 : 64 / sizeof(Key);
+
+protected:
+    // Positions are 1-based; the item at position k is at index k - 1
+    std::vector<Key> keys_;
+    std::vector<Value> values_;
+    Compare comp_;
+};
+
+/**
+* Returns a frozen, read-only copy of tree, ordered by the same comparator.
+* Takes O(n) time.
+*/
+template<class Key, class Value, class Compare>
+FrozenTree<Key, Value, Compare> freeze(const BinarySearchTree<Key, Value, Compare>& tree)
+{
+    return FrozenTree<Key, Value, Compare>(tree);
+}
+
+/*
+  ---------------------------------------------------------
+  Begin implementations for the FrozenTree::iterator class.
+  ---------------------------------------------------------
+*/
+
+/**
+* A default constructor that makes an end iterator.
+*/
+template<class Key, class Value, class Compare>
+FrozenTree<Key, Value, Compare>::iterator::iterator() :
+    tree_(nullptr),
+    position_(0)
+{
+
+}
+
+/**
+* Explicit constructor for the item at the given position of tree.
+*/
+template<class Key, class Value, class Compare>
+FrozenTree<Key, Value, Compare>::iterator::iterator(const FrozenTree* tree, size_t position) :
+    tree_(position == 0 ? nullptr : tree),
+    position_(position)
+{
+
+}
+
+/**
+* Provides access to the item.
+*/
+template<class Key, class Value, class Compare>
+typename FrozenTree<Key, Value, Compare>::iterator::Item
+FrozenTree<Key, Value, Compare>::iterator::operator*() const
+{
+    Item item = { tree_->keys_[position_ - 1], tree_->values_[position_ - 1] };
+    return item;
+}
+
+/**
+* Provides access to the members of the item.
+*/
+template<class Key, class Value, class Compare>
+typename FrozenTree<Key, Value, Compare>::iterator::ItemPointer
+FrozenTree<Key, Value, Compare>::iterator::operator->() const
+{
+    ItemPointer pointer = { { tree_->keys_[position_ - 1], tree_->values_[position_ - 1] } };
+    return pointer;
+}
+
+/**
+* Checks if 'this' iterator's internals have the same value as 'rhs'.
+*/
+template<class Key, class Value, class Compare>
+bool FrozenTree<Key, Value, Compare>::iterator::operator==(const iterator& rhs) const
+{
+    return tree_ == rhs.tree_ && position_ == rhs.position_;
+}
+
+/**
+* Checks if 'this' iterator's internals have a different value as 'rhs'.
+*/
+template<class Key, class Value, class Compare>
+bool FrozenTree<Key, Value, Compare>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Advances the iterator to the next item in key order.
+*/
+template<class Key, class Value, class Compare>
+typename FrozenTree<Key, Value, Compare>::iterator&
+FrozenTree<Key, Value, Compare>::iterator::operator++()
+{
+    position_ = successor(position_, tree_->keys_.size());
+    if (position_ == 0) {
+        tree_ = nullptr;
+    }
+    return *this;
+}
+
+/*
+  -------------------------------------------------------
+  End implementations for the FrozenTree::iterator class.
+  -------------------------------------------------------
+*/
+
+/*
+  -----------------------------------------------
+  Begin implementations for the FrozenTree class.
+  -----------------------------------------------
+*/
+
+/**
+* Default constructor for an empty frozen tree.
+*/
+template<class Key, class Value, class Compare>
+FrozenTree<Key, Value, Compare>::FrozenTree()
+{
+
+}
+
+/**
+* Copies the items of tree into the Eytzinger layout, along with the
+* comparator they are ordered by. Takes O(n) time.
+*/
+template<class Key, class Value, class Compare>
+FrozenTree<Key, Value, Compare>::FrozenTree(const BinarySearchTree<Key, Value, Compare>& tree) :
+    comp_(tree.key_comp())
+{
+    std::vector<const std::pair<const Key, Value>*> items;
+    items.reserve(tree.size());
+    for (typename BinarySearchTree<Key, Value, Compare>::iterator it = tree.begin(); it != tree.end(); ++it) {
+        items.push_back(&*it);
+    }
+
+    // Work out which item goes at each position, then copy them over in
+    // position order so each array is written front to back
+    std::vector<size_t> ranks(items.size() + 1);
+    layout(items, ranks, 1, 0);
+    keys_.reserve(items.size());
+    values_.reserve(items.size());
+    for (size_t position = 1; position <= items.size(); ++position) {
+        keys_.push_back(items[ranks[position]]->first);
+        values_.push_back(items[ranks[position]]->second);
+    }
+}
+
+/**
+* Returns true if the frozen tree is empty
+*/
+template<class Key, class Value, class Compare>
+bool FrozenTree<Key, Value, Compare>::empty() const
+{
+    return keys_.empty();
+}
+
+/**
+* Returns the number of items in the frozen tree
+*/
+template<class Key, class Value, class Compare>
+size_t FrozenTree<Key, Value, Compare>::size() const
+{
+    return keys_.size();
+}
+
+/**
+* Returns an iterator to the "smallest" item, at the end of the left spine
+*/
+template<class Key, class Value, class Compare>
+typename FrozenTree<Key, Value, Compare>::iterator
+FrozenTree<Key, Value, Compare>::begin() const
+{
+    size_t position = 0;
+    for (size_t next = 1; next <= keys_.size(); next *= 2) {
+        position = next;
+    }
+    return iterator(this, position);
+}
+
+/**
+* Returns an iterator whose value means INVALID
+*/
+template<class Key, class Value, class Compare>
+typename FrozenTree<Key, Value, Compare>::iterator
+FrozenTree<Key, Value, Compare>::end() const
+{
+    return iterator();
+}
+
+/**
+* Returns an iterator to the item with the given key,
+* or the end iterator if key does not exist
+*/
+template<class Key, class Value, class Compare>
+typename FrozenTree<Key, Value, Compare>::iterator
+FrozenTree<Key, Value, Compare>::find(const Key& key) const
+{
+    size_t position = boundPosition<false>(key);
+    if (position == 0 || compareKeys(comp_, key, keys_[position - 1]) != 0) return end();
+    return iterator(this, position);
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than key,
+* or the end iterator if there is none.
+*/
+template<class Key, class Value, class Compare>
+typename FrozenTree<Key, Value, Compare>::iterator
+FrozenTree<Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    return iterator(this, boundPosition<false>(key));
+}
+
+/**
+* Returns an iterator to the first item whose key is greater than key,
+* or the end iterator if there is none.
+*/
+template<class Key, class Value, class Compare>
+typename FrozenTree<Key, Value, Compare>::iterator
+FrozenTree<Key, Value, Compare>::upper_bound(const Key& key) const
+{
+    return iterator(this, boundPosition<true>(key));
+}
+
+/**
+* Returns the value stored under key. Throws std::out_of_range if key is
+* not in the frozen tree.
+*/
+template<class Key, class Value, class Compare>
+Value const & FrozenTree<Key, Value, Compare>::operator[](const Key& key) const
+{
+    iterator it = find(key);
+    if (it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+/**
+* Returns the position of the first key greater than key (Inclusive) or not
+* less than key (otherwise), or 0 if there is none.
+*
+* The descent goes right whenever the key at the current position is below
+* the bound and left otherwise, always to the bottom of the implicit tree.
+* The answer is the last position where it went left; each step appends
+* that choice to the position as its lowest bit, so it is recovered at the
+* end by dropping the trailing right turns (ones) and the left turn before.
+*/
+template<class Key, class Value, class Compare>
+template<bool Inclusive>
+size_t FrozenTree<Key, Value, Compare>::boundPosition(const Key& key) const
+{
+    const size_t count = keys_.size();
+    const Key* keys = keys_.data();
+    size_t position = 1;
+    while (position <= count) {
+        size_t ahead = position * PREFETCH_STRIDE;
+        prefetchRead(keys + (ahead <= count ? ahead : count) - 1);
+        int cmp = compareKeys(comp_, keys[position - 1], key);
+        position = 2 * position + (Inclusive ? cmp <= 0 : cmp < 0);
+    }
+    while (position & 1) {
+        position >>= 1;
+    }
+    return position >> 1;
+}
+
+/**
+* Fills ranks[position] with the in-order rank of the item that belongs at
+* each position of the subtree rooted at position, whose first item has
+* the given rank. Returns the rank following the subtree's last item.
+*/
+template<class Key, class Value, class Compare>
+size_t FrozenTree<Key, Value, Compare>::layout(const std::vector<const std::pair<const Key, Value>*>& items, std::vector<size_t>& ranks, size_t position, size_t rank) const
+{
+    if (position > items.size()) return rank;
+
+    rank = layout(items, ranks, 2 * position, rank);
+    ranks[position] = rank++;
+    return layout(items, ranks, 2 * position + 1, rank);
+}
+
+/**
+* Returns the position following the given one in key order, or 0 after the
+* last: the leftmost position of the right subtree if there is one, and
+* otherwise the nearest ancestor whose left subtree holds position.
+*/
+template<class Key, class Value, class Compare>
+size_t FrozenTree<Key, Value, Compare>::successor(size_t position, size_t count)
+{
+    if (2 * position + 1 <= count) {
+        position = 2 * position + 1;
+        while (2 * position <= count) {
+            position *= 2;
+        }
+        return position;
+    }
+    while (position & 1) {
+        position >>= 1;
+    }
+    return position >> 1;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the FrozenTree class.
+  ---------------------------------------------
+*/
+
+#endif
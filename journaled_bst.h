@@ -0,0 +1,697 @@
+#ifndef JOURNALED_BST_H
+#define JOURNALED_BST_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "avlbst.h"
+
+/**
+* A tree whose inserts and removes are durable: each one is appended to a
+* write-ahead journal on disk before it returns, so a crash loses nothing
+* that was acknowledged, and no full-tree dump is needed per write. Tree
+* may be AVLTree (the default) or BinarySearchTree.
+*
+* The tree at path is kept as a snapshot written by save() plus journal
+* files of the edits made since. Opening loads the newest snapshot and
+* replays the journals on top of it. Writers from many threads share each
+* fsync (group commit): edits pile up while one writer flushes, and the
+* next writer to flush takes them all along in one batch, which replay
+* applies all or nothing. When the journal grows past compactBytes, a
+* background thread writes a fresh snapshot and deletes the files it makes
+* obsolete, while writers carry on with a new journal. It copies the tree a
+* chunk at a time, so readers and writers wait for at most one chunk.
+*
+* Keys and values must be trivially copyable. Edits are applied to the tree
+* before they are durable, so a concurrent reader may see an edit a crash
+* would lose. One process at a time may open a path.
+*/
+template <class Key, class Value, class Compare = ThreeWayCompare<Key>,
+          class Tree = AVLTree<Key, Value, Compare> >
+class JournaledTree
+{
+public:
+    explicit JournaledTree(const std::string& path, size_t compactBytes = DEFAULT_COMPACT_BYTES);
+    ~JournaledTree();
+
+    // Reads, which see every edit made so far
+    bool find(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    size_t size() const;
+    template<typename Fn>
+    void read(Fn visit) const;
+
+    // Writes, which return once they are on disk
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    template<typename InputIt>
+    void insert(InputIt first, InputIt last);
+    void remove(const Key& key);
+    void compact();
+
+    static const size_t DEFAULT_COMPACT_BYTES = 64 << 20;
+
+    // Not copyable
+    JournaledTree(const JournaledTree& other) = delete;
+    JournaledTree& operator=(const JournaledTree& other) = delete;
+
+protected:
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                  "JournaledTree needs trivially copyable keys and values");
+
+    // What every journal file starts with
+    struct JournalHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t keyBytes;
+        uint32_t valueBytes;
+        uint32_t byteOrder;
+    };
+    // What every group commit starts with: the length of its records and
+    // a checksum over them
+    struct BatchHeader {
+        uint64_t bytes;
+        uint64_t checksum;
+    };
+    static const char INSERT_RECORD = 'I';
+    static const char REMOVE_RECORD = 'R';
+    static const uint32_t JOURNAL_VERSION = 1;
+    // How many items a compaction copies per hold of the lock
+    static const size_t COMPACT_CHUNK_ITEMS = 4096;
+
+    void appendRecord(char type, const Key& key, const Value* value);
+    void commit(std::unique_lock<std::mutex>& lock, uint64_t sequence);
+    void startCompaction();
+    void writeSnapshot(uint64_t generation);
+    uint64_t copyItems(std::vector<std::pair<Key, Value> >& items) const;
+    void replayJournal(uint64_t generation);
+    int createJournal(uint64_t generation) const;
+    void listFiles(std::vector<uint64_t>& snapshots, std::vector<uint64_t>& journals) const;
+    void removeFilesBefore(uint64_t generation) const;
+    std::string filePath(const char* kind, uint64_t generation) const;
+    static JournalHeader journalHeader();
+    static void writeAll(int fd, const char* data, size_t bytes);
+    static void syncPath(const std::string& path);
+    static uint64_t journalChecksum(uint64_t hash, const char* data, size_t bytes);
+
+    std::string path_;
+    size_t compactBytes_;
+    Tree tree_;
+    mutable std::mutex lock_;
+    std::condition_variable changed_;
+
+    int journalFd_;
+    uint64_t generation_;       // number of the journal being written
+    size_t journalBytes_;       // bytes in it so far
+    std::vector<char> pending_; // records waiting for the next flush, after room for their header
+    uint64_t appended_;         // sequence number of the last record appended
+    uint64_t written_;          // sequence number of the last record on disk
+    bool flushing_;
+    bool compacting_;
+    bool broken_;               // set once a flush fails, after which nothing is durable
+    std::thread compactor_;
+};
+
+/*
+  --------------------------------------------------
+  Begin implementations for the JournaledTree class.
+  --------------------------------------------------
+*/
+
+/**
+* Opens the tree stored at path: the newest snapshot named path.snap.<n>,
+* plus every journal named path.log.<m> with m >= n, replayed in order.
+* A batch that was torn or corrupted by a crash ends the replay of its
+* journal. Starts a new journal for the edits to come. Throws
+* std::runtime_error if the files cannot be read or hold another kind of
+* tree.
+*/
+template<class Key, class Value, class Compare, class Tree>
+JournaledTree<Key, Value, Compare, Tree>::JournaledTree(const std::string& path, size_t compactBytes) :
+    path_(path),
+    compactBytes_(compactBytes),
+    journalFd_(-1),
+    generation_(0),
+    journalBytes_(0),
+    pending_(sizeof(BatchHeader)),
+    appended_(0),
+    written_(0),
+    flushing_(false),
+    compacting_(false),
+    broken_(false)
+{
+    std::vector<uint64_t> snapshots;
+    std::vector<uint64_t> journals;
+    listFiles(snapshots, journals);
+    std::sort(journals.begin(), journals.end());
+
+    uint64_t snapshot = 0;
+    if (!snapshots.empty()) {
+        snapshot = *std::max_element(snapshots.begin(), snapshots.end());
+        tree_.load(filePath("snap", snapshot));
+    }
+    generation_ = snapshot;
+    for (size_t i = 0; i < journals.size(); ++i) {
+        if (journals[i] < snapshot) continue;
+        replayJournal(journals[i]);
+        generation_ = journals[i];
+    }
+
+    generation_++;
+    journalFd_ = createJournal(generation_);
+    journalBytes_ = sizeof(JournalHeader);
+}
+
+/**
+* Waits for a compaction in progress, then closes the journal.
+*/
+template<class Key, class Value, class Compare, class Tree>
+JournaledTree<Key, Value, Compare, Tree>::~JournaledTree()
+{
+    if (compactor_.joinable()) {
+        compactor_.join();
+    }
+    if (journalFd_ >= 0) {
+        ::close(journalFd_);
+    }
+}
+
+/**
+* Copies the value stored under key into value and returns true, or returns
+* false if key is not in the tree.
+*/
+template<class Key, class Value, class Compare, class Tree>
+bool JournaledTree<Key, Value, Compare, Tree>::find(const Key& key, Value& value) const
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    typename Tree::iterator it = tree_.find(key);
+    if (it == tree_.end()) return false;
+    value = it->second;
+    return true;
+}
+
+/**
+* Returns true if key is in the tree.
+*/
+template<class Key, class Value, class Compare, class Tree>
+bool JournaledTree<Key, Value, Compare, Tree>::contains(const Key& key) const
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    return tree_.find(key) != tree_.end();
+}
+
+/**
+* Returns the number of items in the tree.
+*/
+template<class Key, class Value, class Compare, class Tree>
+size_t JournaledTree<Key, Value, Compare, Tree>::size() const
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    return tree_.size();
+}
+
+/**
+* Calls visit with a const reference to the tree, which no one changes
+* until visit returns. Writers wait meanwhile, so keep it short.
+*/
+template<class Key, class Value, class Compare, class Tree>
+template<typename Fn>
+void JournaledTree<Key, Value, Compare, Tree>::read(Fn visit) const
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    visit(static_cast<const Tree&>(tree_));
+}
+
+/**
+* Inserts an item, overwriting the value of an existing key, and returns
+* once it is on disk. Throws std::runtime_error if the journal cannot be
+* written, in which case the item is in the tree but may not survive a
+* crash.
+*/
+template<class Key, class Value, class Compare, class Tree>
+void JournaledTree<Key, Value, Compare, Tree>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    std::unique_lock<std::mutex> lock(lock_);
+    tree_.insert(keyValuePair);
+    appendRecord(INSERT_RECORD, keyValuePair.first, &keyValuePair.second);
+    commit(lock, appended_);
+}
+
+/**
+* Inserts the items of a range as one batch, which a crash keeps all or
+* none of, and returns once they are on disk.
+*/
+template<class Key, class Value, class Compare, class Tree>
+template<typename InputIt>
+void JournaledTree<Key, Value, Compare, Tree>::insert(InputIt first, InputIt last)
+{
+    std::unique_lock<std::mutex> lock(lock_);
+    uint64_t before = appended_;
+    for (; first != last; ++first) {
+        tree_.insert(*first);
+        appendRecord(INSERT_RECORD, first->first, &first->second);
+    }
+    if (appended_ != before) {
+        commit(lock, appended_);
+    }
+}
+
+/**
+* Removes key from the tree, if it is there, and returns once the removal
+* is on disk.
+*/
+template<class Key, class Value, class Compare, class Tree>
+void JournaledTree<Key, Value, Compare, Tree>::remove(const Key& key)
+{
+    std::unique_lock<std::mutex> lock(lock_);
+    tree_.remove(key);
+    appendRecord(REMOVE_RECORD, key, nullptr);
+    commit(lock, appended_);
+}
+
+/**
+* Writes a snapshot of the tree now and deletes the files it replaces,
+* waiting until that is done. Throws std::runtime_error if no new journal
+* can be started.
+*/
+template<class Key, class Value, class Compare, class Tree>
+void JournaledTree<Key, Value, Compare, Tree>::compact()
+{
+    std::unique_lock<std::mutex> lock(lock_);
+    while (flushing_ || compacting_) {
+        changed_.wait(lock);
+    }
+    startCompaction();
+    while (compacting_) {
+        changed_.wait(lock);
+    }
+}
+
+/**
+* Adds a record to the ones waiting for the next flush: its type, the key,
+* and the value if it has one. Called with the lock held.
+*/
+template<class Key, class Value, class Compare, class Tree>
+void JournaledTree<Key, Value, Compare, Tree>::appendRecord(char type, const Key& key, const Value* value)
+{
+    size_t at = pending_.size();
+    pending_.resize(at + 1 + sizeof(Key) + (value != nullptr ? sizeof(Value) : 0));
+    pending_[at] = type;
+    std::memcpy(&pending_[at + 1], &key, sizeof(Key));
+    if (value != nullptr) {
+        std::memcpy(&pending_[at + 1 + sizeof(Key)], value, sizeof(Value));
+    }
+    appended_++;
+}
+
+/**
+* Waits until the record with the given sequence number is on disk. If no
+* one is flushing, this writer flushes every waiting record as one batch,
+* with the lock released during the write and fsync, so later writers can
+* queue up behind it for the next batch. Starts a compaction once the
+* journal is big enough. Once a flush fails, this and every later commit
+* throws std::runtime_error, as the journal may have lost records.
+*/
+template<class Key, class Value, class Compare, class Tree>
+void JournaledTree<Key, Value, Compare, Tree>::commit(std::unique_lock<std::mutex>& lock, uint64_t sequence)
+{
+    while (written_ < sequence) {
+        if (broken_) throw std::runtime_error("Failed writing the journal of " + path_);
+        if (flushing_) {
+            changed_.wait(lock);
+            continue;
+        }
+
+        std::vector<char> batch(sizeof(BatchHeader));
+        batch.swap(pending_);
+        uint64_t last = appended_;
+        int fd = journalFd_;
+        BatchHeader header;
+        header.bytes = batch.size() - sizeof(BatchHeader);
+        header.checksum = journalChecksum(header.bytes, batch.data() + sizeof(BatchHeader), header.bytes);
+        std::memcpy(batch.data(), &header, sizeof(header));
+
+        flushing_ = true;
+        lock.unlock();
+        bool failed = false;
+        try {
+            writeAll(fd, batch.data(), batch.size());
+            if (::fsync(fd) != 0) throw std::runtime_error("Failed syncing a journal");
+        }
+        catch (...) {
+            failed = true;
+        }
+        lock.lock();
+        flushing_ = false;
+        broken_ = failed;
+        changed_.notify_all();
+        if (failed) throw std::runtime_error("Failed writing the journal of " + path_);
+
+        written_ = last;
+        journalBytes_ += batch.size();
+        if (journalBytes_ >= compactBytes_ && !compacting_) {
+            try {
+                startCompaction();
+            }
+            catch (const std::runtime_error&) {
+                // Keep using the current journal and try again after the next flush
+            }
+        }
+    }
+}
+
+/**
+* Switches to a new journal and starts writing a snapshot of the tree on a
+* background thread. Every edit from now on, and those still waiting to be
+* flushed, go to the new journal, even where the snapshot has them too;
+* replaying an edit onto a tree that already has it changes nothing. Called
+* with the lock held, while no one is flushing or compacting.
+*/
+template<class Key, class Value, class Compare, class Tree>
+void JournaledTree<Key, Value, Compare, Tree>::startCompaction()
+{
+    uint64_t generation = generation_ + 1;
+    int fd = createJournal(generation);
+    ::close(journalFd_);
+    journalFd_ = fd;
+    generation_ = generation;
+    journalBytes_ = sizeof(JournalHeader);
+
+    compacting_ = true;
+    if (compactor_.joinable()) {
+        compactor_.join();
+    }
+    compactor_ = std::thread(&JournaledTree::writeSnapshot, this, generation);
+}
+
+/**
+* Runs on the compaction thread: copies the items of the tree, writes them
+* out as the snapshot path.snap.<generation>, makes it durable under its final name, then
+* deletes every older snapshot and journal. If anything fails, the older
+* files are kept, so no edits are lost, and the next compaction tries again.
+*
+* The copy may hold edits made while it was taken, which may not be on disk
+* yet, and may hold only part of a batch. So the snapshot only takes its
+* final name once every edit in it is in the new journal too, where replay
+* finds the rest of the batch.
+*/
+template<class Key, class Value, class Compare, class Tree>
+void JournaledTree<Key, Value, Compare, Tree>::writeSnapshot(uint64_t generation)
+{
+    try {
+        std::string target = filePath("snap", generation);
+        std::string temporary = target + ".tmp";
+        uint64_t copied;
+        {
+            // The copy is already in key order, so it goes straight to the
+            // file, with no tree built around it
+            std::vector<std::pair<Key, Value> > items;
+            copied = copyItems(items);
+            typename Tree::SnapshotWriter writer(temporary, items.size());
+            for (size_t i = 0; i < items.size(); ++i) {
+                writer.write(items[i].first, items[i].second);
+            }
+            writer.finish();
+        }
+        syncPath(temporary);
+        {
+            std::unique_lock<std::mutex> lock(lock_);
+            while (written_ < copied && !broken_) {
+                changed_.wait(lock);
+            }
+            if (written_ < copied) throw std::runtime_error("Failed writing the journal of " + path_);
+        }
+        if (std::rename(temporary.c_str(), target.c_str()) != 0) {
+            throw std::runtime_error("Cannot rename " + temporary);
+        }
+        size_t slash = path_.rfind('/');
+        syncPath(slash == std::string::npos ? "." : path_.substr(0, slash + 1));
+        removeFilesBefore(generation);
+    }
+    catch (const std::exception&) {
+        // Leave the older files in place
+    }
+
+    std::lock_guard<std::mutex> guard(lock_);
+    compacting_ = false;
+    changed_.notify_all();
+}
+
+/**
+* Runs on the compaction thread: copies the items of the tree into items in
+* key order, COMPACT_CHUNK_ITEMS at a time, letting go of the lock between
+* chunks. Edits made in between may or may not make it into the copy.
+* Returns the sequence number of the last record appended by the time the
+* copy was finished, so the copy holds no later edit.
+*/
+template<class Key, class Value, class Compare, class Tree>
+uint64_t JournaledTree<Key, Value, Compare, Tree>::copyItems(std::vector<std::pair<Key, Value> >& items) const
+{
+    std::unique_lock<std::mutex> lock(lock_);
+    items.reserve(tree_.size());
+    typename Tree::iterator it = tree_.begin();
+    while (it != tree_.end()) {
+        for (size_t copied = 0; copied < COMPACT_CHUNK_ITEMS && it != tree_.end(); ++copied, ++it) {
+            items.push_back(*it);
+        }
+        if (it == tree_.end()) break;
+
+        // Let waiting readers and writers in, then pick up after the last
+        // key copied, wherever it is now
+        lock.unlock();
+        std::this_thread::yield();
+        lock.lock();
+        it = tree_.upper_bound(items.back().first);
+    }
+    return appended_;
+}
+
+/**
+* Applies the batches of journal path.log.<generation> to the tree, up to
+* the first one that is incomplete or fails its checksum.
+*/
+template<class Key, class Value, class Compare, class Tree>
+void JournaledTree<Key, Value, Compare, Tree>::replayJournal(uint64_t generation)
+{
+    std::string journal = filePath("log", generation);
+    std::ifstream in(journal.c_str(), std::ios::binary);
+    if (!in) throw std::runtime_error("Cannot open " + journal);
+    std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    // A crash right after the journal was created can leave its header torn
+    if (data.size() < sizeof(JournalHeader)) return;
+    JournalHeader found;
+    JournalHeader expected = journalHeader();
+    std::memcpy(&found, data.data(), sizeof(found));
+    if (std::memcmp(found.magic, expected.magic, sizeof(found.magic)) != 0) {
+        throw std::runtime_error(journal + " is not a tree journal");
+    }
+    if (found.byteOrder != expected.byteOrder || found.version != expected.version ||
+        found.keyBytes != expected.keyBytes || found.valueBytes != expected.valueBytes) {
+        throw std::runtime_error(journal + " was written for another kind of tree");
+    }
+
+    size_t at = sizeof(JournalHeader);
+    while (data.size() - at >= sizeof(BatchHeader)) {
+        BatchHeader header;
+        std::memcpy(&header, &data[at], sizeof(header));
+        at += sizeof(header);
+        if (header.bytes > data.size() - at) return;
+        const char* record = &data[at];
+        const char* end = record + header.bytes;
+        if (journalChecksum(header.bytes, record, header.bytes) != header.checksum) return;
+        at += header.bytes;
+
+        while (end - record >= static_cast<std::ptrdiff_t>(1 + sizeof(Key))) {
+            std::pair<Key, Value> item;
+            std::memcpy(&item.first, record + 1, sizeof(Key));
+            if (*record == REMOVE_RECORD) {
+                tree_.remove(item.first);
+                record += 1 + sizeof(Key);
+            }
+            else {
+                std::memcpy(&item.second, record + 1 + sizeof(Key), sizeof(Value));
+                tree_.insert(item);
+                record += 1 + sizeof(Key) + sizeof(Value);
+            }
+        }
+    }
+}
+
+/**
+* Creates journal path.log.<generation>, replacing any file there, writes
+* its header and makes it durable. Returns its file descriptor.
+*/
+template<class Key, class Value, class Compare, class Tree>
+int JournaledTree<Key, Value, Compare, Tree>::createJournal(uint64_t generation) const
+{
+    std::string journal = filePath("log", generation);
+    int fd = ::open(journal.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd < 0) throw std::runtime_error("Cannot open " + journal + " for writing");
+
+    JournalHeader header = journalHeader();
+    try {
+        writeAll(fd, reinterpret_cast<const char*>(&header), sizeof(header));
+        if (::fsync(fd) != 0) throw std::runtime_error("Failed writing " + journal);
+        size_t slash = path_.rfind('/');
+        syncPath(slash == std::string::npos ? "." : path_.substr(0, slash + 1));
+    }
+    catch (...) {
+        ::close(fd);
+        throw;
+    }
+    return fd;
+}
+
+/**
+* Finds the generations of the snapshots and journals of this tree on disk.
+*/
+template<class Key, class Value, class Compare, class Tree>
+void JournaledTree<Key, Value, Compare, Tree>::listFiles(std::vector<uint64_t>& snapshots,
+                                                         std::vector<uint64_t>& journals) const
+{
+    size_t slash = path_.rfind('/');
+    std::string directory = (slash == std::string::npos) ? "." : path_.substr(0, slash + 1);
+    std::string name = (slash == std::string::npos) ? path_ : path_.substr(slash + 1);
+
+    DIR* dir = opendir(directory.c_str());
+    if (dir == nullptr) throw std::runtime_error("Cannot open " + directory);
+    while (struct dirent* entry = readdir(dir)) {
+        std::string file = entry->d_name;
+        if (file.compare(0, name.size() + 1, name + ".") != 0) continue;
+        std::string suffix = file.substr(name.size() + 1);
+        std::vector<uint64_t>* found;
+        if (suffix.compare(0, 5, "snap.") == 0) {
+            found = &snapshots;
+            suffix = suffix.substr(5);
+        }
+        else if (suffix.compare(0, 4, "log.") == 0) {
+            found = &journals;
+            suffix = suffix.substr(4);
+        }
+        else {
+            continue;
+        }
+        if (suffix.empty() || suffix.find_first_not_of("0123456789") != std::string::npos) continue;
+        found->push_back(std::strtoull(suffix.c_str(), nullptr, 10));
+    }
+    closedir(dir);
+}
+
+/**
+* Deletes the snapshots and journals older than the given generation.
+*/
+template<class Key, class Value, class Compare, class Tree>
+void JournaledTree<Key, Value, Compare, Tree>::removeFilesBefore(uint64_t generation) const
+{
+    std::vector<uint64_t> snapshots;
+    std::vector<uint64_t> journals;
+    listFiles(snapshots, journals);
+    for (size_t i = 0; i < snapshots.size(); ++i) {
+        if (snapshots[i] < generation) std::remove(filePath("snap", snapshots[i]).c_str());
+    }
+    for (size_t i = 0; i < journals.size(); ++i) {
+        if (journals[i] < generation) std::remove(filePath("log", journals[i]).c_str());
+    }
+}
+
+/**
+* Returns the name of a snapshot ("snap") or journal ("log") of this tree.
+*/
+template<class Key, class Value, class Compare, class Tree>
+std::string JournaledTree<Key, Value, Compare, Tree>::filePath(const char* kind, uint64_t generation) const
+{
+    return path_ + "." + kind + "." + std::to_string(generation);
+}
+
+/**
+* Returns the header of a journal of this tree's types.
+*/
+template<class Key, class Value, class Compare, class Tree>
+typename JournaledTree<Key, Value, Compare, Tree>::JournalHeader
+JournaledTree<Key, Value, Compare, Tree>::journalHeader()
+{
+    JournalHeader header;
+    std::memcpy(header.magic, "BSTJRNL", sizeof(header.magic));
+    header.version = JOURNAL_VERSION;
+    header.keyBytes = sizeof(Key);
+    header.valueBytes = sizeof(Value);
+    header.byteOrder = 0x01020304;
+    return header;
+}
+
+/**
+* Writes all of data to fd, however many calls that takes. Throws
+* std::runtime_error if writing fails.
+*/
+template<class Key, class Value, class Compare, class Tree>
+void JournaledTree<Key, Value, Compare, Tree>::writeAll(int fd, const char* data, size_t bytes)
+{
+    while (bytes > 0) {
+        ssize_t written = ::write(fd, data, bytes);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("Failed writing a journal");
+        }
+        data += written;
+        bytes -= static_cast<size_t>(written);
+    }
+}
+
+/**
+* Makes a file, or the entries of a directory, durable. Throws
+* std::runtime_error if that fails.
+*/
+template<class Key, class Value, class Compare, class Tree>
+void JournaledTree<Key, Value, Compare, Tree>::syncPath(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Cannot open " + path);
+    int result = ::fsync(fd);
+    ::close(fd);
+    if (result != 0) throw std::runtime_error("Failed syncing " + path);
+}
+
+/**
+* Continues a checksum over the next bytes of a journal, the same way
+* BinarySearchTree checksums its snapshots.
+*/
+template<class Key, class Value, class Compare, class Tree>
+uint64_t JournaledTree<Key, Value, Compare, Tree>::journalChecksum(uint64_t hash, const char* data, size_t bytes)
+{
+    const uint64_t prime = 0x100000001b3ULL;
+    size_t i = 0;
+    for (; i + 8 <= bytes; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 32;
+    }
+    for (; i < bytes; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * prime;
+    }
+    return hash;
+}
+
+/*
+  ------------------------------------------------
+  End implementations for the JournaledTree class.
+  ------------------------------------------------
+*/
+
+#endif
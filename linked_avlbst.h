@@ -0,0 +1,436 @@
+#ifndef LINKED_AVLBST_H
+#define LINKED_AVLBST_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+
+/**
+* The AVL algorithm of the trees whose nodes link to each other by integer
+* handles, such as slot indices or file offsets, instead of by pointers:
+* linking and unlinking nodes, the rebalancing after either, in-order
+* traversal and the invariant checks. Where the nodes live and how their
+* links are packed is up to Tree, which derives from this class and
+* provides the link accessors as members:
+*
+*   static const Link NONE;                 the handle meaning "no node"
+*   Link root() const;                      and void setRoot(Link)
+*   Link left(Link) const;                  and void setLeft(Link, Link)
+*   Link right(Link) const;                 and void setRight(Link, Link)
+*   Link parent(Link) const;                and void setParent(Link, Link)
+*   int balance(Link) const;                and void setBalance(Link, int)
+*   bool isNode(Link) const;                whether a handle is in range
+*   int compareNodes(Link, Link) const;     the order of two nodes' keys
+*
+* A tree that keeps these protected must befriend this class.
+*/
+template <class Tree, class Link>
+class LinkedAVLTree
+{
+protected:
+    void attach(Link parent, Link node, bool toLeft);
+    void unlink(Link node);
+    Link first() const;
+    Link successor(Link node) const;
+    int treeHeight() const;
+    bool isValidTree(size_t size) const;
+
+    void insertFix(Link node, Link child);
+    void removeFix(Link node, int diff);
+    void rotateLeft(Link x);
+    void rotateRight(Link y);
+    void replaceChild(Link parent, Link oldChild, Link newChild);
+    int audit(Link node, Link parent, size_t& count) const;
+
+    Tree& tree();
+    const Tree& tree() const;
+};
+
+/*
+  --------------------------------------------------
+  Begin implementations for the LinkedAVLTree class.
+  --------------------------------------------------
+*/
+
+/**
+* Links a new leaf under parent (or makes it the root, if parent is NONE)
+* on the given side, and rebalances.
+*/
+template<class Tree, class Link>
+void LinkedAVLTree<Tree, Link>::attach(Link parent, Link node, bool toLeft)
+{
+    if (parent == Tree::NONE) {
+        tree().setRoot(node);
+    }
+    else if (toLeft) {
+        tree().setLeft(parent, node);
+    }
+    else {
+        tree().setRight(parent, node);
+    }
+    insertFix(parent, node);
+}
+
+/**
+* Unlinks node from the tree and rebalances, leaving node itself for the
+* caller to free. A node with two children is replaced by its predecessor,
+* relinked into its place, so handles to other nodes stay valid.
+*/
+template<class Tree, class Link>
+void LinkedAVLTree<Tree, Link>::unlink(Link node)
+{
+    Tree& t = tree();
+
+    // Where the subtree lost height, and on which side
+    Link fixNode;
+    int diff;
+
+    if (t.left(node) != Tree::NONE && t.right(node) != Tree::NONE) {
+        Link pred = t.left(node);
+        while (t.right(pred) != Tree::NONE) {
+            pred = t.right(pred);
+        }
+
+        // Unhook the predecessor, which has no right child
+        Link predParent = t.parent(pred);
+        Link predChild = t.left(pred);
+        if (predParent == node) {
+            fixNode = pred;
+            diff = -1;
+        }
+        else {
+            t.setRight(predParent, predChild);
+            if (predChild != Tree::NONE) t.setParent(predChild, predParent);
+            t.setLeft(pred, t.left(node));
+            t.setParent(t.left(node), pred);
+            fixNode = predParent;
+            diff = 1;
+        }
+
+        // Move it into node's place
+        t.setRight(pred, t.right(node));
+        t.setParent(t.right(node), pred);
+        t.setParent(pred, t.parent(node));
+        t.setBalance(pred, t.balance(node));
+        replaceChild(t.parent(node), node, pred);
+    }
+    else {
+        Link child = (t.left(node) != Tree::NONE) ? t.left(node) : t.right(node);
+        fixNode = t.parent(node);
+        diff = (fixNode != Tree::NONE && t.left(fixNode) == node) ? -1 : 1;
+        if (child != Tree::NONE) t.setParent(child, fixNode);
+        replaceChild(fixNode, node, child);
+    }
+
+    removeFix(fixNode, diff);
+}
+
+/**
+* Returns the node with the "smallest" key, or NONE if the tree is empty.
+*/
+template<class Tree, class Link>
+Link LinkedAVLTree<Tree, Link>::first() const
+{
+    const Tree& t = tree();
+    Link node = t.root();
+    while (node != Tree::NONE && t.left(node) != Tree::NONE) {
+        node = t.left(node);
+    }
+    return node;
+}
+
+/**
+* Returns the node following the given one in key order, or NONE.
+*/
+template<class Tree, class Link>
+Link LinkedAVLTree<Tree, Link>::successor(Link node) const
+{
+    const Tree& t = tree();
+    if (t.right(node) != Tree::NONE) {
+        node = t.right(node);
+        while (t.left(node) != Tree::NONE) {
+            node = t.left(node);
+        }
+        return node;
+    }
+    Link up = t.parent(node);
+    while (up != Tree::NONE && t.right(up) == node) {
+        node = up;
+        up = t.parent(up);
+    }
+    return up;
+}
+
+/**
+* Returns the height of the tree (-1 when empty), following the taller
+* child at every level as told by the balance factors.
+*/
+template<class Tree, class Link>
+int LinkedAVLTree<Tree, Link>::treeHeight() const
+{
+    const Tree& t = tree();
+    int height = -1;
+    for (Link node = t.root(); node != Tree::NONE; ) {
+        height++;
+        node = (t.balance(node) < 0) ? t.right(node) : t.left(node);
+    }
+    return height;
+}
+
+/**
+* Checks every AVL invariant in one O(n) pass: handles in range, keys in
+* order, parent links, the height balance of every subtree, each node's
+* stored balance, and that there are size nodes.
+*/
+template<class Tree, class Link>
+bool LinkedAVLTree<Tree, Link>::isValidTree(size_t size) const
+{
+    size_t count = 0;
+    if (audit(tree().root(), Tree::NONE, count) < -1) return false;
+    return count == size;
+}
+
+/**
+* Rebalances after child grew taller under node, walking up until a
+* subtree's height stops changing or one rotation restores it.
+*/
+template<class Tree, class Link>
+void LinkedAVLTree<Tree, Link>::insertFix(Link node, Link child)
+{
+    Tree& t = tree();
+    while (node != Tree::NONE) {
+        int b = t.balance(node) + ((t.left(node) == child) ? 1 : -1);
+        if (b == 0) {
+            t.setBalance(node, 0);
+            return;
+        }
+        if (b == 1 || b == -1) {
+            t.setBalance(node, b);
+            child = node;
+            node = t.parent(node);
+            continue;
+        }
+
+        if (b == 2) {
+            Link l = t.left(node);
+            if (t.balance(l) == 1) {
+                // Left-left case
+                rotateRight(node);
+                t.setBalance(node, 0);
+                t.setBalance(l, 0);
+            }
+            else {
+                // Left-right case
+                Link g = t.right(l);
+                int gb = t.balance(g);
+                rotateLeft(l);
+                rotateRight(node);
+                t.setBalance(node, (gb == 1) ? -1 : 0);
+                t.setBalance(l, (gb == -1) ? 1 : 0);
+                t.setBalance(g, 0);
+            }
+        }
+        else {
+            Link r = t.right(node);
+            if (t.balance(r) == -1) {
+                // Right-right case
+                rotateLeft(node);
+                t.setBalance(node, 0);
+                t.setBalance(r, 0);
+            }
+            else {
+                // Right-left case
+                Link g = t.left(r);
+                int gb = t.balance(g);
+                rotateRight(r);
+                rotateLeft(node);
+                t.setBalance(node, (gb == -1) ? 1 : 0);
+                t.setBalance(r, (gb == 1) ? -1 : 0);
+                t.setBalance(g, 0);
+            }
+        }
+        return;
+    }
+}
+
+/**
+* Rebalances after the subtree on one side of node lost height: diff is -1
+* for the left side and 1 for the right. Walks up until a subtree's height
+* stops changing.
+*/
+template<class Tree, class Link>
+void LinkedAVLTree<Tree, Link>::removeFix(Link node, int diff)
+{
+    Tree& t = tree();
+    while (node != Tree::NONE) {
+        Link up = t.parent(node);
+        int nextDiff = (up != Tree::NONE && t.left(up) == node) ? -1 : 1;
+        int b = t.balance(node) + diff;
+
+        if (b == 1 || b == -1) {
+            t.setBalance(node, b);
+            return;
+        }
+        if (b == 2) {
+            Link l = t.left(node);
+            int lb = t.balance(l);
+            if (lb >= 0) {
+                // Left-left case
+                rotateRight(node);
+                if (lb == 0) {
+                    t.setBalance(node, 1);
+                    t.setBalance(l, -1);
+                    return;
+                }
+                t.setBalance(node, 0);
+                t.setBalance(l, 0);
+            }
+            else {
+                // Left-right case
+                Link g = t.right(l);
+                int gb = t.balance(g);
+                rotateLeft(l);
+                rotateRight(node);
+                t.setBalance(node, (gb == 1) ? -1 : 0);
+                t.setBalance(l, (gb == -1) ? 1 : 0);
+                t.setBalance(g, 0);
+            }
+        }
+        else if (b == -2) {
+            Link r = t.right(node);
+            int rb = t.balance(r);
+            if (rb <= 0) {
+                // Right-right case
+                rotateLeft(node);
+                if (rb == 0) {
+                    t.setBalance(node, -1);
+                    t.setBalance(r, 1);
+                    return;
+                }
+                t.setBalance(node, 0);
+                t.setBalance(r, 0);
+            }
+            else {
+                // Right-left case
+                Link g = t.left(r);
+                int gb = t.balance(g);
+                rotateRight(r);
+                rotateLeft(node);
+                t.setBalance(node, (gb == -1) ? 1 : 0);
+                t.setBalance(r, (gb == 1) ? -1 : 0);
+                t.setBalance(g, 0);
+            }
+        }
+        else {
+            t.setBalance(node, 0);
+        }
+
+        // The subtree is one shorter than before: keep going up
+        node = up;
+        diff = nextDiff;
+    }
+}
+
+/**
+* Rotates the right child of x up into x's place. Balances are left to the caller.
+*/
+template<class Tree, class Link>
+void LinkedAVLTree<Tree, Link>::rotateLeft(Link x)
+{
+    Tree& t = tree();
+    Link y = t.right(x);
+    Link up = t.parent(x);
+    Link middle = t.left(y);
+
+    t.setRight(x, middle);
+    if (middle != Tree::NONE) t.setParent(middle, x);
+    t.setLeft(y, x);
+    t.setParent(x, y);
+    t.setParent(y, up);
+    replaceChild(up, x, y);
+}
+
+/**
+* Rotates the left child of y up into y's place. Balances are left to the caller.
+*/
+template<class Tree, class Link>
+void LinkedAVLTree<Tree, Link>::rotateRight(Link y)
+{
+    Tree& t = tree();
+    Link x = t.left(y);
+    Link up = t.parent(y);
+    Link middle = t.right(x);
+
+    t.setLeft(y, middle);
+    if (middle != Tree::NONE) t.setParent(middle, y);
+    t.setRight(x, y);
+    t.setParent(y, x);
+    t.setParent(x, up);
+    replaceChild(up, y, x);
+}
+
+/**
+* Points the link of parent (or the root, if parent is NONE) that led to
+* oldChild at newChild instead.
+*/
+template<class Tree, class Link>
+void LinkedAVLTree<Tree, Link>::replaceChild(Link parent, Link oldChild, Link newChild)
+{
+    Tree& t = tree();
+    if (parent == Tree::NONE) {
+        t.setRoot(newChild);
+    }
+    else if (t.left(parent) == oldChild) {
+        t.setLeft(parent, newChild);
+    }
+    else {
+        t.setRight(parent, newChild);
+    }
+}
+
+/**
+* Checks the subtree under node (see isValidTree()) and counts its nodes.
+* Returns its height, or -2 if something is wrong.
+*/
+template<class Tree, class Link>
+int LinkedAVLTree<Tree, Link>::audit(Link node, Link parent, size_t& count) const
+{
+    const Tree& t = tree();
+    if (node == Tree::NONE) return -1;
+    if (!t.isNode(node) || t.parent(node) != parent) return -2;
+
+    Link l = t.left(node);
+    Link r = t.right(node);
+    if (l != Tree::NONE && (!t.isNode(l) || t.compareNodes(l, node) >= 0)) return -2;
+    if (r != Tree::NONE && (!t.isNode(r) || t.compareNodes(r, node) <= 0)) return -2;
+
+    int leftHeight = audit(l, node, count);
+    int rightHeight = audit(r, node, count);
+    if (leftHeight < -1 || rightHeight < -1) return -2;
+    if (t.balance(node) != leftHeight - rightHeight || std::abs(leftHeight - rightHeight) > 1) return -2;
+    count++;
+    return 1 + std::max(leftHeight, rightHeight);
+}
+
+/**
+* Returns 'this' as the tree deriving from this class.
+*/
+template<class Tree, class Link>
+Tree& LinkedAVLTree<Tree, Link>::tree()
+{
+    return static_cast<Tree&>(*this);
+}
+
+template<class Tree, class Link>
+const Tree& LinkedAVLTree<Tree, Link>::tree() const
+{
+    return static_cast<const Tree&>(*this);
+}
+
+/*
+  ------------------------------------------------
+  End implementations for the LinkedAVLTree class.
+  ------------------------------------------------
+*/
+
+#endif
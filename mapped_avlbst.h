@@ -0,0 +1,830 @@
+#ifndef MAPPED_AVLBST_H
+#define MAPPED_AVLBST_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bst.h"
+#include "linked_avlbst.h"
+
+/**
+* An AVL tree with the same interface as AVLTree whose nodes live in a
+* memory-mapped file instead of on the heap. Nodes link to each other by
+* byte offsets from the start of the file rather than by pointers, so the
+* file means the same thing wherever it is mapped: opening an existing tree
+* is O(1), pages are read in lazily as searches touch them, and any number
+* of processes can share one read-only tree through the page cache.
+*
+* Keys and values are stored as raw bytes, so both must be trivially
+* copyable, and a file can only be opened with the key and value types and
+* byte order it was created with. Changes reach the file through the shared
+* mapping, and sync() waits until they are on disk; a crash in the middle of
+* an update can leave the file inconsistent. Iterators stay valid until
+* their item is removed, but references to items are only good until the
+* next insert, which may move the mapping as the file grows. There may be
+* one writer per file, and no readers while it writes. The rebalancing is
+* that of LinkedAVLTree, shared with CompactAVLTree.
+*/
+template <class Key, class Value, class Compare = ThreeWayCompare<Key> >
+class MappedAVLTree : protected LinkedAVLTree<MappedAVLTree<Key, Value, Compare>, uint64_t>
+{
+public:
+    explicit MappedAVLTree(const std::string& path, bool readOnly = false);
+    MappedAVLTree(const std::string& path, bool readOnly, const Compare& comp);
+    ~MappedAVLTree();
+
+    /**
+    * An iterator over the items in key order.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        std::pair<const Key, Value>& operator*() const;
+        std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class MappedAVLTree<Key, Value, Compare>;
+        iterator(const MappedAVLTree* tree, uint64_t offset);
+        const MappedAVLTree* tree_;
+        uint64_t offset_;
+    };
+
+    std::pair<iterator, bool> insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    void sync() const;
+    bool empty() const;
+    size_t size() const;
+    int height() const;
+    bool isValid() const;
+    bool isReadOnly() const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+    // Not copyable
+    MappedAVLTree(const MappedAVLTree& other) = delete;
+    MappedAVLTree& operator=(const MappedAVLTree& other) = delete;
+
+protected:
+    friend class LinkedAVLTree<MappedAVLTree<Key, Value, Compare>, uint64_t>;
+
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                  "MappedAVLTree needs trivially copyable keys and values");
+
+    // What the file starts with. The tree's root and bookkeeping live here,
+    // in the mapping, so they are saved along with the nodes.
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t keyBytes;
+        uint32_t valueBytes;
+        uint32_t byteOrder;
+        uint64_t root;
+        uint64_t unused;    // offset of the first slot never handed out yet
+        uint64_t free;      // head of the freelist of removed slots
+        uint64_t size;
+    };
+    struct Slot {
+        Slot(const Key& key, const Value& value, uint64_t parent);
+        std::pair<const Key, Value> item;
+        uint64_t left;
+        uint64_t right;
+        uint64_t parent;
+        int8_t balance;
+    };
+    // What an unused slot holds: the next one on the freelist
+    struct FreeSlot {
+        uint64_t next;
+    };
+
+    // Offset 0 is the header, so it stands for "no node"
+    static const uint64_t NONE = 0;
+    static const uint32_t FILE_VERSION = 1;
+    static const size_t INITIAL_FILE_BYTES = 1 << 16;
+
+    void openFile(const std::string& path);
+    void mapFile(size_t bytes);
+    void unmapFile();
+    void grow(size_t bytes);
+    void checkWritable() const;
+    static uint64_t firstSlot();
+    static FileHeader emptyHeader();
+
+    FileHeader& header() const;
+    Slot& slot(uint64_t offset) const;
+    uint64_t root() const;
+    uint64_t left(uint64_t offset) const;
+    uint64_t right(uint64_t offset) const;
+    uint64_t parent(uint64_t offset) const;
+    int balance(uint64_t offset) const;
+    void setRoot(uint64_t offset);
+    void setLeft(uint64_t offset, uint64_t left);
+    void setRight(uint64_t offset, uint64_t right);
+    void setParent(uint64_t offset, uint64_t parent);
+    void setBalance(uint64_t offset, int balance);
+    bool isNode(uint64_t offset) const;
+    int compareNodes(uint64_t a, uint64_t b) const;
+
+    uint64_t createSlot(const Key& key, const Value& value, uint64_t parent);
+    void destroySlot(uint64_t offset);
+
+    uint64_t findOffset(const Key& key) const;
+
+protected:
+    char* base_;            // start of the mapping, or nullptr
+    size_t mappedBytes_;    // length of the mapping, which is the file size
+    int fd_;
+    bool readOnly_;
+    Compare comp_;
+};
+
+/*
+  --------------------------------------------------------
+  Begin implementations for the MappedAVLTree::Slot class.
+  --------------------------------------------------------
+*/
+
+/**
+* Explicit constructor for a balanced leaf under parent.
+*/
+template<class Key, class Value, class Compare>
+MappedAVLTree<Key, Value, Compare>::Slot::Slot(const Key& key, const Value& value, uint64_t parent) :
+    item(key, value),
+    left(NONE),
+    right(NONE),
+    parent(parent),
+    balance(0)
+{
+
+}
+
+/*
+  ------------------------------------------------------
+  End implementations for the MappedAVLTree::Slot class.
+  ------------------------------------------------------
+*/
+
+/*
+  ------------------------------------------------------------
+  Begin implementations for the MappedAVLTree::iterator class.
+  ------------------------------------------------------------
+*/
+
+/**
+* A default constructor that makes an end iterator.
+*/
+template<class Key, class Value, class Compare>
+MappedAVLTree<Key, Value, Compare>::iterator::iterator() :
+    tree_(nullptr),
+    offset_(NONE)
+{
+
+}
+
+/**
+* Explicit constructor for the item in the slot at the given offset of tree.
+*/
+template<class Key, class Value, class Compare>
+MappedAVLTree<Key, Value, Compare>::iterator::iterator(const MappedAVLTree* tree, uint64_t offset) :
+    tree_(offset == NONE ? nullptr : tree),
+    offset_(offset)
+{
+
+}
+
+/**
+* Provides access to the item.
+*/
+template<class Key, class Value, class Compare>
+std::pair<const Key, Value>&
+MappedAVLTree<Key, Value, Compare>::iterator::operator*() const
+{
+    return tree_->slot(offset_).item;
+}
+
+/**
+* Provides access to the address of the item.
+*/
+template<class Key, class Value, class Compare>
+std::pair<const Key, Value>*
+MappedAVLTree<Key, Value, Compare>::iterator::operator->() const
+{
+    return &(tree_->slot(offset_).item);
+}
+
+/**
+* Checks if 'this' iterator's internals have the same value as 'rhs'.
+*/
+template<class Key, class Value, class Compare>
+bool MappedAVLTree<Key, Value, Compare>::iterator::operator==(const iterator& rhs) const
+{
+    return tree_ == rhs.tree_ && offset_ == rhs.offset_;
+}
+
+/**
+* Checks if 'this' iterator's internals have a different value as 'rhs'.
+*/
+template<class Key, class Value, class Compare>
+bool MappedAVLTree<Key, Value, Compare>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Advances the iterator to the next item in key order.
+*/
+template<class Key, class Value, class Compare>
+typename MappedAVLTree<Key, Value, Compare>::iterator&
+MappedAVLTree<Key, Value, Compare>::iterator::operator++()
+{
+    offset_ = tree_->successor(offset_);
+    if (offset_ == NONE) {
+        tree_ = nullptr;
+    }
+    return *this;
+}
+
+/*
+  ----------------------------------------------------------
+  End implementations for the MappedAVLTree::iterator class.
+  ----------------------------------------------------------
+*/
+
+/*
+  --------------------------------------------------
+  Begin implementations for the MappedAVLTree class.
+  --------------------------------------------------
+*/
+
+/**
+* Opens the tree stored in the file at path, or creates an empty one there
+* if the file does not exist or is empty. Only the header is checked, so
+* this takes the same time for any size of tree. A read-only tree maps the
+* file read-only and may not be changed. Throws std::runtime_error if the
+* file cannot be opened or mapped, or holds something other than a tree of
+* these types.
+*/
+template<class Key, class Value, class Compare>
+MappedAVLTree<Key, Value, Compare>::MappedAVLTree(const std::string& path, bool readOnly) :
+    base_(nullptr),
+    mappedBytes_(0),
+    fd_(-1),
+    readOnly_(readOnly)
+{
+    openFile(path);
+}
+
+/**
+* Constructor for a tree whose keys are ordered with the given comparator,
+* which must order them the same way every time the file is opened.
+*/
+template<class Key, class Value, class Compare>
+MappedAVLTree<Key, Value, Compare>::MappedAVLTree(const std::string& path, bool readOnly, const Compare& comp) :
+    base_(nullptr),
+    mappedBytes_(0),
+    fd_(-1),
+    readOnly_(readOnly),
+    comp_(comp)
+{
+    openFile(path);
+}
+
+/**
+* Unmaps and closes the file. Changes not yet written back by sync() still
+* reach the file, through the page cache.
+*/
+template<class Key, class Value, class Compare>
+MappedAVLTree<Key, Value, Compare>::~MappedAVLTree()
+{
+    unmapFile();
+}
+
+/**
+* Inserts an item, overwriting the value of an existing key. Returns an
+* iterator to the item and whether a new item was added. The file grows
+* as needed.
+*/
+template<class Key, class Value, class Compare>
+std::pair<typename MappedAVLTree<Key, Value, Compare>::iterator, bool>
+MappedAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    checkWritable();
+    uint64_t parentOffset = NONE;
+    uint64_t current = header().root;
+    int cmp = 0;
+    while (current != NONE) {
+        cmp = compareKeys(comp_, keyValuePair.first, slot(current).item.first);
+        if (cmp == 0) {
+            slot(current).item.second = keyValuePair.second;
+            return std::make_pair(iterator(this, current), false);
+        }
+        parentOffset = current;
+        current = (cmp < 0) ? left(current) : right(current);
+    }
+
+    uint64_t node = createSlot(keyValuePair.first, keyValuePair.second, parentOffset);
+    header().size++;
+    this->attach(parentOffset, node, cmp < 0);
+    return std::make_pair(iterator(this, node), true);
+}
+
+/**
+* Removes key from the tree, if it is there. A node with two children is
+* replaced by its predecessor, relinked into its place, so iterators to
+* other items stay valid.
+*/
+template<class Key, class Value, class Compare>
+void MappedAVLTree<Key, Value, Compare>::remove(const Key& key)
+{
+    checkWritable();
+    uint64_t node = findOffset(key);
+    if (node == NONE) return;
+
+    this->unlink(node);
+    destroySlot(node);
+    header().size--;
+}
+
+/**
+* Removes every item from the tree. The file keeps its size, and its slots
+* are reused by later inserts.
+*/
+template<class Key, class Value, class Compare>
+void MappedAVLTree<Key, Value, Compare>::clear()
+{
+    checkWritable();
+    header() = emptyHeader();
+}
+
+/**
+* Blocks until every change made so far is written to the file on disk.
+* Throws std::runtime_error if writing fails.
+*/
+template<class Key, class Value, class Compare>
+void MappedAVLTree<Key, Value, Compare>::sync() const
+{
+    if (!readOnly_ && msync(base_, mappedBytes_, MS_SYNC) != 0) {
+        throw std::runtime_error("Failed writing a mapped tree to disk");
+    }
+}
+
+/**
+* Returns true if the tree is empty
+*/
+template<class Key, class Value, class Compare>
+bool MappedAVLTree<Key, Value, Compare>::empty() const
+{
+    return header().size == 0;
+}
+
+/**
+* Returns the number of items in the tree
+*/
+template<class Key, class Value, class Compare>
+size_t MappedAVLTree<Key, Value, Compare>::size() const
+{
+    return header().size;
+}
+
+/**
+* Returns the height of the tree (-1 when empty), following the taller
+* child at every level as told by the balance factors.
+*/
+template<class Key, class Value, class Compare>
+int MappedAVLTree<Key, Value, Compare>::height() const
+{
+    return this->treeHeight();
+}
+
+/**
+* Checks every AVL invariant in one O(n) pass: keys in order, parent links,
+* the height balance of every subtree, each node's stored balance, and
+* size(). Meant for tests.
+*/
+template<class Key, class Value, class Compare>
+bool MappedAVLTree<Key, Value, Compare>::isValid() const
+{
+    return this->isValidTree(header().size);
+}
+
+/**
+* Returns true if the tree was opened read-only
+*/
+template<class Key, class Value, class Compare>
+bool MappedAVLTree<Key, Value, Compare>::isReadOnly() const
+{
+    return readOnly_;
+}
+
+/**
+* Returns an iterator to the "smallest" item in the tree
+*/
+template<class Key, class Value, class Compare>
+typename MappedAVLTree<Key, Value, Compare>::iterator
+MappedAVLTree<Key, Value, Compare>::begin() const
+{
+    return iterator(this, this->first());
+}
+
+/**
+* Returns an iterator whose value means INVALID
+*/
+template<class Key, class Value, class Compare>
+typename MappedAVLTree<Key, Value, Compare>::iterator
+MappedAVLTree<Key, Value, Compare>::end() const
+{
+    return iterator();
+}
+
+/**
+* Returns an iterator to the item with the given key,
+* or the end iterator if key does not exist in the tree
+*/
+template<class Key, class Value, class Compare>
+typename MappedAVLTree<Key, Value, Compare>::iterator
+MappedAVLTree<Key, Value, Compare>::find(const Key& key) const
+{
+    return iterator(this, findOffset(key));
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than key,
+* or the end iterator if there is none.
+*/
+template<class Key, class Value, class Compare>
+typename MappedAVLTree<Key, Value, Compare>::iterator
+MappedAVLTree<Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    uint64_t best = NONE;
+    uint64_t current = header().root;
+    while (current != NONE) {
+        if (compareKeys(comp_, slot(current).item.first, key) < 0) {
+            current = right(current);
+        }
+        else {
+            best = current;
+            current = left(current);
+        }
+    }
+    return iterator(this, best);
+}
+
+/**
+* Returns the value stored under key. Throws std::out_of_range if key is
+* not in the tree. On a read-only tree the value may be read but not
+* assigned: the mapping is read-only, so a write through it faults.
+*/
+template<class Key, class Value, class Compare>
+Value& MappedAVLTree<Key, Value, Compare>::operator[](const Key& key)
+{
+    uint64_t node = findOffset(key);
+    if (node == NONE) throw std::out_of_range("Invalid key");
+    return slot(node).item.second;
+}
+
+template<class Key, class Value, class Compare>
+Value const & MappedAVLTree<Key, Value, Compare>::operator[](const Key& key) const
+{
+    uint64_t node = findOffset(key);
+    if (node == NONE) throw std::out_of_range("Invalid key");
+    return slot(node).item.second;
+}
+
+/**
+* Opens or creates the file at path and maps all of it (see the constructor).
+* Cleans up after itself if it throws.
+*/
+template<class Key, class Value, class Compare>
+void MappedAVLTree<Key, Value, Compare>::openFile(const std::string& path)
+{
+    fd_ = ::open(path.c_str(), readOnly_ ? O_RDONLY : (O_RDWR | O_CREAT), 0644);
+    if (fd_ < 0) throw std::runtime_error("Cannot open " + path);
+
+    try {
+        struct stat info;
+        if (fstat(fd_, &info) != 0) throw std::runtime_error("Cannot open " + path);
+        size_t fileBytes = static_cast<size_t>(info.st_size);
+
+        if (fileBytes == 0 && !readOnly_) {
+            if (ftruncate(fd_, INITIAL_FILE_BYTES) != 0) {
+                throw std::runtime_error("Cannot grow " + path);
+            }
+            mapFile(INITIAL_FILE_BYTES);
+            header() = emptyHeader();
+            return;
+        }
+        if (fileBytes < firstSlot()) throw std::runtime_error(path + " is not a mapped tree");
+        mapFile(fileBytes);
+
+        const FileHeader& found = header();
+        FileHeader expected = emptyHeader();
+        if (std::memcmp(found.magic, expected.magic, sizeof(found.magic)) != 0) {
+            throw std::runtime_error(path + " is not a mapped tree");
+        }
+        if (found.byteOrder != expected.byteOrder) {
+            throw std::runtime_error(path + " was written with another byte order");
+        }
+        if (found.version != expected.version) {
+            throw std::runtime_error(path + " has an unsupported mapped tree version");
+        }
+        if (found.keyBytes != expected.keyBytes || found.valueBytes != expected.valueBytes) {
+            throw std::runtime_error(path + " holds keys or values of another type");
+        }
+        if (found.unused < firstSlot() || found.unused > fileBytes) {
+            throw std::runtime_error(path + " is truncated");
+        }
+        // Every search starts at the root and every insert may take the
+        // head of the freelist, so check both in O(1); isValid() checks
+        // the rest of the file
+        if ((found.root != NONE && !isNode(found.root)) || (found.free != NONE && !isNode(found.free))) {
+            throw std::runtime_error(path + " is corrupt");
+        }
+    }
+    catch (...) {
+        unmapFile();
+        throw;
+    }
+}
+
+/**
+* Maps the first bytes of the file, replacing any earlier mapping.
+*/
+template<class Key, class Value, class Compare>
+void MappedAVLTree<Key, Value, Compare>::mapFile(size_t bytes)
+{
+    if (base_ != nullptr) {
+        munmap(base_, mappedBytes_);
+        base_ = nullptr;
+    }
+    int protection = readOnly_ ? PROT_READ : (PROT_READ | PROT_WRITE);
+    void* address = mmap(nullptr, bytes, protection, MAP_SHARED, fd_, 0);
+    if (address == MAP_FAILED) throw std::runtime_error("Cannot map a tree file");
+    base_ = static_cast<char*>(address);
+    mappedBytes_ = bytes;
+}
+
+/**
+* Unmaps and closes the file, if it is open.
+*/
+template<class Key, class Value, class Compare>
+void MappedAVLTree<Key, Value, Compare>::unmapFile()
+{
+    if (base_ != nullptr) {
+        munmap(base_, mappedBytes_);
+        base_ = nullptr;
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    mappedBytes_ = 0;
+}
+
+/**
+* Grows the file to at least the given size, doubling it so that inserts
+* take amortized O(1) remaps, and maps it again. Offsets stay valid; the
+* mapping may move.
+*/
+template<class Key, class Value, class Compare>
+void MappedAVLTree<Key, Value, Compare>::grow(size_t bytes)
+{
+    size_t newBytes = std::max(bytes, 2 * mappedBytes_);
+    if (ftruncate(fd_, static_cast<off_t>(newBytes)) != 0) {
+        throw std::runtime_error("Cannot grow a tree file");
+    }
+    mapFile(newBytes);
+}
+
+/**
+* Throws std::logic_error if the tree was opened read-only.
+*/
+template<class Key, class Value, class Compare>
+void MappedAVLTree<Key, Value, Compare>::checkWritable() const
+{
+    if (readOnly_) throw std::logic_error("Cannot change a read-only MappedAVLTree");
+}
+
+/**
+* Returns the offset of the first slot, just past the header.
+*/
+template<class Key, class Value, class Compare>
+uint64_t MappedAVLTree<Key, Value, Compare>::firstSlot()
+{
+    return (sizeof(FileHeader) + alignof(Slot) - 1) / alignof(Slot) * alignof(Slot);
+}
+
+/**
+* Returns true if offset is that of a slot handed out at some point.
+*/
+template<class Key, class Value, class Compare>
+bool MappedAVLTree<Key, Value, Compare>::isNode(uint64_t offset) const
+{
+    return offset >= firstSlot() && offset < header().unused && (offset - firstSlot()) % sizeof(Slot) == 0;
+}
+
+/**
+* Returns the header of an empty tree of this tree's types.
+*/
+template<class Key, class Value, class Compare>
+typename MappedAVLTree<Key, Value, Compare>::FileHeader
+MappedAVLTree<Key, Value, Compare>::emptyHeader()
+{
+    FileHeader header;
+    std::memcpy(header.magic, "AVLMMAP", sizeof(header.magic));
+    header.version = FILE_VERSION;
+    header.keyBytes = sizeof(Key);
+    header.valueBytes = sizeof(Value);
+    header.byteOrder = 0x01020304;
+    header.root = NONE;
+    header.unused = firstSlot();
+    header.free = NONE;
+    header.size = 0;
+    return header;
+}
+
+/**
+* Returns the header at the start of the mapping.
+*/
+template<class Key, class Value, class Compare>
+typename MappedAVLTree<Key, Value, Compare>::FileHeader&
+MappedAVLTree<Key, Value, Compare>::header() const
+{
+    return *reinterpret_cast<FileHeader*>(base_);
+}
+
+/**
+* Returns the slot at the given offset.
+*/
+template<class Key, class Value, class Compare>
+typename MappedAVLTree<Key, Value, Compare>::Slot&
+MappedAVLTree<Key, Value, Compare>::slot(uint64_t offset) const
+{
+    return *reinterpret_cast<Slot*>(base_ + offset);
+}
+
+/**
+* Getters for the root and for the links of the node in a slot. Each
+* returns NONE if there is no such node.
+*/
+template<class Key, class Value, class Compare>
+uint64_t MappedAVLTree<Key, Value, Compare>::root() const
+{
+    return header().root;
+}
+
+template<class Key, class Value, class Compare>
+uint64_t MappedAVLTree<Key, Value, Compare>::left(uint64_t offset) const
+{
+    return slot(offset).left;
+}
+
+template<class Key, class Value, class Compare>
+uint64_t MappedAVLTree<Key, Value, Compare>::right(uint64_t offset) const
+{
+    return slot(offset).right;
+}
+
+template<class Key, class Value, class Compare>
+uint64_t MappedAVLTree<Key, Value, Compare>::parent(uint64_t offset) const
+{
+    return slot(offset).parent;
+}
+
+/**
+* A getter for the balance (left height minus right height) of a node.
+*/
+template<class Key, class Value, class Compare>
+int MappedAVLTree<Key, Value, Compare>::balance(uint64_t offset) const
+{
+    return slot(offset).balance;
+}
+
+/**
+* Setters for the root, and for the links and the balance of a node.
+*/
+template<class Key, class Value, class Compare>
+void MappedAVLTree<Key, Value, Compare>::setRoot(uint64_t offset)
+{
+    header().root = offset;
+}
+
+template<class Key, class Value, class Compare>
+void MappedAVLTree<Key, Value, Compare>::setLeft(uint64_t offset, uint64_t left)
+{
+    slot(offset).left = left;
+}
+
+template<class Key, class Value, class Compare>
+void MappedAVLTree<Key, Value, Compare>::setRight(uint64_t offset, uint64_t right)
+{
+    slot(offset).right = right;
+}
+
+template<class Key, class Value, class Compare>
+void MappedAVLTree<Key, Value, Compare>::setParent(uint64_t offset, uint64_t parent)
+{
+    slot(offset).parent = parent;
+}
+
+template<class Key, class Value, class Compare>
+void MappedAVLTree<Key, Value, Compare>::setBalance(uint64_t offset, int balance)
+{
+    slot(offset).balance = static_cast<int8_t>(balance);
+}
+
+/**
+* Compares the keys of the nodes in two slots.
+*/
+template<class Key, class Value, class Compare>
+int MappedAVLTree<Key, Value, Compare>::compareNodes(uint64_t a, uint64_t b) const
+{
+    return compareKeys(comp_, slot(a).item.first, slot(b).item.first);
+}
+
+/**
+* Constructs a leaf in a free slot, reusing a removed one if there is one
+* and otherwise taking the next unused slot, growing the file if it is
+* full. Returns the slot's offset.
+*/
+template<class Key, class Value, class Compare>
+uint64_t MappedAVLTree<Key, Value, Compare>::createSlot(const Key& key, const Value& value, uint64_t parent)
+{
+    uint64_t offset = header().free;
+    if (offset != NONE) {
+        header().free = reinterpret_cast<FreeSlot*>(&slot(offset))->next;
+        new (&slot(offset)) Slot(key, value, parent);
+        return offset;
+    }
+
+    offset = header().unused;
+    if (offset + sizeof(Slot) > mappedBytes_) {
+        // The key and value may live in the mapping that is about to move
+        Key keyCopy(key);
+        Value valueCopy(value);
+        grow(offset + sizeof(Slot));
+        new (&slot(offset)) Slot(keyCopy, valueCopy, parent);
+    }
+    else {
+        new (&slot(offset)) Slot(key, value, parent);
+    }
+    header().unused = offset + sizeof(Slot);
+    return offset;
+}
+
+/**
+* Puts the slot of a removed node on the freelist. Keys and values are
+* trivially copyable, so there is nothing to destroy.
+*/
+template<class Key, class Value, class Compare>
+void MappedAVLTree<Key, Value, Compare>::destroySlot(uint64_t offset)
+{
+    FreeSlot* freed = new (&slot(offset)) FreeSlot();
+    freed->next = header().free;
+    header().free = offset;
+}
+
+/**
+* Returns the offset of the node with the given key, or NONE.
+*/
+template<class Key, class Value, class Compare>
+uint64_t MappedAVLTree<Key, Value, Compare>::findOffset(const Key& key) const
+{
+    uint64_t current = header().root;
+    while (current != NONE) {
+        int cmp = compareKeys(comp_, key, slot(current).item.first);
+        if (cmp == 0) return current;
+        current = (cmp < 0) ? left(current) : right(current);
+    }
+    return NONE;
+}
+
+/*
+  ------------------------------------------------
+  End implementations for the MappedAVLTree class.
+  ------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,311 @@
+#ifndef NODE_ARENA_H
+#define NODE_ARENA_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <new>
+
+/**
+* A slab allocator for the nodes of a search tree.
+* Blocks are carved out of large contiguous slabs instead of being requested from
+* the heap one at a time, removed nodes are kept on a freelist for reuse, and
+* release() hands every slab back at once. All blocks handed out by an arena have
+* the same size, which is fixed by the first call to allocate().
+*
+* Trees that move nodes between each other (split, join, set operations) link
+* their arenas with share(). Linked arenas pool their slabs into one group that
+* lives until the last of them is released, so a node may be freed into any
+* arena of the group no matter which one allocated it. The arenas of a group
+* may be used on different threads (the halves of a split, say): each arena
+* is still used by one thread at a time, and the group's slab list is guarded
+* by a mutex, which is only taken when a slab is added or groups merge.
+*/
+class NodeArena
+{
+public:
+    NodeArena();
+    ~NodeArena();
+
+    void* allocate(std::size_t bytes);
+    void deallocate(void* block);
+    void release();
+    void share(NodeArena& other);
+    void adopt(NodeArena& other);
+
+    // Not copyable: the slabs belong to exactly one arena (or group)
+    NodeArena(const NodeArena& other) = delete;
+    NodeArena& operator=(const NodeArena& other) = delete;
+
+private:
+    void addSlab();
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+    struct Slab {
+        Slab* next;
+    };
+    // The slabs of a group of linked arenas. When two groups are merged, one
+    // of them hands its slabs to the other and forwards to it from then on.
+    // Both fields are guarded by mutex.
+    struct SlabGroup {
+        SlabGroup() : slabs(nullptr) {}
+        ~SlabGroup();
+        Slab* slabs;
+        std::shared_ptr<SlabGroup> forward;
+        std::mutex mutex;
+    };
+    SlabGroup* group();
+    void addToGroup(Slab* slab);
+
+    static const std::size_t FIRST_SLAB_BLOCKS = 64;
+    static const std::size_t MAX_SLAB_BLOCKS = 1 << 16;
+
+    std::size_t blockSize_;
+    std::size_t slabBlocks_;
+    char* cursor_;
+    char* limit_;
+    std::shared_ptr<SlabGroup> group_;
+    FreeBlock* free_;
+};
+
+/*
+  -----------------------------------------------
+  Begin implementations for the NodeArena class.
+  -----------------------------------------------
+*/
+
+/**
+* Default constructor, which creates an arena that owns no memory yet.
+*/
+inline NodeArena::NodeArena() :
+    blockSize_(0),
+    slabBlocks_(FIRST_SLAB_BLOCKS),
+    cursor_(nullptr),
+    limit_(nullptr),
+    free_(nullptr)
+{
+
+}
+
+/**
+* Destructor, which returns all slabs to the heap unless linked arenas still
+* use them. Any objects still living in the arena must have been destroyed
+* by their owner beforehand.
+*/
+inline NodeArena::~NodeArena()
+{
+    release();
+}
+
+/**
+* Returns a block of at least the given size, reusing a freed block if there
+* is one and otherwise taking the next block of the current slab.
+*/
+inline void* NodeArena::allocate(std::size_t bytes)
+{
+    if (blockSize_ == 0) {
+        // Round up so every block (and the slab header) stays suitably aligned
+        const std::size_t align = alignof(std::max_align_t);
+        std::size_t size = bytes < sizeof(FreeBlock) ? sizeof(FreeBlock) : bytes;
+        blockSize_ = (size + align - 1) / align * align;
+    }
+
+    if (free_ != nullptr) {
+        FreeBlock* block = free_;
+        free_ = block->next;
+        return block;
+    }
+    if (cursor_ == limit_) {
+        addSlab();
+    }
+    void* block = cursor_;
+    cursor_ += blockSize_;
+    return block;
+}
+
+/**
+* Puts a block back on the freelist so the next allocate() can reuse it.
+*/
+inline void NodeArena::deallocate(void* block)
+{
+    FreeBlock* freed = static_cast<FreeBlock*>(block);
+    freed->next = free_;
+    free_ = freed;
+}
+
+/**
+* Gives up this arena's hold on its slabs and resets it for use again. The
+* slabs are freed at once unless a linked arena still holds the group.
+*/
+inline void NodeArena::release()
+{
+    group_.reset();
+    slabBlocks_ = FIRST_SLAB_BLOCKS;
+    cursor_ = nullptr;
+    limit_ = nullptr;
+    free_ = nullptr;
+}
+
+/**
+* Links this arena and other into one group, so that blocks allocated by
+* either may be freed into the other and outlive the arena that allocated
+* them. Both arenas must hand out blocks of the same size.
+*/
+inline void NodeArena::share(NodeArena& other)
+{
+    if (&other == this) return;
+    if (blockSize_ == 0) {
+        blockSize_ = other.blockSize_;
+    }
+    else if (other.blockSize_ == 0) {
+        other.blockSize_ = blockSize_;
+    }
+
+    while (true) {
+        SlabGroup* mine = group();
+        SlabGroup* theirs = other.group();
+        if (mine == nullptr && theirs == nullptr) {
+            group_ = std::make_shared<SlabGroup>();
+        }
+        else if (mine == nullptr) {
+            group_ = other.group_;
+        }
+        else if (theirs != nullptr && mine != theirs) {
+            // Arenas of either group may be adding slabs on other threads,
+            // or merging their group elsewhere, in which case look again
+            std::unique_lock<std::mutex> lockMine(mine->mutex, std::defer_lock);
+            std::unique_lock<std::mutex> lockTheirs(theirs->mutex, std::defer_lock);
+            std::lock(lockMine, lockTheirs);
+            if (mine->forward != nullptr || theirs->forward != nullptr) continue;
+
+            // Move other's slabs into this group and forward other's group here
+            if (theirs->slabs != nullptr) {
+                Slab* last = theirs->slabs;
+                while (last->next != nullptr) {
+                    last = last->next;
+                }
+                last->next = mine->slabs;
+                mine->slabs = theirs->slabs;
+                theirs->slabs = nullptr;
+            }
+            theirs->forward = group_;
+        }
+        other.group_ = group_;
+        return;
+    }
+}
+
+/**
+* Takes over every block of other, leaving it empty. Other's owner must not
+* use any object it still has in there. Unlike share(), this also moves
+* other's free and unused blocks over, so no memory sits idle in other.
+* Other's free blocks are taken even if it has no slabs of its own, since
+* they may have been freed into it from this arena's group. Takes time
+* linear in the number of slabs and free blocks of other.
+*/
+inline void NodeArena::adopt(NodeArena& other)
+{
+    if (&other == this) return;
+    if (other.group() != nullptr) {
+        share(other);
+    }
+
+    if (other.free_ != nullptr) {
+        FreeBlock* tail = other.free_;
+        while (tail->next != nullptr) {
+            tail = tail->next;
+        }
+        tail->next = free_;
+        free_ = other.free_;
+    }
+
+    // Keep whichever unused slab tail is larger; the other one stays idle
+    // until the group is freed
+    if (other.limit_ - other.cursor_ > limit_ - cursor_) {
+        cursor_ = other.cursor_;
+        limit_ = other.limit_;
+        slabBlocks_ = other.slabBlocks_;
+    }
+    other.release();
+}
+
+/**
+* Returns the group that currently holds this arena's slabs, following (and
+* shortening) any forwarding left behind by share(), or NULL if there is none.
+*/
+inline NodeArena::SlabGroup* NodeArena::group()
+{
+    while (group_ != nullptr) {
+        std::shared_ptr<SlabGroup> next;
+        {
+            std::lock_guard<std::mutex> lock(group_->mutex);
+            next = group_->forward;
+        }
+        if (next == nullptr) break;
+        group_ = next;
+    }
+    return group_.get();
+}
+
+/**
+* Allocates a new slab, doubling the slab size each time up to a fixed cap.
+*/
+inline void NodeArena::addSlab()
+{
+    const std::size_t align = alignof(std::max_align_t);
+    const std::size_t header = (sizeof(Slab) + align - 1) / align * align;
+
+    char* memory = static_cast<char*>(std::malloc(header + slabBlocks_ * blockSize_));
+    if (memory == nullptr) throw std::bad_alloc();
+    addToGroup(reinterpret_cast<Slab*>(memory));
+
+    cursor_ = memory + header;
+    limit_ = cursor_ + slabBlocks_ * blockSize_;
+    if (slabBlocks_ < MAX_SLAB_BLOCKS) {
+        slabBlocks_ *= 2;
+    }
+}
+
+/**
+* Puts a new slab on the list of this arena's group, making a group if there
+* is none. Another thread may forward the group elsewhere in the meantime, in
+* which case the slab goes to the group forwarded to.
+*/
+inline void NodeArena::addToGroup(Slab* slab)
+{
+    while (true) {
+        if (group() == nullptr) {
+            group_ = std::make_shared<SlabGroup>();
+        }
+        SlabGroup* current = group_.get();
+        std::lock_guard<std::mutex> lock(current->mutex);
+        if (current->forward == nullptr) {
+            slab->next = current->slabs;
+            current->slabs = slab;
+            return;
+        }
+    }
+}
+
+/**
+* Frees every slab of a group once no arena uses it anymore.
+*/
+inline NodeArena::SlabGroup::~SlabGroup()
+{
+    while (slabs != nullptr) {
+        Slab* next = slabs->next;
+        std::free(slabs);
+        slabs = next;
+    }
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the NodeArena class.
+  ---------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,732 @@
+#ifndef PARENTLESS_AVLBST_H
+#define PARENTLESS_AVLBST_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "bst.h"
+#include "node_arena.h"
+
+/**
+* An AVL tree whose nodes keep no parent pointer, with the same interface as
+* AVLTree. insert() and remove() record the links they follow on the way
+* down and rebalance back up along that record. Iterators carry the stack of
+* ancestors still to visit instead of climbing parent links. An int/int
+* node takes 32 bytes against 40 for an AVLNode. Rotations write two child
+* links rather than up to six links, and removal relinks the predecessor
+* without any node swap.
+*
+* The stacks have a fixed depth of MAX_HEIGHT, which no AVL tree that fits
+* in memory can exceed, so neither updates nor iterators allocate. Unlike
+* AVLTree's, iterators are invalidated by any insert() or remove(), since
+* the paths they hold may change shape.
+*/
+template <class Key, class Value, class Compare = ThreeWayCompare<Key> >
+class ParentlessAVLTree
+{
+protected:
+    struct TreeNode {
+        TreeNode(const Key& key, const Value& value);
+
+        std::pair<const Key, Value> item;
+        TreeNode* left;
+        TreeNode* right;
+        int8_t balance;     // left height minus right height
+    };
+
+    // An AVL tree of height 90 has over 2^62 nodes
+    static const int MAX_HEIGHT = 90;
+
+public:
+    ParentlessAVLTree();
+    explicit ParentlessAVLTree(const Compare& comp);
+    ~ParentlessAVLTree();
+
+    /**
+    * A forward iterator over the items in key order.
+    */
+    class iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef value_type* pointer;
+        typedef value_type& reference;
+
+        iterator();
+        iterator(const iterator& other);
+        iterator& operator=(const iterator& other);
+
+        std::pair<const Key, Value>& operator*() const;
+        std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class ParentlessAVLTree<Key, Value, Compare>;
+        void push(TreeNode* node);
+        // Nodes still to visit, the current one on top
+        TreeNode* stack_[MAX_HEIGHT];
+        int depth_;
+    };
+
+    std::pair<iterator, bool> insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+    size_t size() const;
+    int height() const;
+    bool isValid() const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+    // Not copyable
+    ParentlessAVLTree(const ParentlessAVLTree& other) = delete;
+    ParentlessAVLTree& operator=(const ParentlessAVLTree& other) = delete;
+
+protected:
+    TreeNode* internalFind(const Key& key) const;
+    iterator pathIterator(TreeNode** const* links, const bool* wentLeft, int depth) const;
+    void descend(iterator& it, TreeNode* node, const Key& key) const;
+    static TreeNode* rotateLeft(TreeNode* x);
+    static TreeNode* rotateRight(TreeNode* y);
+    static TreeNode* rebalance(TreeNode* node, bool& shorter);
+    void destroySubtree(TreeNode* node);
+    int audit(const TreeNode* node, size_t& count) const;
+
+protected:
+    TreeNode* root_;
+    size_t size_;
+    NodeArena pool_;
+    Compare comp_;
+};
+
+/*
+  ---------------------------------------------------------------
+  Begin implementations for the ParentlessAVLTree::TreeNode class.
+  ---------------------------------------------------------------
+*/
+
+/**
+* Explicit constructor for a balanced leaf.
+*/
+template<class Key, class Value, class Compare>
+ParentlessAVLTree<Key, Value, Compare>::TreeNode::TreeNode(const Key& key, const Value& value) :
+    item(key, value),
+    left(nullptr),
+    right(nullptr),
+    balance(0)
+{
+
+}
+
+/*
+  -------------------------------------------------------------
+  End implementations for the ParentlessAVLTree::TreeNode class.
+  -------------------------------------------------------------
+*/
+
+/*
+  ---------------------------------------------------------------
+  Begin implementations for the ParentlessAVLTree::iterator class.
+  ---------------------------------------------------------------
+*/
+
+/**
+* A default constructor that makes an end iterator.
+*/
+template<class Key, class Value, class Compare>
+ParentlessAVLTree<Key, Value, Compare>::iterator::iterator() :
+    depth_(0)
+{
+
+}
+
+/**
+* Copy constructor, which copies only the part of the stack in use.
+*/
+template<class Key, class Value, class Compare>
+ParentlessAVLTree<Key, Value, Compare>::iterator::iterator(const iterator& other) :
+    depth_(other.depth_)
+{
+    std::copy(other.stack_, other.stack_ + depth_, stack_);
+}
+
+/**
+* Copy assignment, which copies only the part of the stack in use.
+*/
+template<class Key, class Value, class Compare>
+typename ParentlessAVLTree<Key, Value, Compare>::iterator&
+ParentlessAVLTree<Key, Value, Compare>::iterator::operator=(const iterator& other)
+{
+    depth_ = other.depth_;
+    std::copy(other.stack_, other.stack_ + depth_, stack_);
+    return *this;
+}
+
+/**
+* Provides access to the item.
+*/
+template<class Key, class Value, class Compare>
+std::pair<const Key, Value>&
+ParentlessAVLTree<Key, Value, Compare>::iterator::operator*() const
+{
+    return stack_[depth_ - 1]->item;
+}
+
+/**
+* Provides access to the address of the item.
+*/
+template<class Key, class Value, class Compare>
+std::pair<const Key, Value>*
+ParentlessAVLTree<Key, Value, Compare>::iterator::operator->() const
+{
+    return &(stack_[depth_ - 1]->item);
+}
+
+/**
+* Checks if 'this' iterator is at the same item as 'rhs'.
+*/
+template<class Key, class Value, class Compare>
+bool ParentlessAVLTree<Key, Value, Compare>::iterator::operator==(const iterator& rhs) const
+{
+    if (depth_ == 0 || rhs.depth_ == 0) return depth_ == rhs.depth_;
+    return stack_[depth_ - 1] == rhs.stack_[rhs.depth_ - 1];
+}
+
+/**
+* Checks if 'this' iterator is at a different item than 'rhs'.
+*/
+template<class Key, class Value, class Compare>
+bool ParentlessAVLTree<Key, Value, Compare>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Advances the iterator to the next item: the leftmost node of the right
+* subtree if there is one, and otherwise the ancestor below it on the stack.
+*/
+template<class Key, class Value, class Compare>
+typename ParentlessAVLTree<Key, Value, Compare>::iterator&
+ParentlessAVLTree<Key, Value, Compare>::iterator::operator++()
+{
+    TreeNode* current = stack_[--depth_];
+    for (TreeNode* node = current->right; node != nullptr; node = node->left) {
+        push(node);
+    }
+    return *this;
+}
+
+/**
+* Pushes a node on the stack.
+*/
+template<class Key, class Value, class Compare>
+void ParentlessAVLTree<Key, Value, Compare>::iterator::push(TreeNode* node)
+{
+    stack_[depth_++] = node;
+}
+
+/*
+  -------------------------------------------------------------
+  End implementations for the ParentlessAVLTree::iterator class.
+  -------------------------------------------------------------
+*/
+
+/*
+  ------------------------------------------------------
+  Begin implementations for the ParentlessAVLTree class.
+  ------------------------------------------------------
+*/
+
+/**
+* Default constructor for an empty tree.
+*/
+template<class Key, class Value, class Compare>
+ParentlessAVLTree<Key, Value, Compare>::ParentlessAVLTree() :
+    root_(nullptr),
+    size_(0)
+{
+
+}
+
+/**
+* Constructor for an empty tree that orders its keys with the given comparator.
+*/
+template<class Key, class Value, class Compare>
+ParentlessAVLTree<Key, Value, Compare>::ParentlessAVLTree(const Compare& comp) :
+    root_(nullptr),
+    size_(0),
+    comp_(comp)
+{
+
+}
+
+template<class Key, class Value, class Compare>
+ParentlessAVLTree<Key, Value, Compare>::~ParentlessAVLTree()
+{
+    clear();
+}
+
+/**
+* Inserts an item, overwriting the value of an existing key. Returns an
+* iterator to the item and whether a new item was added.
+*
+* Every link followed on the way down is recorded, so the balances can be
+* updated back up the same path and a rotation can relink its subtree
+* through the link that led to it.
+*/
+template<class Key, class Value, class Compare>
+std::pair<typename ParentlessAVLTree<Key, Value, Compare>::iterator, bool>
+ParentlessAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    TreeNode** links[MAX_HEIGHT];
+    bool wentLeft[MAX_HEIGHT];
+    int depth = 0;
+
+    TreeNode** link = &root_;
+    while (*link != nullptr) {
+        TreeNode* node = *link;
+        int cmp = compareKeys(comp_, keyValuePair.first, node->item.first);
+        if (cmp == 0) {
+            node->item.second = keyValuePair.second;
+            iterator it = pathIterator(links, wentLeft, depth);
+            it.push(node);
+            return std::make_pair(it, false);
+        }
+        links[depth] = link;
+        wentLeft[depth] = cmp < 0;
+        depth++;
+        link = (cmp < 0) ? &node->left : &node->right;
+    }
+
+    void* block = pool_.allocate(sizeof(TreeNode));
+    TreeNode* added;
+    try {
+        added = new (block) TreeNode(keyValuePair.first, keyValuePair.second);
+    }
+    catch (...) {
+        pool_.deallocate(block);
+        throw;
+    }
+    *link = added;
+    size_++;
+
+    // The subtree below each recorded link grew by one level, until a
+    // balance returns to 0 or a rotation restores the old height
+    for (int i = depth - 1; i >= 0; --i) {
+        TreeNode* node = *links[i];
+        node->balance += wentLeft[i] ? 1 : -1;
+        if (node->balance == 0) break;
+        if (node->balance == 2 || node->balance == -2) {
+            bool shorter;
+            *links[i] = rebalance(node, shorter);
+
+            // The path above the rotation is unchanged; only the rest of
+            // it needs to be found again
+            iterator it = pathIterator(links, wentLeft, i);
+            descend(it, *links[i], keyValuePair.first);
+            return std::make_pair(it, true);
+        }
+    }
+    iterator it = pathIterator(links, wentLeft, depth);
+    it.push(added);
+    return std::make_pair(it, true);
+}
+
+/**
+* Removes key from the tree, if it is there. A node with two children is
+* replaced by its predecessor, found by carrying on down the same path and
+* relinked into its place.
+*/
+template<class Key, class Value, class Compare>
+void ParentlessAVLTree<Key, Value, Compare>::remove(const Key& key)
+{
+    TreeNode** links[MAX_HEIGHT];
+    bool wentLeft[MAX_HEIGHT];
+    int depth = 0;
+
+    TreeNode** link = &root_;
+    while (*link != nullptr) {
+        int cmp = compareKeys(comp_, key, (*link)->item.first);
+        if (cmp == 0) break;
+        links[depth] = link;
+        wentLeft[depth] = cmp < 0;
+        depth++;
+        link = (cmp < 0) ? &(*link)->left : &(*link)->right;
+    }
+    TreeNode* target = *link;
+    if (target == nullptr) return;
+
+    if (target->left == nullptr || target->right == nullptr) {
+        *link = (target->left != nullptr) ? target->left : target->right;
+    }
+    else {
+        // Go on down to the predecessor, then unhook it
+        int targetDepth = depth;
+        links[depth] = link;
+        wentLeft[depth] = true;
+        depth++;
+        TreeNode** predLink = &target->left;
+        while ((*predLink)->right != nullptr) {
+            links[depth] = predLink;
+            wentLeft[depth] = false;
+            depth++;
+            predLink = &(*predLink)->right;
+        }
+        TreeNode* pred = *predLink;
+        *predLink = pred->left;
+
+        // Put it in the target's place, along with the recorded link that
+        // pointed into the target
+        pred->left = target->left;
+        pred->right = target->right;
+        pred->balance = target->balance;
+        *link = pred;
+        if (targetDepth + 1 < depth) {
+            links[targetDepth + 1] = &pred->left;
+        }
+    }
+    target->~TreeNode();
+    pool_.deallocate(target);
+    size_--;
+
+    // The subtree below each recorded link lost a level, until a balance
+    // becomes +-1 or a rotation keeps the height
+    for (int i = depth - 1; i >= 0; --i) {
+        TreeNode* node = *links[i];
+        node->balance -= wentLeft[i] ? 1 : -1;
+        if (node->balance == 1 || node->balance == -1) break;
+        if (node->balance == 2 || node->balance == -2) {
+            bool shorter;
+            *links[i] = rebalance(node, shorter);
+            if (!shorter) break;
+        }
+    }
+}
+
+/**
+* Removes every item from the tree and frees all of its memory.
+*/
+template<class Key, class Value, class Compare>
+void ParentlessAVLTree<Key, Value, Compare>::clear()
+{
+    destroySubtree(root_);
+    root_ = nullptr;
+    size_ = 0;
+    pool_.release();
+}
+
+/**
+* Returns true if the tree is empty
+*/
+template<class Key, class Value, class Compare>
+bool ParentlessAVLTree<Key, Value, Compare>::empty() const
+{
+    return size_ == 0;
+}
+
+/**
+* Returns the number of items in the tree
+*/
+template<class Key, class Value, class Compare>
+size_t ParentlessAVLTree<Key, Value, Compare>::size() const
+{
+    return size_;
+}
+
+/**
+* Returns the height of the tree (-1 when empty), following the taller
+* child at every level as told by the balance factors.
+*/
+template<class Key, class Value, class Compare>
+int ParentlessAVLTree<Key, Value, Compare>::height() const
+{
+    int height = -1;
+    for (TreeNode* node = root_; node != nullptr; ) {
+        height++;
+        node = (node->balance < 0) ? node->right : node->left;
+    }
+    return height;
+}
+
+/**
+* Checks every AVL invariant in one O(n) pass: keys in order, the height
+* balance of every subtree, each node's stored balance, and size(). Meant
+* for tests.
+*/
+template<class Key, class Value, class Compare>
+bool ParentlessAVLTree<Key, Value, Compare>::isValid() const
+{
+    size_t count = 0;
+    if (audit(root_, count) < -1) return false;
+    return count == size_;
+}
+
+/**
+* Returns an iterator to the "smallest" item in the tree
+*/
+template<class Key, class Value, class Compare>
+typename ParentlessAVLTree<Key, Value, Compare>::iterator
+ParentlessAVLTree<Key, Value, Compare>::begin() const
+{
+    iterator it;
+    for (TreeNode* node = root_; node != nullptr; node = node->left) {
+        it.push(node);
+    }
+    return it;
+}
+
+/**
+* Returns an iterator whose value means INVALID
+*/
+template<class Key, class Value, class Compare>
+typename ParentlessAVLTree<Key, Value, Compare>::iterator
+ParentlessAVLTree<Key, Value, Compare>::end() const
+{
+    return iterator();
+}
+
+/**
+* Returns an iterator to the item with the given key,
+* or the end iterator if key does not exist in the tree
+*/
+template<class Key, class Value, class Compare>
+typename ParentlessAVLTree<Key, Value, Compare>::iterator
+ParentlessAVLTree<Key, Value, Compare>::find(const Key& key) const
+{
+    iterator it = lower_bound(key);
+    if (it != end() && compareKeys(comp_, key, it->first) != 0) return end();
+    return it;
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than key,
+* or the end iterator if there is none. The iterator's stack holds every
+* node where the descent went left, which are exactly the ancestors still
+* to visit, with the deepest (the answer) on top.
+*/
+template<class Key, class Value, class Compare>
+typename ParentlessAVLTree<Key, Value, Compare>::iterator
+ParentlessAVLTree<Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    iterator it;
+    descend(it, root_, key);
+    return it;
+}
+
+/**
+* Returns the value stored under key. Throws std::out_of_range if key is
+* not in the tree.
+*/
+template<class Key, class Value, class Compare>
+Value& ParentlessAVLTree<Key, Value, Compare>::operator[](const Key& key)
+{
+    TreeNode* node = internalFind(key);
+    if (node == nullptr) throw std::out_of_range("Invalid key");
+    return node->item.second;
+}
+
+template<class Key, class Value, class Compare>
+Value const & ParentlessAVLTree<Key, Value, Compare>::operator[](const Key& key) const
+{
+    TreeNode* node = internalFind(key);
+    if (node == nullptr) throw std::out_of_range("Invalid key");
+    return node->item.second;
+}
+
+/**
+* Returns an iterator holding the nodes of the first depth recorded links
+* where the descent went left: the ancestors still to visit after a node
+* further down the same path.
+*/
+template<class Key, class Value, class Compare>
+typename ParentlessAVLTree<Key, Value, Compare>::iterator
+ParentlessAVLTree<Key, Value, Compare>::pathIterator(TreeNode** const* links, const bool* wentLeft, int depth) const
+{
+    iterator it;
+    for (int i = 0; i < depth; ++i) {
+        if (wentLeft[i]) it.push(*links[i]);
+    }
+    return it;
+}
+
+/**
+* Searches the subtree rooted at node for the first key not less than key,
+* pushing every node where the search goes left onto the stack of it.
+*/
+template<class Key, class Value, class Compare>
+void ParentlessAVLTree<Key, Value, Compare>::descend(iterator& it, TreeNode* node, const Key& key) const
+{
+    while (node != nullptr) {
+        int cmp = compareKeys(comp_, key, node->item.first);
+        if (cmp > 0) {
+            node = node->right;
+        }
+        else {
+            it.push(node);
+            if (cmp == 0) break;
+            node = node->left;
+        }
+    }
+}
+
+/**
+* Returns the node with the given key, or NULL.
+*/
+template<class Key, class Value, class Compare>
+typename ParentlessAVLTree<Key, Value, Compare>::TreeNode*
+ParentlessAVLTree<Key, Value, Compare>::internalFind(const Key& key) const
+{
+    TreeNode* node = root_;
+    while (node != nullptr) {
+        int cmp = compareKeys(comp_, key, node->item.first);
+        if (cmp == 0) return node;
+        node = (cmp < 0) ? node->left : node->right;
+    }
+    return nullptr;
+}
+
+/**
+* Rotates the right child of x up and returns it. Balances are left to the caller.
+*/
+template<class Key, class Value, class Compare>
+typename ParentlessAVLTree<Key, Value, Compare>::TreeNode*
+ParentlessAVLTree<Key, Value, Compare>::rotateLeft(TreeNode* x)
+{
+    TreeNode* y = x->right;
+    x->right = y->left;
+    y->left = x;
+    return y;
+}
+
+/**
+* Rotates the left child of y up and returns it. Balances are left to the caller.
+*/
+template<class Key, class Value, class Compare>
+typename ParentlessAVLTree<Key, Value, Compare>::TreeNode*
+ParentlessAVLTree<Key, Value, Compare>::rotateRight(TreeNode* y)
+{
+    TreeNode* x = y->left;
+    y->left = x->right;
+    x->right = y;
+    return x;
+}
+
+/**
+* Restores the balance of a subtree whose root has a balance of +-2, and
+* returns its new root. Sets shorter to whether the subtree ended up one
+* level shorter than before the rotation, which is the case unless the
+* taller child was itself balanced (only possible after a removal).
+*/
+template<class Key, class Value, class Compare>
+typename ParentlessAVLTree<Key, Value, Compare>::TreeNode*
+ParentlessAVLTree<Key, Value, Compare>::rebalance(TreeNode* node, bool& shorter)
+{
+    shorter = true;
+    if (node->balance == 2) {
+        TreeNode* l = node->left;
+        if (l->balance >= 0) {
+            // Left-left case
+            TreeNode* root = rotateRight(node);
+            if (l->balance == 0) {
+                node->balance = 1;
+                l->balance = -1;
+                shorter = false;
+            }
+            else {
+                node->balance = 0;
+                l->balance = 0;
+            }
+            return root;
+        }
+        // Left-right case
+        TreeNode* g = l->right;
+        node->left = rotateLeft(l);
+        TreeNode* root = rotateRight(node);
+        node->balance = (g->balance == 1) ? -1 : 0;
+        l->balance = (g->balance == -1) ? 1 : 0;
+        g->balance = 0;
+        return root;
+    }
+
+    TreeNode* r = node->right;
+    if (r->balance <= 0) {
+        // Right-right case
+        TreeNode* root = rotateLeft(node);
+        if (r->balance == 0) {
+            node->balance = -1;
+            r->balance = 1;
+            shorter = false;
+        }
+        else {
+            node->balance = 0;
+            r->balance = 0;
+        }
+        return root;
+    }
+    // Right-left case
+    TreeNode* g = r->left;
+    node->right = rotateRight(r);
+    TreeNode* root = rotateLeft(node);
+    node->balance = (g->balance == -1) ? 1 : 0;
+    r->balance = (g->balance == 1) ? -1 : 0;
+    g->balance = 0;
+    return root;
+}
+
+/**
+* Destroys every node of a subtree without returning its memory to the arena.
+*/
+template<class Key, class Value, class Compare>
+void ParentlessAVLTree<Key, Value, Compare>::destroySubtree(TreeNode* node)
+{
+    if (node == nullptr) return;
+
+    destroySubtree(node->left);
+    destroySubtree(node->right);
+    node->~TreeNode();
+}
+
+/**
+* Checks a subtree (see isValid()) and counts its nodes. Returns its height,
+* or -2 if something is wrong.
+*/
+template<class Key, class Value, class Compare>
+int ParentlessAVLTree<Key, Value, Compare>::audit(const TreeNode* node, size_t& count) const
+{
+    if (node == nullptr) return -1;
+
+    if (node->left != nullptr && compareKeys(comp_, node->left->item.first, node->item.first) >= 0) return -2;
+    if (node->right != nullptr && compareKeys(comp_, node->right->item.first, node->item.first) <= 0) return -2;
+
+    int leftHeight = audit(node->left, count);
+    int rightHeight = audit(node->right, count);
+    if (leftHeight < -1 || rightHeight < -1) return -2;
+    if (node->balance != leftHeight - rightHeight || std::abs(leftHeight - rightHeight) > 1) return -2;
+    count++;
+    return 1 + std::max(leftHeight, rightHeight);
+}
+
+/*
+  ----------------------------------------------------
+  End implementations for the ParentlessAVLTree class.
+  ----------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,742 @@
+#ifndef PERSISTENT_AVLBST_H
+#define PERSISTENT_AVLBST_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "bst.h"
+
+/**
+* A persistent AVL tree: every version of the tree stays valid and unchanged
+* when a later version is edited. Nodes are shared between versions and
+* reference counted, and insert() and remove() copy only the O(log n) nodes
+* on the path they change (path copying), so snapshot() is O(1) in time and
+* memory. Nodes only reachable from the version being edited are updated in
+* place, so a tree with no live snapshots costs no copying at all.
+*
+* Nodes keep no parent pointer, since a shared node has one parent per
+* version; iterators keep the path they came down instead, on a stack of
+* fixed depth MAX_HEIGHT, so lookups never allocate. Versions may be
+* read from other threads while one thread edits its own version, as node
+* counts are atomic and shared nodes are never modified.
+*/
+template <class Key, class Value, class Compare = ThreeWayCompare<Key> >
+class PersistentAVLTree
+{
+protected:
+    struct PathNode {
+        PathNode(const std::pair<const Key, Value>& item, PathNode* left, PathNode* right, int height);
+
+        std::pair<const Key, Value> item;
+        PathNode* left;
+        PathNode* right;
+        int height;
+        std::atomic<unsigned> refs;
+    };
+
+    // An AVL tree of height 90 has over 2^62 nodes
+    static const int MAX_HEIGHT = 90;
+
+public:
+    PersistentAVLTree();
+    explicit PersistentAVLTree(const Compare& comp);
+    PersistentAVLTree(const PersistentAVLTree& other);
+    PersistentAVLTree& operator=(const PersistentAVLTree& other);
+    ~PersistentAVLTree();
+
+    PersistentAVLTree snapshot() const;
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+    size_t size() const;
+    int height() const;
+    bool isValid() const;
+
+    /**
+    * A forward iterator over one version of the tree. It stays valid for as
+    * long as that version does, no matter what happens to other versions.
+    */
+    class iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const value_type* pointer;
+        typedef const value_type& reference;
+
+        iterator();
+        iterator(const iterator& other);
+        iterator& operator=(const iterator& other);
+
+        const std::pair<const Key, Value>& operator*() const;
+        const std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class PersistentAVLTree<Key, Value, Compare>;
+        void push(const PathNode* node);
+        // Nodes still to visit, the current one on top
+        const PathNode* stack_[MAX_HEIGHT];
+        int depth_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    Value const & operator[](const Key& key) const;
+
+protected:
+    static void retain(PathNode* node);
+    static void release(PathNode* node);
+    static int height(const PathNode* node);
+    static PathNode* mutableCopy(PathNode* node);
+    static void detach(PathNode* node, PathNode*& left, PathNode*& right);
+    static void fixHeight(PathNode* node);
+    static PathNode* rotateLeft(PathNode* node);
+    static PathNode* rotateRight(PathNode* node);
+    static PathNode* rebalance(PathNode* node);
+    static PathNode* removeMin(PathNode* node, PathNode*& min);
+    PathNode* insertAt(PathNode* node, const std::pair<const Key, Value>& keyValuePair, bool& added);
+    PathNode* removeAt(PathNode* node, const Key& key, bool& removed);
+    int audit(const PathNode* node, const Key* lo, const Key* hi) const;
+    const PathNode* internalFind(const Key& key) const;
+
+protected:
+    PathNode* root_;
+    size_t size_;
+    Compare comp_;
+};
+
+/*
+  ---------------------------------------------------------------
+  Begin implementations for the PersistentAVLTree::PathNode struct.
+  ---------------------------------------------------------------
+*/
+
+/**
+* Constructor, which takes over one reference to each child.
+*/
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>::PathNode::PathNode(const std::pair<const Key, Value>& item,
+                                                           PathNode* left, PathNode* right, int height) :
+    item(item),
+    left(left),
+    right(right),
+    height(height),
+    refs(1)
+{
+
+}
+
+/*
+  -------------------------------------------------------------
+  End implementations for the PersistentAVLTree::PathNode struct.
+  -------------------------------------------------------------
+*/
+
+/*
+  ---------------------------------------------------------------
+  Begin implementations for the PersistentAVLTree::iterator class.
+  ---------------------------------------------------------------
+*/
+
+/**
+* A default constructor that makes an end iterator.
+*/
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>::iterator::iterator() :
+    depth_(0)
+{
+
+}
+
+/**
+* Copy constructor, which copies only the part of the stack in use.
+*/
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>::iterator::iterator(const iterator& other) :
+    depth_(other.depth_)
+{
+    std::copy(other.stack_, other.stack_ + depth_, stack_);
+}
+
+/**
+* Copy assignment, which copies only the part of the stack in use.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator&
+PersistentAVLTree<Key, Value, Compare>::iterator::operator=(const iterator& other)
+{
+    depth_ = other.depth_;
+    std::copy(other.stack_, other.stack_ + depth_, stack_);
+    return *this;
+}
+
+/**
+* Provides access to the item.
+*/
+template<class Key, class Value, class Compare>
+const std::pair<const Key, Value>&
+PersistentAVLTree<Key, Value, Compare>::iterator::operator*() const
+{
+    return stack_[depth_ - 1]->item;
+}
+
+/**
+* Provides access to the address of the item.
+*/
+template<class Key, class Value, class Compare>
+const std::pair<const Key, Value>*
+PersistentAVLTree<Key, Value, Compare>::iterator::operator->() const
+{
+    return &(stack_[depth_ - 1]->item);
+}
+
+/**
+* Checks if 'this' iterator's internals have the same value as 'rhs'.
+*/
+template<class Key, class Value, class Compare>
+bool PersistentAVLTree<Key, Value, Compare>::iterator::operator==(const iterator& rhs) const
+{
+    if (depth_ == 0 || rhs.depth_ == 0) return depth_ == rhs.depth_;
+    return stack_[depth_ - 1] == rhs.stack_[rhs.depth_ - 1];
+}
+
+/**
+* Checks if 'this' iterator's internals have a different value as 'rhs'.
+*/
+template<class Key, class Value, class Compare>
+bool PersistentAVLTree<Key, Value, Compare>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Advances the iterator to the next item in key order: the leftmost node
+* of the right subtree if there is one, otherwise the nearest ancestor
+* still waiting on the path.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator&
+PersistentAVLTree<Key, Value, Compare>::iterator::operator++()
+{
+    const PathNode* current = stack_[--depth_];
+    for (const PathNode* node = current->right; node != nullptr; node = node->left) {
+        push(node);
+    }
+    return *this;
+}
+
+/**
+* Pushes a node on the stack.
+*/
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::iterator::push(const PathNode* node)
+{
+    stack_[depth_++] = node;
+}
+
+/*
+  -------------------------------------------------------------
+  End implementations for the PersistentAVLTree::iterator class.
+  -------------------------------------------------------------
+*/
+
+/*
+  ------------------------------------------------------
+  Begin implementations for the PersistentAVLTree class.
+  ------------------------------------------------------
+*/
+
+/**
+* Default constructor for an empty tree.
+*/
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree() :
+    root_(nullptr),
+    size_(0)
+{
+
+}
+
+/**
+* Constructor for an empty tree that orders its keys with the given comparator.
+*/
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree(const Compare& comp) :
+    root_(nullptr),
+    size_(0),
+    comp_(comp)
+{
+
+}
+
+/**
+* Copy constructor, which shares every node with other in O(1). The two
+* trees then evolve independently.
+*/
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree(const PersistentAVLTree& other) :
+    root_(other.root_),
+    size_(other.size_),
+    comp_(other.comp_)
+{
+    retain(root_);
+}
+
+/**
+* Assignment, which shares every node with other in O(1) and lets go of
+* the nodes of the old version.
+*/
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>&
+PersistentAVLTree<Key, Value, Compare>::operator=(const PersistentAVLTree& other)
+{
+    retain(other.root_);
+    release(root_);
+    root_ = other.root_;
+    size_ = other.size_;
+    comp_ = other.comp_;
+    return *this;
+}
+
+/**
+* Destructor, which lets go of this version. Nodes still used by other
+* versions survive.
+*/
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>::~PersistentAVLTree()
+{
+    release(root_);
+}
+
+/**
+* Returns the current version of the tree in O(1). Later edits to either
+* tree are invisible to the other.
+*/
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare> PersistentAVLTree<Key, Value, Compare>::snapshot() const
+{
+    return PersistentAVLTree(*this);
+}
+
+/**
+* Inserts an item, overwriting the value of an existing key. Copies the
+* nodes on the path to it that other versions share.
+*/
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    bool added = false;
+    root_ = insertAt(root_, keyValuePair, added);
+    if (added) size_++;
+}
+
+/**
+* Removes key from the tree, if it is there. Copies the nodes on the path
+* to it that other versions share.
+*/
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::remove(const Key& key)
+{
+    // Leave the path alone unless key is really there
+    if (internalFind(key) == nullptr) return;
+
+    bool removed = false;
+    root_ = removeAt(root_, key, removed);
+    if (removed) size_--;
+}
+
+/**
+* Empties this version of the tree.
+*/
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::clear()
+{
+    release(root_);
+    root_ = nullptr;
+    size_ = 0;
+}
+
+/**
+* Returns true if tree is empty
+*/
+template<class Key, class Value, class Compare>
+bool PersistentAVLTree<Key, Value, Compare>::empty() const
+{
+    return root_ == nullptr;
+}
+
+/**
+* Returns the number of items in the tree
+*/
+template<class Key, class Value, class Compare>
+size_t PersistentAVLTree<Key, Value, Compare>::size() const
+{
+    return size_;
+}
+
+/**
+* Returns the height of the tree: -1 for an empty tree, 0 for a single node.
+*/
+template<class Key, class Value, class Compare>
+int PersistentAVLTree<Key, Value, Compare>::height() const
+{
+    return height(root_) - 1;
+}
+
+/**
+* Returns true iff the tree is ordered, height-balanced and every stored
+* height is right. Takes O(n) time; meant for tests.
+*/
+template<class Key, class Value, class Compare>
+bool PersistentAVLTree<Key, Value, Compare>::isValid() const
+{
+    return audit(root_, nullptr, nullptr) >= 0;
+}
+
+/**
+* Returns an iterator to the smallest item in the tree
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator
+PersistentAVLTree<Key, Value, Compare>::begin() const
+{
+    iterator it;
+    for (const PathNode* node = root_; node != nullptr; node = node->left) {
+        it.push(node);
+    }
+    return it;
+}
+
+/**
+* Returns an iterator whose value means INVALID
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator
+PersistentAVLTree<Key, Value, Compare>::end() const
+{
+    return iterator();
+}
+
+/**
+* Returns an iterator to the item with the given key,
+* or the end iterator if key does not exist in the tree
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator
+PersistentAVLTree<Key, Value, Compare>::find(const Key& key) const
+{
+    iterator it = lower_bound(key);
+    if (it != end() && compareKeys(comp_, key, it->first) != 0) {
+        return end();
+    }
+    return it;
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than key,
+* or the end iterator if there is none. Only the nodes the iterator will
+* come back to (those where the descent went left) are kept on its path.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator
+PersistentAVLTree<Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    iterator it;
+    const PathNode* node = root_;
+    while (node != nullptr) {
+        if (compareKeys(comp_, node->item.first, key) < 0) {
+            node = node->right;
+        }
+        else {
+            it.push(node);
+            node = node->left;
+        }
+    }
+    return it;
+}
+
+/**
+* Returns the value stored under key. Throws std::out_of_range if key is
+* not in the tree.
+*/
+template<class Key, class Value, class Compare>
+Value const & PersistentAVLTree<Key, Value, Compare>::operator[](const Key& key) const
+{
+    const PathNode* node = internalFind(key);
+    if (node == nullptr) throw std::out_of_range("Invalid key");
+    return node->item.second;
+}
+
+/**
+* Adds a reference to a node.
+*/
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::retain(PathNode* node)
+{
+    if (node != nullptr) {
+        node->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/**
+* Drops a reference to a node, destroying it (and dropping its references
+* to its children) if it was the last one. Walks down the left spine of
+* freed nodes iteratively, so only subtrees on the right need recursion.
+*/
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::release(PathNode* node)
+{
+    while (node != nullptr && node->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        PathNode* left = node->left;
+        release(node->right);
+        delete node;
+        node = left;
+    }
+}
+
+/**
+* Returns the height of a subtree, 0 for an empty one.
+*/
+template<class Key, class Value, class Compare>
+int PersistentAVLTree<Key, Value, Compare>::height(const PathNode* node)
+{
+    return (node != nullptr) ? node->height : 0;
+}
+
+/**
+* Takes over a reference to node and returns a node with the same contents
+* that only the caller references, so it may be changed in place: node
+* itself if the caller held its only reference, otherwise a copy.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::PathNode*
+PersistentAVLTree<Key, Value, Compare>::mutableCopy(PathNode* node)
+{
+    if (node->refs.load(std::memory_order_acquire) == 1) {
+        return node;
+    }
+    retain(node->left);
+    retain(node->right);
+    PathNode* copy = new PathNode(node->item, node->left, node->right, node->height);
+    release(node);
+    return copy;
+}
+
+/**
+* Takes over a reference to node and lets go of it, handing a reference to
+* each of its children back to the caller.
+*/
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::detach(PathNode* node, PathNode*& left, PathNode*& right)
+{
+    left = node->left;
+    right = node->right;
+    if (node->refs.load(std::memory_order_acquire) == 1) {
+        delete node;
+    }
+    else {
+        retain(left);
+        retain(right);
+        release(node);
+    }
+}
+
+/**
+* Recomputes the height of a node from its children.
+*/
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::fixHeight(PathNode* node)
+{
+    node->height = std::max(height(node->left), height(node->right)) + 1;
+}
+
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::PathNode*
+PersistentAVLTree<Key, Value, Compare>::rotateLeft(PathNode* node)
+{
+    node = mutableCopy(node);
+    PathNode* right = mutableCopy(node->right);
+    node->right = right->left;
+    fixHeight(node);
+    right->left = node;
+    fixHeight(right);
+    return right;
+}
+
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::PathNode*
+PersistentAVLTree<Key, Value, Compare>::rotateRight(PathNode* node)
+{
+    node = mutableCopy(node);
+    PathNode* left = mutableCopy(node->left);
+    node->left = left->right;
+    fixHeight(node);
+    left->right = node;
+    fixHeight(left);
+    return left;
+}
+
+/**
+* Restores the AVL property at a node whose subtrees differ in height by
+* at most two, and returns the new root of the subtree.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::PathNode*
+PersistentAVLTree<Key, Value, Compare>::rebalance(PathNode* node)
+{
+    int balance = height(node->left) - height(node->right);
+    if (balance > 1) {
+        if (height(node->left->left) < height(node->left->right)) {
+            node->left = rotateLeft(node->left);
+        }
+        return rotateRight(node);
+    }
+    if (balance < -1) {
+        if (height(node->right->right) < height(node->right->left)) {
+            node->right = rotateRight(node->right);
+        }
+        return rotateLeft(node);
+    }
+    fixHeight(node);
+    return node;
+}
+
+/**
+* Takes over a reference to a subtree and returns it with the item
+* inserted (or its value overwritten), reporting whether it was added.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::PathNode*
+PersistentAVLTree<Key, Value, Compare>::insertAt(PathNode* node, const std::pair<const Key, Value>& keyValuePair, bool& added)
+{
+    if (node == nullptr) {
+        added = true;
+        return new PathNode(keyValuePair, nullptr, nullptr, 1);
+    }
+
+    int cmp = compareKeys(comp_, keyValuePair.first, node->item.first);
+    node = mutableCopy(node);
+    if (cmp == 0) {
+        node->item.second = keyValuePair.second;
+        return node;
+    }
+    if (cmp < 0) {
+        node->left = insertAt(node->left, keyValuePair, added);
+    }
+    else {
+        node->right = insertAt(node->right, keyValuePair, added);
+    }
+    return rebalance(node);
+}
+
+/**
+* Takes over a reference to a non-empty subtree and returns it without its
+* smallest node, which is handed back through min with no children.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::PathNode*
+PersistentAVLTree<Key, Value, Compare>::removeMin(PathNode* node, PathNode*& min)
+{
+    node = mutableCopy(node);
+    if (node->left == nullptr) {
+        PathNode* right = node->right;
+        node->right = nullptr;
+        min = node;
+        return right;
+    }
+    node->left = removeMin(node->left, min);
+    return rebalance(node);
+}
+
+/**
+* Takes over a reference to a subtree and returns it without key,
+* reporting whether key was there. A node with two children is replaced
+* by its successor. Every node on the path is made mutable, so callers
+* should check first that key is there.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::PathNode*
+PersistentAVLTree<Key, Value, Compare>::removeAt(PathNode* node, const Key& key, bool& removed)
+{
+    if (node == nullptr) return nullptr;
+
+    int cmp = compareKeys(comp_, key, node->item.first);
+    if (cmp == 0) {
+        removed = true;
+        PathNode *left, *right;
+        detach(node, left, right);
+        if (left == nullptr) return right;
+        if (right == nullptr) return left;
+
+        PathNode* min;
+        right = removeMin(right, min);
+        min->left = left;
+        min->right = right;
+        return rebalance(min);
+    }
+
+    node = mutableCopy(node);
+    if (cmp < 0) {
+        node->left = removeAt(node->left, key, removed);
+    }
+    else {
+        node->right = removeAt(node->right, key, removed);
+    }
+    return rebalance(node);
+}
+
+/**
+* Returns the height of a subtree, or -1 if it breaks the ordering (all
+* keys strictly between lo and hi, where given), the AVL property or its
+* stored heights.
+*/
+template<class Key, class Value, class Compare>
+int PersistentAVLTree<Key, Value, Compare>::audit(const PathNode* node, const Key* lo, const Key* hi) const
+{
+    if (node == nullptr) return 0;
+    if (lo != nullptr && compareKeys(comp_, *lo, node->item.first) >= 0) return -1;
+    if (hi != nullptr && compareKeys(comp_, node->item.first, *hi) >= 0) return -1;
+
+    int leftHeight = audit(node->left, lo, &node->item.first);
+    int rightHeight = audit(node->right, &node->item.first, hi);
+    if (leftHeight < 0 || rightHeight < 0 || abs(leftHeight - rightHeight) > 1) return -1;
+    int h = std::max(leftHeight, rightHeight) + 1;
+    return (h == node->height) ? h : -1;
+}
+
+/**
+* Returns the node with the given key, or NULL.
+*/
+template<class Key, class Value, class Compare>
+const typename PersistentAVLTree<Key, Value, Compare>::PathNode*
+PersistentAVLTree<Key, Value, Compare>::internalFind(const Key& key) const
+{
+    const PathNode* node = root_;
+    while (node != nullptr) {
+        int cmp = compareKeys(comp_, key, node->item.first);
+        if (cmp == 0) return node;
+        node = (cmp < 0) ? node->left : node->right;
+    }
+    return nullptr;
+}
+
+/*
+  ----------------------------------------------------
+  End implementations for the PersistentAVLTree class.
+  ----------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,85 @@
+// check_tree.h - helpers shared by the tree tests
+
+#ifndef CHECK_TREE_H
+#define CHECK_TREE_H
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+
+/**
+* Checks that iterating over tree visits exactly the items of expected, in
+* the same order, and that size() agrees. Works for any tree whose iterators
+* point to pairs, so every tree in this repo is checked against std::map the
+* same way.
+*/
+template<typename Tree, typename Key, typename Value>
+testing::AssertionResult matchesMap(const Tree& tree, const std::map<Key, Value>& expected)
+{
+    if (tree.size() != expected.size()) {
+        return testing::AssertionFailure() << "size() is " << tree.size() << " but should be " << expected.size();
+    }
+    typename std::map<Key, Value>::const_iterator want = expected.begin();
+    size_t index = 0;
+    for (auto it = tree.begin(); it != tree.end(); ++it, ++want, ++index) {
+        if (want == expected.end()) {
+            return testing::AssertionFailure() << "The tree has more than the " << expected.size() << " expected items";
+        }
+        if (it->first != want->first || it->second != want->second) {
+            return testing::AssertionFailure() << "Item " << index << " is (" << it->first << ", " << it->second
+                                               << ") but should be (" << want->first << ", " << want->second << ")";
+        }
+    }
+    if (want != expected.end()) {
+        return testing::AssertionFailure() << "The tree stops after " << index << " of " << expected.size() << " items";
+    }
+    return testing::AssertionSuccess();
+}
+
+/**
+* Returns count distinct keys in [0, 4 * count) in random order, the same
+* ones for the same seed.
+*/
+inline std::vector<int> randomKeys(size_t count, unsigned seed)
+{
+    std::vector<int> keys(4 * count);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        keys[i] = static_cast<int>(i);
+    }
+    std::mt19937 rng(seed);
+    std::shuffle(keys.begin(), keys.end(), rng);
+    keys.resize(count);
+    return keys;
+}
+
+/**
+* Runs a random mix of inserts and removes on tree and on a std::map of the
+* same items, and returns the map. Keys fall in [0, keyRange), so both hits
+* and misses are exercised.
+*/
+template<typename Tree>
+std::map<int, int> randomEdits(Tree& tree, size_t operations, int keyRange, unsigned seed)
+{
+    std::map<int, int> expected;
+    std::mt19937 rng(seed);
+    for (size_t i = 0; i < operations; ++i) {
+        int key = static_cast<int>(rng() % keyRange);
+        if (rng() % 3 == 0) {
+            tree.remove(key);
+            expected.erase(key);
+        }
+        else {
+            int value = static_cast<int>(rng() % 1000);
+            tree.insert(std::make_pair(key, value));
+            expected[key] = value;
+        }
+    }
+    return expected;
+}
+
+#endif
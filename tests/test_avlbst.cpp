@@ -0,0 +1,251 @@
+#include "check_tree.h"
+
+#include "avlbst.h"
+
+#include <iterator>
+#include <stdexcept>
+#include <thread>
+
+TEST(OrderStatistics, SelectAndRankMatchTheSortedOrder)
+{
+    OrderStatisticTree<int, int> tree;
+    std::map<int, int> expected = randomEdits(tree, 20000, 3000, 5);
+    ASSERT_TRUE(matchesMap(tree, expected));
+    ASSERT_TRUE(tree.isValid());
+
+    size_t k = 0;
+    for (std::map<int, int>::iterator it = expected.begin(); it != expected.end(); ++it, ++k) {
+        ASSERT_TRUE(tree.select(k) != tree.end()) << "k = " << k;
+        EXPECT_EQ(it->first, tree.select(k)->first);
+        EXPECT_EQ(k, tree.rank(it->first));
+    }
+    EXPECT_TRUE(tree.select(expected.size()) == tree.end());
+
+    // Keys that are not in the tree rank where they would go
+    for (int key = -1; key <= 3000; ++key) {
+        size_t below = std::distance(expected.begin(), expected.lower_bound(key));
+        ASSERT_EQ(below, tree.rank(key)) << "key " << key;
+    }
+}
+
+TEST(OrderStatistics, EmptyTree)
+{
+    OrderStatisticTree<int, int> tree;
+    EXPECT_TRUE(tree.select(0) == tree.end());
+    EXPECT_EQ(0u, tree.rank(42));
+}
+
+// Fills tree and a map with count random items with keys below keyRange
+template<typename Tree>
+static std::map<int, int> randomTree(Tree& tree, size_t count, int keyRange, unsigned seed)
+{
+    std::map<int, int> items;
+    std::mt19937 rng(seed);
+    while (items.size() < count) {
+        int key = static_cast<int>(rng() % keyRange);
+        int value = static_cast<int>(rng() % 1000);
+        tree.insert(std::make_pair(key, value));
+        items[key] = value;
+    }
+    return items;
+}
+
+template<typename Tree>
+static void checkSetOperations(size_t aCount, size_t bCount, unsigned seed)
+{
+    SCOPED_TRACE(testing::Message() << aCount << " and " << bCount << " items");
+    const int keyRange = 4 * static_cast<int>(aCount + bCount) + 1;
+
+    Tree a, b;
+    std::map<int, int> aItems = randomTree(a, aCount, keyRange, seed);
+    std::map<int, int> bItems = randomTree(b, bCount, keyRange, seed + 1);
+    std::map<int, int> expected = aItems;
+    for (std::map<int, int>::iterator it = bItems.begin(); it != bItems.end(); ++it) {
+        expected[it->first] = it->second;
+    }
+    a.union_with(std::move(b));
+    EXPECT_TRUE(matchesMap(a, expected));
+    EXPECT_TRUE(a.isValid());
+    EXPECT_TRUE(b.empty());
+
+    Tree c, d;
+    randomTree(c, aCount, keyRange, seed);
+    randomTree(d, bCount, keyRange, seed + 1);
+    expected.clear();
+    for (std::map<int, int>::iterator it = aItems.begin(); it != aItems.end(); ++it) {
+        if (bItems.count(it->first) != 0) expected.insert(*it);
+    }
+    c.intersect_with(std::move(d));
+    EXPECT_TRUE(matchesMap(c, expected));
+    EXPECT_TRUE(c.isValid());
+    EXPECT_TRUE(d.empty());
+
+    Tree e, f;
+    randomTree(e, aCount, keyRange, seed);
+    randomTree(f, bCount, keyRange, seed + 1);
+    expected.clear();
+    for (std::map<int, int>::iterator it = aItems.begin(); it != aItems.end(); ++it) {
+        if (bItems.count(it->first) == 0) expected.insert(*it);
+    }
+    e.difference(std::move(f));
+    EXPECT_TRUE(matchesMap(e, expected));
+    EXPECT_TRUE(e.isValid());
+    EXPECT_TRUE(f.empty());
+}
+
+TEST(SetOperations, MatchStdMap)
+{
+    const size_t sizes[][2] = {{0, 0}, {0, 50}, {50, 0}, {1, 1}, {1000, 1000}, {3000, 10}, {10, 3000}};
+    unsigned seed = 11;
+    for (const size_t* size : sizes) {
+        checkSetOperations<AVLTree<int, int> >(size[0], size[1], seed);
+        checkSetOperations<OrderStatisticTree<int, int> >(size[0], size[1], seed);
+        seed += 2;
+    }
+}
+
+TEST(SetOperations, WithItself)
+{
+    AVLTree<int, int> tree;
+    std::map<int, int> expected = randomTree(tree, 100, 1000, 12);
+    tree.union_with(std::move(tree));
+    EXPECT_TRUE(matchesMap(tree, expected));
+    tree.intersect_with(std::move(tree));
+    EXPECT_TRUE(matchesMap(tree, expected));
+    tree.difference(std::move(tree));
+    EXPECT_TRUE(tree.empty());
+    EXPECT_TRUE(tree.isValid());
+}
+
+template<typename Tree>
+static void checkSplitAndJoin(unsigned seed)
+{
+    Tree tree;
+    std::map<int, int> expected = randomTree(tree, 2000, 10000, seed);
+    for (int key : {-1, 0, 1, 2500, 5000, 7777, 9999, 10000}) {
+        SCOPED_TRACE(testing::Message() << "split at " << key);
+        std::map<int, int> low(expected.begin(), expected.lower_bound(key));
+        std::map<int, int> high(expected.lower_bound(key), expected.end());
+
+        Tree right = tree.split(key);
+        EXPECT_TRUE(matchesMap(tree, low));
+        EXPECT_TRUE(matchesMap(right, high));
+        EXPECT_TRUE(tree.isValid());
+        EXPECT_TRUE(right.isValid());
+
+        tree.join(std::move(right));
+        EXPECT_TRUE(matchesMap(tree, expected));
+        EXPECT_TRUE(tree.isValid());
+        EXPECT_TRUE(right.empty());
+    }
+}
+
+TEST(SplitJoin, SplitThenJoinRestoresTheTree)
+{
+    checkSplitAndJoin<AVLTree<int, int> >(13);
+    checkSplitAndJoin<OrderStatisticTree<int, int> >(14);
+}
+
+TEST(SplitJoin, JoinsTreesOfVeryDifferentHeights)
+{
+    AVLTree<int, int> small, large;
+    std::map<int, int> expected;
+    for (int i = 0; i < 3; ++i) {
+        small.insert(std::make_pair(i, i));
+        expected[i] = i;
+    }
+    for (int i = 10; i < 5000; ++i) {
+        large.insert(std::make_pair(i, i));
+        expected[i] = i;
+    }
+    small.join(std::move(large));
+    EXPECT_TRUE(matchesMap(small, expected));
+    EXPECT_TRUE(small.isValid());
+
+    AVLTree<int, int> tail;
+    tail.insert(std::make_pair(10000, 0));
+    expected[10000] = 0;
+    small.join(std::move(tail));
+    EXPECT_TRUE(matchesMap(small, expected));
+    EXPECT_TRUE(small.isValid());
+}
+
+TEST(SplitJoin, PlainTreesCountTheirHalvesLater)
+{
+    // A plain AVLTree cannot count the halves in O(log n), so they count
+    // themselves when size() is first asked for, edits and joins included
+    AVLTree<int, int> tree;
+    for (int i = 0; i < 1000; ++i) {
+        tree.insert(std::make_pair(i, i));
+    }
+    AVLTree<int, int> right = tree.split(300);
+    tree.insert(std::make_pair(-1, -1));
+    tree.remove(10);
+    tree.remove(20);
+    right.insert(std::make_pair(5000, 0));
+    AVLTree<int, int> tail = right.split(900);
+    EXPECT_EQ(101u, tail.size());
+    tree.join(std::move(right));
+    EXPECT_EQ(899u, tree.size());
+    tree.join(std::move(tail));
+    EXPECT_EQ(1000u, tree.size());
+    EXPECT_EQ(0u, right.size());
+
+    AVLTree<int, int> moved(std::move(tree));
+    EXPECT_EQ(1000u, moved.size());
+    AVLTree<int, int> upper = moved.split(500);
+    upper.clear();
+    EXPECT_EQ(0u, upper.size());
+    EXPECT_EQ(499u, moved.size());
+}
+
+TEST(SplitJoin, HalvesCanBeEditedOnDifferentThreads)
+{
+    AVLTree<int, int> left;
+    std::map<int, int> expected;
+    for (int i = 0; i < 1000; ++i) {
+        left.insert(std::make_pair(i, i));
+        expected[i] = i;
+    }
+    AVLTree<int, int> right = left.split(500);
+
+    // Both halves allocate slabs from the arena group they share
+    std::thread other([&right]() {
+        for (int i = 1000; i < 100000; ++i) {
+            right.insert(std::make_pair(i, i));
+            if (i % 3 == 0) right.remove(i - 500);
+        }
+    });
+    for (int i = -1; i > -100000; --i) {
+        left.insert(std::make_pair(i, i));
+        if (i % 3 == 0) left.remove(i + 500);
+    }
+    other.join();
+
+    for (int i = 1000; i < 100000; ++i) {
+        expected[i] = i;
+        if (i % 3 == 0) expected.erase(i - 500);
+    }
+    for (int i = -1; i > -100000; --i) {
+        expected[i] = i;
+        if (i % 3 == 0) expected.erase(i + 500);
+    }
+    left.join(std::move(right));
+    EXPECT_TRUE(matchesMap(left, expected));
+    EXPECT_TRUE(left.isValid());
+}
+
+TEST(SplitJoin, OverlappingTreesAreNotJoined)
+{
+    AVLTree<int, int> left, right;
+    for (int i = 0; i < 100; ++i) {
+        left.insert(std::make_pair(i, i));
+        right.insert(std::make_pair(i + 99, i));
+    }
+    EXPECT_THROW(left.join(std::move(right)), std::invalid_argument);
+    EXPECT_EQ(100u, left.size());
+    EXPECT_EQ(100u, right.size());
+    EXPECT_THROW(left.join(std::move(left)), std::invalid_argument);
+    EXPECT_TRUE(left.isValid());
+    EXPECT_TRUE(right.isValid());
+}
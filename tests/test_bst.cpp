@@ -0,0 +1,548 @@
+#include "check_tree.h"
+
+#include "bst.h"
+#include "avlbst.h"
+
+#include <cctype>
+#include <functional>
+#include <iterator>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+// Items (i, 10 * i) for every i in [0, count), in key order
+static std::vector<std::pair<int, int> > sortedItems(int count)
+{
+    std::vector<std::pair<int, int> > items;
+    for (int i = 0; i < count; ++i) {
+        items.push_back(std::make_pair(i, 10 * i));
+    }
+    return items;
+}
+
+static std::map<int, int> asMap(const std::vector<std::pair<int, int> >& items)
+{
+    return std::map<int, int>(items.begin(), items.end());
+}
+
+TEST(BulkBuild, AssignBuildsAPerfectlyBalancedTree)
+{
+    for (int count : {0, 1, 2, 3, 7, 8, 1000, 1023, 1024}) {
+        std::vector<std::pair<int, int> > items = sortedItems(count);
+        BinarySearchTree<int, int> bst;
+        bst.insert(std::make_pair(-5, -5));
+        bst.assign(items.begin(), items.end());
+        EXPECT_TRUE(matchesMap(bst, asMap(items))) << count << " items";
+        EXPECT_TRUE(bst.isBalanced());
+
+        AVLTree<int, int> avl;
+        avl.assign(items.begin(), items.end());
+        EXPECT_TRUE(matchesMap(avl, asMap(items))) << count << " items";
+        EXPECT_TRUE(avl.isValid());
+        int height = -1;
+        for (int n = count; n > 0; n /= 2) {
+            height++;
+        }
+        EXPECT_EQ(height, avl.height()) << count << " items";
+    }
+}
+
+TEST(BulkBuild, RangeConstructorsKeepTheTreesUsable)
+{
+    std::vector<std::pair<int, int> > items = sortedItems(500);
+    std::map<int, int> expected = asMap(items);
+
+    AVLTree<int, int> avl(items.begin(), items.end());
+    for (int i = 0; i < 500; i += 3) {
+        avl.remove(i);
+        expected.erase(i);
+    }
+    for (int i = 500; i < 700; ++i) {
+        avl.insert(std::make_pair(i, i));
+        expected[i] = i;
+    }
+    EXPECT_TRUE(matchesMap(avl, expected));
+    EXPECT_TRUE(avl.isValid());
+
+    // The subtree sizes are filled in by the build as well
+    OrderStatisticTree<int, int> ranked(items.begin(), items.end());
+    EXPECT_TRUE(ranked.isValid());
+    EXPECT_EQ(250, ranked.select(250)->first);
+    EXPECT_EQ(250u, ranked.rank(250));
+}
+
+TEST(BulkBuild, UnsortedRangeIsRejected)
+{
+    std::vector<std::pair<int, int> > items = sortedItems(100);
+    std::swap(items[40], items[41]);
+    AVLTree<int, int> tree;
+    tree.insert(std::make_pair(1, 1));
+    EXPECT_THROW(tree.assign(items.begin(), items.end()), std::invalid_argument);
+    EXPECT_EQ(1u, tree.size());
+    EXPECT_EQ(1, tree[1]);
+
+    // Duplicate keys are not strictly increasing either
+    items = sortedItems(100);
+    items[41].first = 40;
+    EXPECT_THROW(tree.assign(items.begin(), items.end()), std::invalid_argument);
+    EXPECT_TRUE(tree.isValid());
+}
+
+TEST(Teardown, ClearsADegenerateTreeWithoutRecursing)
+{
+    // Appending through end() builds a plain BST that is one long spine,
+    // deeper than a recursive teardown could follow on a default stack
+    const int count = 1000000;
+    BinarySearchTree<int, std::string> tree;
+    for (int i = 0; i < count; ++i) {
+        tree.insert(tree.end(), std::make_pair(i, std::string(i % 7, 'x')));
+    }
+    EXPECT_EQ(count, tree.height() + 1);
+    tree.clear();
+    EXPECT_TRUE(tree.empty());
+    EXPECT_TRUE(tree.begin() == tree.end());
+
+    tree.insert(std::make_pair(1, std::string("one")));
+    EXPECT_EQ("one", tree[1]);
+
+    // The destructor takes the same path
+    BinarySearchTree<int, int>* spine = new BinarySearchTree<int, int>;
+    for (int i = count; i > 0; --i) {
+        spine->insert(spine->begin(), std::make_pair(i, i));
+    }
+    EXPECT_EQ(static_cast<size_t>(count), spine->size());
+    delete spine;
+}
+
+// The key an iterator points to, or -1000 for the end iterator
+template<typename Iterator>
+static int keyAt(Iterator it, Iterator end)
+{
+    return (it == end) ? -1000 : it->first;
+}
+
+TEST(Bounds, MatchStdMapOnEveryKey)
+{
+    AVLTree<int, int> avl;
+    std::map<int, int> expected = randomEdits(avl, 3000, 1000, 6);
+    BinarySearchTree<int, int> bst;
+    for (std::map<int, int>::iterator it = expected.begin(); it != expected.end(); ++it) {
+        bst.insert(*it);
+    }
+
+    for (int key = -2; key <= 1002; ++key) {
+        int lower = keyAt(expected.lower_bound(key), expected.end());
+        int upper = keyAt(expected.upper_bound(key), expected.end());
+        EXPECT_EQ(lower, keyAt(avl.lower_bound(key), avl.end())) << "key " << key;
+        EXPECT_EQ(upper, keyAt(avl.upper_bound(key), avl.end())) << "key " << key;
+        EXPECT_EQ(lower, keyAt(bst.lower_bound(key), bst.end())) << "key " << key;
+        EXPECT_EQ(upper, keyAt(bst.upper_bound(key), bst.end())) << "key " << key;
+
+        std::pair<AVLTree<int, int>::iterator, AVLTree<int, int>::iterator> equal = avl.equal_range(key);
+        EXPECT_TRUE(equal.first == avl.lower_bound(key)) << "key " << key;
+        EXPECT_TRUE(equal.second == avl.upper_bound(key)) << "key " << key;
+    }
+}
+
+TEST(Bounds, RangeVisitsAHalfOpenInterval)
+{
+    AVLTree<int, int> tree;
+    for (int i = 0; i < 100; i += 2) {
+        tree.insert(std::make_pair(i, i));
+    }
+
+    std::vector<int> keys;
+    for (std::pair<const int, int>& item : tree.range(11, 20)) {
+        keys.push_back(item.first);
+    }
+    EXPECT_EQ((std::vector<int>{12, 14, 16, 18}), keys);
+
+    EXPECT_TRUE(tree.range(13, 14).empty());
+    EXPECT_TRUE(tree.range(50, 50).empty());
+    EXPECT_FALSE(tree.range(-10, 1).empty());
+    EXPECT_TRUE(tree.range(99, 1000).empty());
+}
+
+// An AVLTree that hands out its root, to look at its shape and to tamper with it
+class OpenAVLTree : public AVLTree<int, int>
+{
+public:
+    AVLNode<int, int>* root() const { return static_cast<AVLNode<int, int>*>(root_); }
+};
+
+// Inserts the subtree under node into bst in preorder, so bst takes its shape
+static void copyShape(AVLNode<int, int>* node, BinarySearchTree<int, int>& bst)
+{
+    if (node == nullptr) return;
+    bst.insert(node->getItem());
+    copyShape(node->getLeft(), bst);
+    copyShape(node->getRight(), bst);
+}
+
+TEST(Audit, HeightAndBalanceOfKnownShapes)
+{
+    BinarySearchTree<int, int> bst;
+    EXPECT_EQ(-1, bst.height());
+    EXPECT_TRUE(bst.isBalanced());
+    for (int key : {4, 2, 6, 1, 3, 5, 7}) {
+        bst.insert(std::make_pair(key, key));
+    }
+    EXPECT_EQ(2, bst.height());
+    EXPECT_TRUE(bst.isBalanced());
+    bst.insert(std::make_pair(8, 8));
+    bst.insert(std::make_pair(9, 9));
+    EXPECT_EQ(4, bst.height());
+    EXPECT_FALSE(bst.isBalanced());
+    EXPECT_TRUE(bst.isValid());
+
+    // Deep trees are audited without recursing
+    BinarySearchTree<int, int> spine;
+    for (int i = 0; i < 200000; ++i) {
+        spine.insert(spine.end(), std::make_pair(i, i));
+    }
+    EXPECT_EQ(199999, spine.height());
+    EXPECT_FALSE(spine.isBalanced());
+    EXPECT_TRUE(spine.isValid());
+}
+
+TEST(Audit, AVLHeightAgreesWithAFullWalk)
+{
+    OpenAVLTree avl;
+    std::map<int, int> expected = randomEdits(avl, 20000, 5000, 7);
+    BinarySearchTree<int, int> copy;
+    copyShape(avl.root(), copy);
+    ASSERT_TRUE(matchesMap(copy, expected));
+    EXPECT_TRUE(avl.isBalanced());
+    EXPECT_TRUE(avl.isValid());
+    // The balance factors lead straight down the tallest path, which a plain
+    // BST of the same shape measures by walking every node
+    EXPECT_EQ(copy.height(), avl.height());
+}
+
+TEST(Audit, IsValidCatchesAWrongBalanceFactor)
+{
+    OpenAVLTree tree;
+    for (int i = 0; i < 100; ++i) {
+        tree.insert(std::make_pair(i, i));
+    }
+    ASSERT_TRUE(tree.isValid());
+    int8_t balance = tree.root()->getBalance();
+    tree.root()->setBalance(balance == 0 ? 1 : 0);
+    EXPECT_FALSE(tree.isValid());
+    tree.root()->setBalance(balance);
+    EXPECT_TRUE(tree.isValid());
+}
+
+// A three-way comparator that ignores case
+struct CaseInsensitive {
+    int operator()(const std::string& a, const std::string& b) const
+    {
+        for (size_t i = 0; i < a.size() && i < b.size(); ++i) {
+            int ca = std::tolower(static_cast<unsigned char>(a[i]));
+            int cb = std::tolower(static_cast<unsigned char>(b[i]));
+            if (ca != cb) return ca - cb;
+        }
+        return (a.size() < b.size()) ? -1 : (a.size() > b.size()) ? 1 : 0;
+    }
+};
+
+TEST(Comparators, BoolComparatorsOrderTheKeys)
+{
+    AVLTree<int, int, std::greater<int> > tree;
+    std::map<int, int, std::greater<int> > expected;
+    std::mt19937 rng(8);
+    for (int i = 0; i < 5000; ++i) {
+        int key = static_cast<int>(rng() % 1000);
+        if (i % 3 == 0) {
+            tree.remove(key);
+            expected.erase(key);
+        }
+        else {
+            tree.insert(std::make_pair(key, i));
+            expected[key] = i;
+        }
+    }
+    ASSERT_EQ(expected.size(), tree.size());
+    std::map<int, int, std::greater<int> >::iterator want = expected.begin();
+    for (AVLTree<int, int, std::greater<int> >::iterator it = tree.begin(); it != tree.end(); ++it, ++want) {
+        EXPECT_EQ(want->first, it->first);
+    }
+    EXPECT_TRUE(tree.isValid());
+    EXPECT_EQ(expected.lower_bound(500)->first, tree.lower_bound(500)->first);
+}
+
+TEST(Comparators, ThreeWayComparatorsOrderTheKeys)
+{
+    BinarySearchTree<std::string, int, CaseInsensitive> tree;
+    tree.insert(std::make_pair(std::string("banana"), 1));
+    tree.insert(std::make_pair(std::string("Apple"), 2));
+    tree.insert(std::make_pair(std::string("cherry"), 3));
+    tree.insert(std::make_pair(std::string("APPLE"), 4));
+    EXPECT_EQ(3u, tree.size());
+    EXPECT_EQ(4, tree["apple"]);
+    EXPECT_EQ("Apple", tree.begin()->first);
+    EXPECT_TRUE(tree.isValid());
+}
+
+TEST(Comparators, HeterogeneousLookupTakesCStrings)
+{
+    AVLTree<std::string, int> tree;
+    for (const char* key : {"a", "b", "c", "d"}) {
+        tree.insert(std::make_pair(std::string(key), key[0] - 'a'));
+    }
+    const char* b = "b";
+    ASSERT_TRUE(tree.find(b) != tree.end());
+    EXPECT_EQ(1, tree.find(b)->second);
+    EXPECT_TRUE(tree.find("bb") == tree.end());
+    EXPECT_EQ("c", tree.lower_bound("bb")->first);
+    EXPECT_EQ("c", tree.upper_bound("b")->first);
+    std::pair<AVLTree<std::string, int>::iterator, AVLTree<std::string, int>::iterator> range = tree.equal_range("d");
+    EXPECT_EQ("d", range.first->first);
+    EXPECT_TRUE(range.second == tree.end());
+}
+
+// A value that counts how often it is constructed, and how often copied
+struct Counted {
+    Counted() : value(0) { constructions++; }
+    explicit Counted(int value) : value(value) { constructions++; }
+    Counted(const Counted& other) : value(other.value) { constructions++; copies++; }
+    Counted(Counted&& other) : value(other.value) { constructions++; }
+    Counted& operator=(const Counted& other) { value = other.value; copies++; return *this; }
+    Counted& operator=(Counted&& other) { value = other.value; return *this; }
+    int value;
+    static int constructions;
+    static int copies;
+};
+int Counted::constructions = 0;
+int Counted::copies = 0;
+
+// Every tree can print itself, so its values must be printable
+std::ostream& operator<<(std::ostream& out, const Counted& counted)
+{
+    return out << counted.value;
+}
+
+TEST(Emplace, EmplaceAndTryEmplaceLeaveExistingItems)
+{
+    AVLTree<int, std::string> tree;
+    EXPECT_TRUE(tree.emplace(1, "one").second);
+    EXPECT_FALSE(tree.emplace(1, "uno").second);
+    EXPECT_EQ("one", tree[1]);
+
+    std::pair<AVLTree<int, std::string>::iterator, bool> result = tree.try_emplace(2, 3, 'x');
+    EXPECT_TRUE(result.second);
+    EXPECT_EQ("xxx", result.first->second);
+    result = tree.try_emplace(2, "two");
+    EXPECT_FALSE(result.second);
+    EXPECT_EQ("xxx", result.first->second);
+    EXPECT_TRUE(tree.isValid());
+
+    // try_emplace() builds nothing for a key that is already there
+    AVLTree<int, Counted> counted;
+    counted.try_emplace(1, 10);
+    Counted::constructions = 0;
+    EXPECT_FALSE(counted.try_emplace(1, 20).second);
+    EXPECT_EQ(0, Counted::constructions);
+    EXPECT_EQ(10, counted[1].value);
+}
+
+TEST(Emplace, RvaluesAreMovedNotCopied)
+{
+    AVLTree<int, Counted> tree;
+    Counted::copies = 0;
+    for (int i = 0; i < 100; ++i) {
+        tree.insert(std::make_pair(i, Counted(i)));
+    }
+    tree.emplace(100, Counted(100));
+    tree.try_emplace(101, 101);
+    tree.insert_or_assign(5, Counted(-5));
+    tree.insert(tree.end(), std::make_pair(102, Counted(102)));
+    EXPECT_EQ(0, Counted::copies);
+    ASSERT_EQ(103u, tree.size());
+    EXPECT_EQ(-5, tree[5].value);
+    EXPECT_EQ(101, tree[101].value);
+    EXPECT_TRUE(tree.isValid());
+}
+
+TEST(Emplace, InsertOrAssignAndUpsert)
+{
+    BinarySearchTree<std::string, int> tree;
+    EXPECT_TRUE(tree.insert_or_assign("a", 1).second);
+    EXPECT_FALSE(tree.insert_or_assign("a", 2).second);
+    EXPECT_EQ(2, tree["a"]);
+
+    // Counting words with one descent per word
+    AVLTree<std::string, int> counts;
+    std::map<std::string, int> expected;
+    const char* words[] = {"the", "cat", "and", "the", "hat", "and", "the", "bat"};
+    for (const char* word : words) {
+        std::pair<AVLTree<std::string, int>::iterator, bool> result =
+            counts.upsert(word, [](int& count) { count++; });
+        EXPECT_EQ(expected.count(word) == 0, result.second);
+        expected[word]++;
+        EXPECT_EQ(expected[word], result.first->second);
+    }
+    EXPECT_TRUE(matchesMap(counts, expected));
+    EXPECT_TRUE(counts.isValid());
+}
+
+TEST(HintedInsert, AnyHintGivesTheSameTree)
+{
+    std::vector<int> keys = randomKeys(3000, 9);
+    AVLTree<int, int> tree;
+    std::map<int, int> expected;
+    AVLTree<int, int>::iterator last = tree.end();
+    std::mt19937 rng(10);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        // Mix good hints, stale ones and the ends of the tree
+        AVLTree<int, int>::iterator hint;
+        switch (rng() % 4) {
+        case 0: hint = last; break;
+        case 1: hint = tree.begin(); break;
+        case 2: hint = tree.end(); break;
+        default: hint = tree.lower_bound(keys[i]); break;
+        }
+        last = tree.insert(hint, std::make_pair(keys[i], static_cast<int>(i)));
+        ASSERT_EQ(keys[i], last->first);
+        expected[keys[i]] = static_cast<int>(i);
+    }
+    EXPECT_TRUE(matchesMap(tree, expected));
+    EXPECT_TRUE(tree.isValid());
+
+    // An existing key gets its value overwritten, whatever the hint
+    AVLTree<int, int>::iterator it = tree.insert(tree.begin(), std::make_pair(keys[100], -1));
+    EXPECT_EQ(keys[100], it->first);
+    EXPECT_EQ(-1, tree[keys[100]]);
+    EXPECT_EQ(expected.size(), tree.size());
+}
+
+TEST(HintedInsert, SortedStreams)
+{
+    AVLTree<int, int> ascending;
+    for (int i = 0; i < 10000; ++i) {
+        ascending.insert(ascending.end(), std::make_pair(i, i));
+    }
+    AVLTree<int, int> descending;
+    for (int i = 9999; i >= 0; --i) {
+        descending.insert(descending.begin(), std::make_pair(i, i));
+    }
+    BinarySearchTree<int, int> nearlySorted;
+    BinarySearchTree<int, int>::iterator hint = nearlySorted.end();
+    for (int i = 0; i < 10000; ++i) {
+        int key = (i % 10 == 9) ? i - 5 : i;
+        hint = nearlySorted.insert(hint, std::make_pair(key, key));
+    }
+
+    std::map<int, int> expected;
+    for (int i = 0; i < 10000; ++i) {
+        expected[i] = i;
+    }
+    EXPECT_TRUE(matchesMap(ascending, expected));
+    EXPECT_TRUE(matchesMap(descending, expected));
+    EXPECT_TRUE(ascending.isValid());
+    EXPECT_TRUE(descending.isValid());
+    EXPECT_EQ(9000u, nearlySorted.size());
+    EXPECT_TRUE(nearlySorted.isValid());
+}
+
+TEST(FindBatch, MatchesFindForEveryKey)
+{
+    AVLTree<int, int> avl;
+    randomEdits(avl, 5000, 2000, 21);
+    BinarySearchTree<int, int> bst;
+    randomEdits(bst, 2000, 2000, 22);
+
+    // More keys than the searches kept in flight at once, with repeats,
+    // misses and keys outside the tree on both sides
+    std::vector<int> keys;
+    std::mt19937 rng(23);
+    for (int i = 0; i < 1000; ++i) {
+        keys.push_back(static_cast<int>(rng() % 2200) - 100);
+    }
+    for (size_t count : {size_t(0), size_t(1), size_t(15), size_t(16), size_t(17), keys.size()}) {
+        SCOPED_TRACE(testing::Message() << count << " keys");
+        std::vector<AVLTree<int, int>::iterator> found;
+        avl.find_batch(keys.begin(), keys.begin() + count, std::back_inserter(found));
+        ASSERT_EQ(count, found.size());
+        for (size_t i = 0; i < count; ++i) {
+            EXPECT_TRUE(found[i] == avl.find(keys[i])) << "key " << keys[i];
+        }
+
+        std::vector<BinarySearchTree<int, int>::iterator> bstFound(count);
+        EXPECT_TRUE(bst.find_batch(keys.begin(), keys.begin() + count, bstFound.begin()) == bstFound.end());
+        for (size_t i = 0; i < count; ++i) {
+            EXPECT_TRUE(bstFound[i] == bst.find(keys[i])) << "key " << keys[i];
+        }
+    }
+
+    AVLTree<int, int> empty;
+    std::vector<AVLTree<int, int>::iterator> none(3);
+    empty.find_batch(keys.begin(), keys.begin() + 3, none.begin());
+    EXPECT_TRUE(none[0] == empty.end() && none[2] == empty.end());
+}
+
+TEST(Iterators, ReverseAndBidirectional)
+{
+    AVLTree<int, int> tree;
+    std::map<int, int> expected = randomEdits(tree, 5000, 2000, 28);
+
+    std::map<int, int>::reverse_iterator want = expected.rbegin();
+    for (AVLTree<int, int>::reverse_iterator it = tree.rbegin(); it != tree.rend(); ++it, ++want) {
+        ASSERT_TRUE(want != expected.rend());
+        ASSERT_EQ(want->first, it->first);
+    }
+    EXPECT_TRUE(want == expected.rend());
+
+    // Stepping back from end() lands on the largest item, even after the
+    // largest and smallest items change
+    tree.insert(std::make_pair(5000, 1));
+    tree.insert(std::make_pair(-5000, 1));
+    AVLTree<int, int>::iterator it = tree.end();
+    --it;
+    EXPECT_EQ(5000, it->first);
+    EXPECT_EQ(-5000, tree.begin()->first);
+    tree.remove(5000);
+    tree.remove(-5000);
+    it = tree.end();
+    it--;
+    EXPECT_EQ(expected.rbegin()->first, it->first);
+    EXPECT_EQ(expected.begin()->first, tree.begin()->first);
+
+    // Going forwards and back again visits the same items
+    it = tree.find(expected.begin()->first);
+    for (int step = 0; step < 100; ++step) {
+        ++it;
+    }
+    AVLTree<int, int>::iterator back = it;
+    for (int step = 0; step < 100; ++step) {
+        back--;
+    }
+    EXPECT_TRUE(back == tree.begin());
+    EXPECT_TRUE(std::prev(std::next(it)) == it);
+    EXPECT_TRUE(tree.isValid());
+}
+
+TEST(Iterators, ForEachVisitsEveryItemInOrder)
+{
+    BinarySearchTree<int, int> bst;
+    std::map<int, int> expected = randomEdits(bst, 5000, 2000, 29);
+    std::vector<std::pair<int, int> > visited;
+    bst.for_each([&visited](const std::pair<const int, int>& item) { visited.push_back(item); });
+    std::vector<std::pair<int, int> > items(expected.begin(), expected.end());
+    EXPECT_EQ(items, visited);
+
+    // Values may be changed through the visit
+    AVLTree<int, int> avl;
+    expected = randomEdits(avl, 1000, 500, 30);
+    avl.for_each([](std::pair<const int, int>& item) { item.second = item.first * 2; });
+    for (std::map<int, int>::iterator it = expected.begin(); it != expected.end(); ++it) {
+        it->second = it->first * 2;
+    }
+    EXPECT_TRUE(matchesMap(avl, expected));
+
+    AVLTree<int, int> empty;
+    int calls = 0;
+    empty.for_each([&calls](const std::pair<const int, int>&) { calls++; });
+    EXPECT_EQ(0, calls);
+    EXPECT_TRUE(empty.rbegin() == empty.rend());
+}
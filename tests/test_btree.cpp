@@ -0,0 +1,106 @@
+#include "check_tree.h"
+
+#include "btree.h"
+
+#include <stdexcept>
+#include <string>
+
+TEST(BTreeMap, MatchesStdMapAfterRandomEdits)
+{
+    BTreeMap<int, int> tree;
+    std::map<int, int> expected = randomEdits(tree, 100000, 20000, 19);
+    EXPECT_TRUE(matchesMap(tree, expected));
+    EXPECT_TRUE(tree.isValid());
+
+    // Wide keys make for narrow nodes, and so for a deeper tree
+    BTreeMap<std::string, int> strings;
+    std::map<std::string, int> expectedStrings;
+    std::mt19937 rng(20);
+    for (int i = 0; i < 20000; ++i) {
+        std::string key = std::to_string(rng() % 5000);
+        if (i % 3 == 0) {
+            strings.remove(key);
+            expectedStrings.erase(key);
+        }
+        else {
+            strings.insert(std::make_pair(key, i));
+            expectedStrings[key] = i;
+        }
+    }
+    EXPECT_TRUE(matchesMap(strings, expectedStrings));
+    EXPECT_TRUE(strings.isValid());
+}
+
+TEST(BTreeMap, SortedInsertsAndRemovesKeepItShallow)
+{
+    BTreeMap<int, int> tree;
+    for (int i = 0; i < 100000; ++i) {
+        tree.insert(std::make_pair(i, i));
+    }
+    EXPECT_TRUE(tree.isValid());
+    EXPECT_LE(tree.height(), 4);
+
+    // Removing from either end makes nodes borrow from and merge with
+    // their siblings on both sides
+    std::map<int, int> expected;
+    for (int i = 20000; i < 80000; ++i) {
+        expected[i] = i;
+    }
+    for (int i = 0; i < 20000; ++i) {
+        tree.remove(i);
+        tree.remove(99999 - i);
+        if (i % 1000 == 0) {
+            ASSERT_TRUE(tree.isValid()) << "after " << i << " removes from each end";
+        }
+    }
+    EXPECT_TRUE(matchesMap(tree, expected));
+
+    for (int i = 20000; i < 80000; ++i) {
+        tree.remove(i);
+    }
+    EXPECT_TRUE(tree.empty());
+    EXPECT_EQ(-1, tree.height());
+    EXPECT_TRUE(tree.begin() == tree.end());
+    EXPECT_TRUE(tree.isValid());
+}
+
+TEST(BTreeMap, LookupsAndWritesThroughIterators)
+{
+    BTreeMap<int, int> tree;
+    std::map<int, int> expected;
+    for (int i = 0; i < 3000; i += 3) {
+        tree.insert(std::make_pair(i, i));
+        expected[i] = i;
+    }
+    for (int key = -1; key <= 3001; ++key) {
+        std::map<int, int>::iterator lower = expected.lower_bound(key);
+        std::map<int, int>::iterator upper = expected.upper_bound(key);
+        BTreeMap<int, int>::iterator treeLower = tree.lower_bound(key);
+        BTreeMap<int, int>::iterator treeUpper = tree.upper_bound(key);
+        ASSERT_EQ(lower == expected.end(), treeLower == tree.end()) << "key " << key;
+        ASSERT_EQ(upper == expected.end(), treeUpper == tree.end()) << "key " << key;
+        if (lower != expected.end()) {
+            EXPECT_EQ(lower->first, treeLower->first);
+        }
+        if (upper != expected.end()) {
+            EXPECT_EQ(upper->first, treeUpper->first);
+        }
+        EXPECT_EQ(expected.count(key) != 0, tree.find(key) != tree.end());
+    }
+
+    for (BTreeMap<int, int>::iterator it = tree.begin(); it != tree.end(); ++it) {
+        it->second = -it->first;
+    }
+    tree[3] = 7;
+    EXPECT_EQ(7, tree[3]);
+    EXPECT_EQ(-6, tree[6]);
+    EXPECT_THROW(tree[4], std::out_of_range);
+
+    std::pair<BTreeMap<int, int>::iterator, bool> result = tree.insert(std::make_pair(6, 0));
+    EXPECT_FALSE(result.second);
+    EXPECT_EQ(0, result.first->second);
+    tree.clear();
+    EXPECT_TRUE(tree.empty());
+    tree.insert(std::make_pair(1, 1));
+    EXPECT_EQ(1u, tree.size());
+}
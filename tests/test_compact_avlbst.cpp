@@ -0,0 +1,72 @@
+#include "check_tree.h"
+
+#include "compact_avlbst.h"
+
+#include <set>
+#include <stdexcept>
+#include <string>
+
+TEST(CompactAVLTree, MatchesStdMapAfterRandomEdits)
+{
+    CompactAVLTree<int, int> tree;
+    std::map<int, int> expected = randomEdits(tree, 50000, 10000, 24);
+    EXPECT_TRUE(matchesMap(tree, expected));
+    EXPECT_TRUE(tree.isValid());
+
+    for (int key = -1; key <= 10000; key += 7) {
+        std::map<int, int>::iterator want = expected.lower_bound(key);
+        CompactAVLTree<int, int>::iterator got = tree.lower_bound(key);
+        ASSERT_EQ(want == expected.end(), got == tree.end()) << "key " << key;
+        if (want != expected.end()) {
+            EXPECT_EQ(want->first, got->first);
+        }
+    }
+
+    tree.clear();
+    EXPECT_TRUE(tree.empty());
+    EXPECT_EQ(-1, tree.height());
+    expected = randomEdits(tree, 5000, 1000, 25);
+    EXPECT_TRUE(matchesMap(tree, expected));
+    EXPECT_TRUE(tree.isValid());
+}
+
+TEST(CompactAVLTree, ItemsStayPutAndSlotsAreReused)
+{
+    CompactAVLTree<int, std::string> tree;
+    std::vector<const std::pair<const int, std::string>*> items;
+    for (int i = 0; i < 20000; ++i) {
+        items.push_back(&*tree.insert(std::make_pair(i, std::to_string(i))).first);
+    }
+    // Growing the tree adds chunks but never moves the ones already there
+    for (int i = 0; i < 20000; ++i) {
+        ASSERT_EQ(items[i], &*tree.find(i));
+    }
+    EXPECT_LE(tree.height(), 20);
+
+    std::set<const void*> freed;
+    for (int i = 0; i < 20000; i += 2) {
+        freed.insert(items[i]);
+        tree.remove(i);
+    }
+    for (int i = 0; i < 10000; ++i) {
+        const void* item = &*tree.insert(std::make_pair(-i - 1, std::string("x"))).first;
+        ASSERT_EQ(1u, freed.count(item)) << "insert " << i << " did not reuse a removed slot";
+    }
+    EXPECT_EQ(20000u, tree.size());
+    EXPECT_TRUE(tree.isValid());
+}
+
+TEST(CompactAVLTree, ValueAccess)
+{
+    CompactAVLTree<int, int> tree;
+    EXPECT_TRUE(tree.insert(std::make_pair(1, 1)).second);
+    EXPECT_FALSE(tree.insert(std::make_pair(1, 2)).second);
+    EXPECT_EQ(2, tree[1]);
+    tree[1] = 3;
+    const CompactAVLTree<int, int>& constTree = tree;
+    EXPECT_EQ(3, constTree[1]);
+    EXPECT_THROW(tree[2], std::out_of_range);
+    EXPECT_THROW(constTree[2], std::out_of_range);
+    tree.remove(2);
+    EXPECT_EQ(1u, tree.size());
+}
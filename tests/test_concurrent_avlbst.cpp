@@ -0,0 +1,139 @@
+#include "check_tree.h"
+
+#include "concurrent_avlbst.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+
+TEST(ConcurrentAVLTree, ViewReleasedOnAnotherThread)
+{
+    ConcurrentAVLTree<int, int> tree;
+    tree.insert(std::make_pair(1, 1));
+
+    // Hand views to other threads to destroy, so that they are released on
+    // a different counter slot than the one they were announced on
+    for (int i = 0; i < 64; ++i) {
+        ConcurrentAVLTree<int, int>::ReadView view = tree.read();
+        EXPECT_EQ(1u, view->size());
+        std::thread releaser([](ConcurrentAVLTree<int, int>::ReadView v) { }, std::move(view));
+        releaser.join();
+    }
+    // A writer would wait forever for a view whose count was never withdrawn
+    tree.insert(std::make_pair(2, 2));
+    EXPECT_TRUE(tree.contains(2));
+    EXPECT_EQ(2u, tree.size());
+}
+
+TEST(ConcurrentAVLTree, ThrowingEditKeepsCopiesInStep)
+{
+    ConcurrentAVLTree<int, int> tree;
+    for (int i = 0; i < 10; ++i) {
+        tree.insert(std::make_pair(i, i));
+    }
+
+    // Throws half way through the first call
+    EXPECT_THROW(tree.modify([](ConcurrentAVLTree<int, int>::Tree& t) {
+        t.insert(std::make_pair(100, 100));
+        throw std::runtime_error("first");
+    }), std::runtime_error);
+    EXPECT_FALSE(tree.contains(100));
+
+    // Throws only on the second call, after the edit is published
+    int calls = 0;
+    EXPECT_THROW(tree.modify([&calls](ConcurrentAVLTree<int, int>::Tree& t) {
+        t.insert(std::make_pair(200, 200));
+        if (++calls == 2) throw std::runtime_error("second");
+    }), std::runtime_error);
+    EXPECT_TRUE(tree.contains(200));
+
+    // Both copies must now hold the same items: every write swaps which one
+    // readers see, so check both sides of a few swaps
+    std::map<int, int> expected;
+    for (int i = 0; i < 10; ++i) {
+        expected[i] = i;
+    }
+    expected[200] = 200;
+    for (int i = 0; i < 2; ++i) {
+        {
+            ConcurrentAVLTree<int, int>::ReadView view = tree.read();
+            EXPECT_TRUE(matchesMap(*view, expected));
+            EXPECT_TRUE(view->isValid());
+        }
+        tree.remove(-1);
+    }
+}
+
+TEST(ConcurrentAVLTree, ReadersSeeWholeEdits)
+{
+    typedef ConcurrentAVLTree<int, int>::Tree Tree;
+    ConcurrentAVLTree<int, int> tree;
+    tree.modify([](Tree& t) {
+        t.insert(std::make_pair(0, 0));
+        t.insert(std::make_pair(1, 0));
+    });
+
+    // Every edit moves an amount from key 0 to key 1 and adds a key of its
+    // own, so the two values always sum to zero and keys only ever grow
+    const int edits = 500;
+    std::atomic<bool> done(false);
+    std::atomic<int> failures(0);
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 4; ++r) {
+        readers.push_back(std::thread([&tree, &done, &failures]() {
+            size_t lastSize = 0;
+            int reads = 0;
+            while (!done.load() || reads < 100) {
+                ConcurrentAVLTree<int, int>::ReadView view = tree.read();
+                int a = (*view)[0];
+                int b = (*view)[1];
+                if (a + b != 0 || view->size() < lastSize) failures++;
+                lastSize = view->size();
+                if (++reads % 64 == 0 && !view->isValid()) failures++;
+                std::this_thread::yield();
+            }
+        }));
+    }
+    for (int i = 1; i <= edits; ++i) {
+        tree.modify([i](Tree& t) {
+            t[0] -= i;
+            t.insert(std::make_pair(i + 1, i));
+            t[1] += i;
+        });
+        if (i % 10 == 0) tree.insert(std::make_pair(-i, i));
+    }
+    done = true;
+    for (size_t r = 0; r < readers.size(); ++r) {
+        readers[r].join();
+    }
+    EXPECT_EQ(0, failures.load());
+
+    std::map<int, int> expected;
+    expected[0] = -edits * (edits + 1) / 2;
+    expected[1] = edits * (edits + 1) / 2;
+    for (int i = 1; i <= edits; ++i) {
+        expected[i + 1] = i;
+        if (i % 10 == 0) expected[-i] = i;
+    }
+    ConcurrentAVLTree<int, int>::ReadView view = tree.read();
+    EXPECT_TRUE(matchesMap(*view, expected));
+}
+
+TEST(ConcurrentAVLTree, PointReadsAndClear)
+{
+    ConcurrentAVLTree<int, int> tree;
+    for (int i = 0; i < 100; ++i) {
+        tree.insert(std::make_pair(i, i * i));
+    }
+    int value = 0;
+    EXPECT_TRUE(tree.find(9, value));
+    EXPECT_EQ(81, value);
+    EXPECT_FALSE(tree.find(100, value));
+    tree.remove(9);
+    EXPECT_FALSE(tree.contains(9));
+    EXPECT_EQ(99u, tree.size());
+    tree.clear();
+    EXPECT_EQ(0u, tree.size());
+    tree.insert(std::make_pair(5, 5));
+    EXPECT_TRUE(tree.contains(5));
+}
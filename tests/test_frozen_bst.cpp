@@ -0,0 +1,90 @@
+#include "check_tree.h"
+
+#include "avlbst.h"
+#include "frozen_bst.h"
+
+#include <stdexcept>
+#include <string>
+
+// A comparator whose order depends on its state
+struct FlippableLess {
+    FlippableLess() : descending(false) {}
+    explicit FlippableLess(bool descending) : descending(descending) {}
+    bool operator()(int a, int b) const { return descending ? b < a : a < b; }
+    bool descending;
+};
+
+TEST(FrozenTree, KeepsTheComparatorOfTheTree)
+{
+    AVLTree<int, int, FlippableLess> tree(FlippableLess(true));
+    for (int i = 0; i < 100; ++i) {
+        tree.insert(std::make_pair(i, -i));
+    }
+    EXPECT_TRUE(tree.key_comp().descending);
+
+    FrozenTree<int, int, FlippableLess> frozen = freeze(tree);
+    ASSERT_EQ(100u, frozen.size());
+    int expected = 99;
+    for (FrozenTree<int, int, FlippableLess>::iterator it = frozen.begin(); it != frozen.end(); ++it) {
+        EXPECT_EQ(expected--, it->first);
+    }
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_TRUE(frozen.find(i) != frozen.end()) << "key " << i;
+        EXPECT_EQ(-i, frozen[i]);
+    }
+    EXPECT_EQ(50, frozen.lower_bound(50)->first);
+    EXPECT_EQ(49, frozen.upper_bound(50)->first);
+}
+
+// The key an iterator points to, or -1000 for the end iterator
+template<typename Iterator>
+static int keyAt(Iterator it, Iterator end)
+{
+    return (it == end) ? -1000 : it->first;
+}
+
+TEST(FrozenTree, MatchesStdMapForEveryShape)
+{
+    // Every size up to a few full levels, so that the last level of the
+    // implicit layout is filled to every extent
+    for (int count = 0; count <= 70; ++count) {
+        SCOPED_TRACE(testing::Message() << count << " items");
+        AVLTree<int, int> tree;
+        std::map<int, int> expected;
+        std::vector<int> keys = randomKeys(count, count);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            tree.insert(std::make_pair(2 * keys[i], keys[i]));
+            expected[2 * keys[i]] = keys[i];
+        }
+        FrozenTree<int, int> frozen = freeze(tree);
+        ASSERT_TRUE(matchesMap(frozen, expected));
+        EXPECT_EQ(count == 0, frozen.empty());
+
+        for (int key = -1; key <= 8 * count + 1; ++key) {
+            EXPECT_EQ(keyAt(expected.lower_bound(key), expected.end()), keyAt(frozen.lower_bound(key), frozen.end()));
+            EXPECT_EQ(keyAt(expected.upper_bound(key), expected.end()), keyAt(frozen.upper_bound(key), frozen.end()));
+            EXPECT_EQ(keyAt(expected.find(key), expected.end()), keyAt(frozen.find(key), frozen.end()));
+        }
+    }
+}
+
+TEST(FrozenTree, IsACopy)
+{
+    BinarySearchTree<std::string, int> tree;
+    tree.insert(std::make_pair(std::string("b"), 2));
+    tree.insert(std::make_pair(std::string("a"), 1));
+    FrozenTree<std::string, int> frozen = freeze(tree);
+    tree.remove("a");
+    tree.insert(std::make_pair(std::string("c"), 3));
+    tree["b"] = 20;
+
+    EXPECT_EQ(2u, frozen.size());
+    EXPECT_EQ(1, frozen["a"]);
+    EXPECT_EQ(2, frozen["b"]);
+    EXPECT_THROW(frozen["c"], std::out_of_range);
+
+    FrozenTree<std::string, int> empty;
+    EXPECT_TRUE(empty.empty());
+    EXPECT_TRUE(empty.begin() == empty.end());
+    EXPECT_TRUE(empty.find("a") == empty.end());
+}
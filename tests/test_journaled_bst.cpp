@@ -0,0 +1,212 @@
+#include "check_tree.h"
+
+#include "journaled_bst.h"
+
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A scratch directory for the snapshot and journal files, removed again at
+// the end of each test
+class JournaledTreeFiles : public testing::Test
+{
+protected:
+    JournaledTreeFiles()
+    {
+        std::string pattern = testing::TempDir() + "journaled-test-XXXXXX";
+        std::vector<char> name(pattern.begin(), pattern.end());
+        name.push_back('\0');
+        directory_ = mkdtemp(name.data());
+        path_ = directory_ + "/tree";
+    }
+
+    ~JournaledTreeFiles()
+    {
+        DIR* dir = opendir(directory_.c_str());
+        if (dir != nullptr) {
+            for (struct dirent* entry = readdir(dir); entry != nullptr; entry = readdir(dir)) {
+                std::string name = entry->d_name;
+                if (name != "." && name != "..") {
+                    unlink((directory_ + "/" + name).c_str());
+                }
+            }
+            closedir(dir);
+        }
+        rmdir(directory_.c_str());
+    }
+
+    // Returns the path of the newest journal
+    std::string newestJournal() const
+    {
+        std::string newest;
+        unsigned long newestGeneration = 0;
+        DIR* dir = opendir(directory_.c_str());
+        for (struct dirent* entry = readdir(dir); entry != nullptr; entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.compare(0, 9, "tree.log.") != 0) continue;
+            unsigned long generation = std::stoul(name.substr(9));
+            if (newest.empty() || generation > newestGeneration) {
+                newest = directory_ + "/" + name;
+                newestGeneration = generation;
+            }
+        }
+        closedir(dir);
+        return newest;
+    }
+
+    std::string directory_;
+    std::string path_;
+};
+
+TEST_F(JournaledTreeFiles, CompactionKeepsEditsMadeWhileCopying)
+{
+    std::map<int, int> expected;
+    {
+        // A small journal limit, so that compactions keep starting while
+        // the writers run, each copying a tree of several chunks
+        JournaledTree<int, int> tree(path_, 1 << 12);
+        std::vector<std::pair<int, int> > items;
+        for (int i = 0; i < 20000; ++i) {
+            items.push_back(std::make_pair(i, i));
+            expected[i] = i;
+        }
+        tree.insert(items.begin(), items.end());
+
+        const int threads = 4;
+        std::vector<std::map<int, int> > changes(threads);
+        std::vector<std::thread> writers;
+        for (int t = 0; t < threads; ++t) {
+            writers.push_back(std::thread([&tree, &changes, t]() {
+                for (int i = 0; i < 1000; ++i) {
+                    // Every thread edits keys of its own, all over the tree
+                    int key = (i * 37 % 5000) * threads + t;
+                    if (i % 4 == 3) {
+                        tree.remove(key);
+                        changes[t][key] = -1;
+                    }
+                    else {
+                        tree.insert(std::make_pair(key, -i - 2));
+                        changes[t][key] = -i - 2;
+                    }
+                }
+            }));
+        }
+        for (int t = 0; t < threads; ++t) {
+            writers[t].join();
+            for (std::map<int, int>::iterator it = changes[t].begin(); it != changes[t].end(); ++it) {
+                if (it->second == -1) expected.erase(it->first);
+                else expected[it->first] = it->second;
+            }
+        }
+        tree.compact();
+        tree.read([&expected](const AVLTree<int, int>& t) {
+            EXPECT_TRUE(matchesMap(t, expected));
+        });
+    }
+
+    JournaledTree<int, int> reopened(path_);
+    reopened.read([&expected](const AVLTree<int, int>& t) {
+        EXPECT_TRUE(matchesMap(t, expected));
+        EXPECT_TRUE(t.isValid());
+    });
+}
+
+TEST_F(JournaledTreeFiles, ReopeningReplaysTheJournal)
+{
+    std::map<int, int> expected;
+    {
+        JournaledTree<int, int> tree(path_);
+        expected = randomEdits(tree, 2000, 500, 34);
+        EXPECT_EQ(expected.size(), tree.size());
+    }
+    {
+        JournaledTree<int, int> tree(path_);
+        tree.read([&expected](const AVLTree<int, int>& t) {
+            EXPECT_TRUE(matchesMap(t, expected));
+        });
+
+        // A batch from a range, then a snapshot with more edits after it
+        std::vector<std::pair<int, int> > items;
+        for (int i = 1000; i < 1100; ++i) {
+            items.push_back(std::make_pair(i, -i));
+            expected[i] = -i;
+        }
+        tree.insert(items.begin(), items.end());
+        tree.compact();
+        tree.remove(1000);
+        expected.erase(1000);
+        int value = 0;
+        EXPECT_TRUE(tree.find(1050, value));
+        EXPECT_EQ(-1050, value);
+        EXPECT_FALSE(tree.contains(1000));
+    }
+    JournaledTree<int, int> tree(path_);
+    tree.read([&expected](const AVLTree<int, int>& t) {
+        EXPECT_TRUE(matchesMap(t, expected));
+        EXPECT_TRUE(t.isValid());
+    });
+}
+
+TEST_F(JournaledTreeFiles, TornTailIsDropped)
+{
+    std::map<int, int> expected;
+    {
+        JournaledTree<int, int> tree(path_);
+        for (int i = 0; i < 100; ++i) {
+            tree.insert(std::make_pair(i, i));
+            expected[i] = i;
+        }
+        // Each call is a batch of its own, so cutting the last one short
+        // loses this edit and nothing before it
+        tree.remove(50);
+    }
+    std::string journal = newestJournal();
+    ASSERT_FALSE(journal.empty());
+    struct stat info;
+    ASSERT_EQ(0, stat(journal.c_str(), &info));
+    ASSERT_EQ(0, truncate(journal.c_str(), info.st_size - 1));
+
+    {
+        JournaledTree<int, int> tree(path_);
+        EXPECT_TRUE(tree.contains(50));
+        tree.read([&expected](const AVLTree<int, int>& t) {
+            EXPECT_TRUE(matchesMap(t, expected));
+        });
+        // New edits go after the torn batch, and survive the next open
+        tree.insert(std::make_pair(200, 200));
+        expected[200] = 200;
+    }
+    JournaledTree<int, int> tree(path_);
+    tree.read([&expected](const AVLTree<int, int>& t) {
+        EXPECT_TRUE(matchesMap(t, expected));
+    });
+}
+
+TEST_F(JournaledTreeFiles, PlainBinarySearchTree)
+{
+    typedef JournaledTree<int, int, ThreeWayCompare<int>, BinarySearchTree<int, int> > PlainTree;
+    std::map<int, int> expected;
+    {
+        PlainTree tree(path_, 1 << 12);
+        expected = randomEdits(tree, 3000, 1000, 35);
+    }
+    PlainTree tree(path_);
+    tree.read([&expected](const BinarySearchTree<int, int>& t) {
+        EXPECT_TRUE(matchesMap(t, expected));
+        EXPECT_TRUE(t.isValid());
+    });
+}
+
+TEST_F(JournaledTreeFiles, OtherTypesAreRejected)
+{
+    {
+        JournaledTree<int, int> tree(path_);
+        tree.insert(std::make_pair(1, 1));
+    }
+    typedef JournaledTree<int, double> WideTree;
+    EXPECT_THROW(WideTree tree(path_), std::runtime_error);
+}
@@ -0,0 +1,159 @@
+#include "check_tree.h"
+
+#include "mapped_avlbst.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+typedef MappedAVLTree<int, int> IntTree;
+
+// A scratch tree file, removed again at the end of each test
+class MappedAVLTreeFile : public testing::Test
+{
+protected:
+    MappedAVLTreeFile() : path_(testing::TempDir() + "mapped-avl-test.avl") { std::remove(path_.c_str()); }
+    ~MappedAVLTreeFile() { std::remove(path_.c_str()); }
+
+    // Overwrites a 64-bit field of the file header at the given offset
+    void patch(std::streamoff offset, uint64_t value)
+    {
+        std::fstream file(path_.c_str(), std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(offset);
+        file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    // Offsets of the fields after the magic and four 32-bit fields
+    static const std::streamoff ROOT = 24;
+    static const std::streamoff FREE = 40;
+
+    std::string path_;
+};
+
+TEST_F(MappedAVLTreeFile, ReadOnlyTreeCanBeIndexed)
+{
+    {
+        MappedAVLTree<int, int> tree(path_);
+        for (int i = 0; i < 100; ++i) {
+            tree.insert(std::make_pair(i, 2 * i));
+        }
+    }
+    MappedAVLTree<int, int> tree(path_, true);
+    EXPECT_TRUE(tree.isReadOnly());
+    EXPECT_EQ(84, tree[42]);
+    const MappedAVLTree<int, int>& constTree = tree;
+    EXPECT_EQ(84, constTree[42]);
+    EXPECT_THROW(tree[1000], std::out_of_range);
+    EXPECT_THROW(tree.insert(std::make_pair(1000, 0)), std::logic_error);
+}
+
+TEST_F(MappedAVLTreeFile, OutOfRangeRootOrFreelistIsRejected)
+{
+    {
+        MappedAVLTree<int, int> tree(path_);
+        for (int i = 0; i < 100; ++i) {
+            tree.insert(std::make_pair(i, i));
+        }
+        tree.remove(50);
+    }
+    patch(ROOT, uint64_t(1) << 40);
+    EXPECT_THROW(IntTree tree(path_), std::runtime_error);
+    patch(ROOT, 0);
+    patch(FREE, uint64_t(1) << 40);
+    EXPECT_THROW(IntTree tree(path_, true), std::runtime_error);
+}
+
+TEST_F(MappedAVLTreeFile, ReopensWhereItLeftOff)
+{
+    std::map<int, int> expected;
+    {
+        MappedAVLTree<int, int> tree(path_);
+        EXPECT_TRUE(tree.empty());
+        // Enough items to grow the file several times
+        expected = randomEdits(tree, 50000, 20000, 32);
+        EXPECT_TRUE(matchesMap(tree, expected));
+        EXPECT_TRUE(tree.isValid());
+        tree.sync();
+    }
+    {
+        MappedAVLTree<int, int> tree(path_);
+        EXPECT_TRUE(matchesMap(tree, expected));
+        EXPECT_TRUE(tree.isValid());
+
+        // Freed slots are reused across opens
+        std::mt19937 rng(33);
+        for (int i = 0; i < 10000; ++i) {
+            int key = static_cast<int>(rng() % 20000);
+            tree.remove(key);
+            expected.erase(key);
+            tree.insert(std::make_pair(key + 20000, i));
+            expected[key + 20000] = i;
+        }
+        EXPECT_TRUE(matchesMap(tree, expected));
+        EXPECT_TRUE(tree.isValid());
+    }
+    MappedAVLTree<int, int> readOnly(path_, true);
+    EXPECT_TRUE(matchesMap(readOnly, expected));
+    EXPECT_TRUE(readOnly.isValid());
+    EXPECT_THROW(readOnly.remove(expected.begin()->first), std::logic_error);
+    EXPECT_THROW(readOnly.clear(), std::logic_error);
+}
+
+TEST_F(MappedAVLTreeFile, ClearKeepsTheFileUsable)
+{
+    {
+        MappedAVLTree<int, int> tree(path_);
+        for (int i = 0; i < 1000; ++i) {
+            tree.insert(std::make_pair(i, i));
+        }
+        tree.clear();
+        EXPECT_TRUE(tree.empty());
+        EXPECT_TRUE(tree.begin() == tree.end());
+        tree.insert(std::make_pair(7, 7));
+    }
+    MappedAVLTree<int, int> tree(path_);
+    EXPECT_EQ(1u, tree.size());
+    EXPECT_EQ(7, tree[7]);
+    EXPECT_EQ(7, tree.lower_bound(3)->first);
+    EXPECT_TRUE(tree.lower_bound(8) == tree.end());
+    EXPECT_TRUE(tree.isValid());
+}
+
+TEST_F(MappedAVLTreeFile, OtherFilesAreRejected)
+{
+    {
+        MappedAVLTree<int, int> tree(path_);
+        tree.insert(std::make_pair(1, 1));
+    }
+    typedef MappedAVLTree<int, double> WideTree;
+    EXPECT_THROW(WideTree tree(path_), std::runtime_error);
+
+    std::ofstream(path_.c_str(), std::ios::binary | std::ios::trunc) << "this is not a tree, just some text in a file";
+    EXPECT_THROW(IntTree tree(path_), std::runtime_error);
+    std::remove(path_.c_str());
+    EXPECT_THROW(IntTree tree(path_, true), std::runtime_error);
+}
+
+TEST_F(MappedAVLTreeFile, CustomComparator)
+{
+    typedef MappedAVLTree<int, int, std::greater<int> > DescendingTree;
+    std::map<int, int, std::greater<int> > expected;
+    {
+        DescendingTree tree(path_, false, std::greater<int>());
+        for (int i = 0; i < 500; ++i) {
+            tree.insert(std::make_pair(i * 7 % 500, i));
+            expected[i * 7 % 500] = i;
+        }
+    }
+    DescendingTree tree(path_);
+    ASSERT_EQ(expected.size(), tree.size());
+    std::map<int, int, std::greater<int> >::iterator want = expected.begin();
+    for (DescendingTree::iterator it = tree.begin(); it != tree.end(); ++it, ++want) {
+        EXPECT_EQ(want->first, it->first);
+        EXPECT_EQ(want->second, it->second);
+    }
+    EXPECT_TRUE(tree.isValid());
+}
@@ -0,0 +1,105 @@
+#include "check_tree.h"
+
+#include "node_arena.h"
+#include "bst.h"
+#include "avlbst.h"
+
+#include <cstdint>
+#include <set>
+
+TEST(NodeArena, BlocksAreDistinctAndAligned)
+{
+    NodeArena arena;
+    std::set<void*> blocks;
+    for (int i = 0; i < 1000; ++i) {
+        void* block = arena.allocate(40);
+        EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(block) % alignof(std::max_align_t));
+        EXPECT_TRUE(blocks.insert(block).second);
+    }
+}
+
+TEST(NodeArena, FreedBlocksAreReused)
+{
+    NodeArena arena;
+    std::vector<void*> blocks;
+    for (int i = 0; i < 100; ++i) {
+        blocks.push_back(arena.allocate(24));
+    }
+    std::set<void*> freed;
+    for (int i = 0; i < 100; i += 2) {
+        arena.deallocate(blocks[i]);
+        freed.insert(blocks[i]);
+    }
+    for (int i = 0; i < 50; ++i) {
+        EXPECT_EQ(1u, freed.count(arena.allocate(24)));
+    }
+}
+
+TEST(NodeArena, SharedArenasFreeIntoEachOther)
+{
+    NodeArena a, b;
+    void* block = a.allocate(32);
+    b.share(a);
+    a.release();
+    // block now belongs to the group b still holds, so b may free and reuse it
+    b.deallocate(block);
+    EXPECT_EQ(block, b.allocate(32));
+}
+
+TEST(NodeArena, AdoptTakesFreeBlocks)
+{
+    NodeArena a, b;
+    a.allocate(32);
+    void* block = b.allocate(32);
+    b.deallocate(block);
+    a.adopt(b);
+    EXPECT_EQ(block, a.allocate(32));
+}
+
+TEST(NodeArena, TreesReuseRemovedNodes)
+{
+    AVLTree<int, int> tree;
+    for (int i = 0; i < 200; ++i) {
+        tree.insert(std::make_pair(i, i));
+    }
+    std::set<const void*> freed;
+    for (int i = 0; i < 200; i += 2) {
+        freed.insert(&*tree.find(i));
+        tree.remove(i);
+    }
+    for (int i = 1000; i < 1100; ++i) {
+        EXPECT_EQ(1u, freed.count(&*tree.insert(std::make_pair(i, i)).first));
+    }
+    EXPECT_TRUE(tree.isValid());
+}
+
+TEST(NodeArena, TreesMatchMapAfterRandomEdits)
+{
+    BinarySearchTree<int, int> bst;
+    std::map<int, int> expected = randomEdits(bst, 5000, 500, 1);
+    EXPECT_TRUE(matchesMap(bst, expected));
+    EXPECT_TRUE(bst.isValid());
+
+    AVLTree<int, int> avl;
+    expected = randomEdits(avl, 20000, 2000, 2);
+    EXPECT_TRUE(matchesMap(avl, expected));
+    EXPECT_TRUE(avl.isValid());
+
+    avl.clear();
+    EXPECT_TRUE(avl.empty());
+    expected = randomEdits(avl, 2000, 200, 3);
+    EXPECT_TRUE(matchesMap(avl, expected));
+}
+
+TEST(NodeArena, MovedTreesKeepTheirNodes)
+{
+    AVLTree<int, int> tree;
+    std::map<int, int> expected = randomEdits(tree, 3000, 1000, 4);
+    AVLTree<int, int> moved(std::move(tree));
+    EXPECT_TRUE(tree.empty());
+    EXPECT_TRUE(matchesMap(moved, expected));
+
+    tree = std::move(moved);
+    EXPECT_TRUE(matchesMap(tree, expected));
+    EXPECT_TRUE(tree.isValid());
+}
@@ -0,0 +1,93 @@
+#include "check_tree.h"
+
+#include "avlbst.h"
+
+#include <set>
+
+TEST(ParallelEdits, EraseReusesFreedNodes)
+{
+    AVLTree<int, int> tree;
+    for (int i = 0; i < 40000; ++i) {
+        tree.insert(std::make_pair(i, i));
+    }
+    std::vector<int> erased;
+    std::set<const void*> freed;
+    for (int i = 0; i < 40000; i += 2) {
+        erased.push_back(i);
+        freed.insert(&*tree.find(i));
+    }
+    tree.erase_parallel(erased.begin(), erased.end(), 4);
+    EXPECT_EQ(20000u, tree.size());
+
+    for (int i = 0; i < 20000; ++i) {
+        const void* item = &*tree.insert(std::make_pair(100000 + i, i)).first;
+        ASSERT_EQ(1u, freed.count(item)) << "insert " << i << " did not reuse a node freed by erase_parallel()";
+    }
+    EXPECT_TRUE(tree.isValid());
+}
+
+TEST(ParallelEdits, InsertMatchesStdMap)
+{
+    for (unsigned threads : {1u, 2u, 4u, 7u}) {
+        SCOPED_TRACE(testing::Message() << threads << " threads");
+        AVLTree<int, int> tree;
+        std::map<int, int> expected = randomEdits(tree, 5000, 200000, 15);
+
+        // Unsorted, with repeated keys: the last item with a key wins
+        std::vector<std::pair<int, int> > items;
+        std::mt19937 rng(16);
+        for (int i = 0; i < 60000; ++i) {
+            items.push_back(std::make_pair(static_cast<int>(rng() % 200000), i));
+            expected[items.back().first] = i;
+        }
+        tree.insert_parallel(items.begin(), items.end(), threads);
+        EXPECT_TRUE(matchesMap(tree, expected));
+        EXPECT_TRUE(tree.isValid());
+    }
+}
+
+TEST(ParallelEdits, EraseMatchesStdMap)
+{
+    for (unsigned threads : {1u, 3u, 8u}) {
+        SCOPED_TRACE(testing::Message() << threads << " threads");
+        OrderStatisticTree<int, int> tree;
+        std::map<int, int> expected;
+        std::vector<std::pair<int, int> > items;
+        for (int i = 0; i < 50000; ++i) {
+            items.push_back(std::make_pair(3 * i, i));
+            expected[3 * i] = i;
+        }
+        tree.insert_parallel(items.begin(), items.end(), threads);
+
+        // Keys that are missing, repeated and out of order
+        std::vector<int> keys;
+        std::mt19937 rng(17);
+        for (int i = 0; i < 40000; ++i) {
+            keys.push_back(static_cast<int>(rng() % 160000));
+            expected.erase(keys.back());
+        }
+        tree.erase_parallel(keys.begin(), keys.end(), threads);
+        EXPECT_TRUE(matchesMap(tree, expected));
+        EXPECT_TRUE(tree.isValid());
+    }
+}
+
+TEST(ParallelEdits, SmallBatchesAndEmptyTrees)
+{
+    AVLTree<int, int> tree;
+    std::vector<std::pair<int, int> > items = {{3, 3}, {1, 1}, {2, 2}, {1, 10}};
+    tree.insert_parallel(items.begin(), items.end(), 4);
+    std::map<int, int> expected = {{1, 10}, {2, 2}, {3, 3}};
+    EXPECT_TRUE(matchesMap(tree, expected));
+
+    std::vector<int> keys = {2, 5};
+    tree.erase_parallel(keys.begin(), keys.end(), 4);
+    expected.erase(2);
+    EXPECT_TRUE(matchesMap(tree, expected));
+
+    std::vector<int> none;
+    tree.erase_parallel(none.begin(), none.end(), 4);
+    tree.insert_parallel(items.end(), items.end(), 4);
+    EXPECT_TRUE(matchesMap(tree, expected));
+    EXPECT_TRUE(tree.isValid());
+}
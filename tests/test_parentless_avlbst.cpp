@@ -0,0 +1,65 @@
+#include "check_tree.h"
+
+#include "parentless_avlbst.h"
+
+#include <stdexcept>
+#include <string>
+
+TEST(ParentlessAVLTree, MatchesStdMapAfterRandomEdits)
+{
+    ParentlessAVLTree<int, int> tree;
+    std::map<int, int> expected = randomEdits(tree, 50000, 10000, 26);
+    EXPECT_TRUE(matchesMap(tree, expected));
+    EXPECT_TRUE(tree.isValid());
+
+    tree.clear();
+    EXPECT_TRUE(tree.empty());
+    EXPECT_EQ(-1, tree.height());
+    expected = randomEdits(tree, 5000, 1000, 27);
+    EXPECT_TRUE(matchesMap(tree, expected));
+    EXPECT_TRUE(tree.isValid());
+}
+
+TEST(ParentlessAVLTree, SortedInsertsStayBalanced)
+{
+    ParentlessAVLTree<int, std::string> tree;
+    for (int i = 0; i < 65535; ++i) {
+        tree.insert(std::make_pair(i, std::to_string(i)));
+    }
+    EXPECT_TRUE(tree.isValid());
+    EXPECT_EQ(15, tree.height());
+    for (int i = 65534; i >= 0; i -= 2) {
+        tree.remove(i);
+    }
+    EXPECT_EQ(32767u, tree.size());
+    EXPECT_TRUE(tree.isValid());
+    EXPECT_EQ("99", tree[99]);
+}
+
+TEST(ParentlessAVLTree, IteratorsCarryTheirPath)
+{
+    ParentlessAVLTree<int, int> tree;
+    for (int i = 0; i < 1000; i += 2) {
+        tree.insert(std::make_pair(i, -i));
+    }
+
+    // An iterator from a search walks on from there without parent links
+    ParentlessAVLTree<int, int>::iterator it = tree.lower_bound(501);
+    ParentlessAVLTree<int, int>::iterator copy = it;
+    int expected = 502;
+    for (; it != tree.end(); ++it, expected += 2) {
+        ASSERT_EQ(expected, it->first);
+    }
+    EXPECT_EQ(1000, expected);
+    EXPECT_EQ(502, copy->first);
+    ++copy;
+    EXPECT_EQ(504, copy->first);
+
+    ParentlessAVLTree<int, int>::iterator found = tree.find(998);
+    EXPECT_EQ(-998, found->second);
+    ++found;
+    EXPECT_TRUE(found == tree.end());
+    EXPECT_TRUE(tree.find(501) == tree.end());
+    EXPECT_TRUE(tree.lower_bound(999) == tree.end());
+    EXPECT_THROW(tree[501], std::out_of_range);
+}
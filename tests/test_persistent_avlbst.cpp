@@ -0,0 +1,152 @@
+#include "check_tree.h"
+
+#include "persistent_avlbst.h"
+
+#include <stdexcept>
+#include <thread>
+
+// A value that counts how many of it are alive
+struct Live {
+    Live() : value(0) { count++; }
+    explicit Live(int value) : value(value) { count++; }
+    Live(const Live& other) : value(other.value) { count++; }
+    ~Live() { count--; }
+    Live& operator=(const Live& other) { value = other.value; return *this; }
+    bool operator!=(const Live& other) const { return value != other.value; }
+    int value;
+    static int count;
+};
+int Live::count = 0;
+
+TEST(PersistentAVLTree, SnapshotsKeepTheirVersion)
+{
+    PersistentAVLTree<int, int> tree;
+    std::vector<PersistentAVLTree<int, int> > versions;
+    std::vector<std::map<int, int> > expected;
+    std::map<int, int> current;
+    std::mt19937 rng(18);
+    for (int i = 0; i < 5000; ++i) {
+        int key = static_cast<int>(rng() % 1000);
+        if (rng() % 3 == 0) {
+            tree.remove(key);
+            current.erase(key);
+        }
+        else {
+            tree.insert(std::make_pair(key, i));
+            current[key] = i;
+        }
+        if (i % 250 == 0) {
+            versions.push_back(tree.snapshot());
+            expected.push_back(current);
+        }
+    }
+    EXPECT_TRUE(matchesMap(tree, current));
+    EXPECT_TRUE(tree.isValid());
+    for (size_t v = 0; v < versions.size(); ++v) {
+        EXPECT_TRUE(matchesMap(versions[v], expected[v])) << "version " << v;
+        EXPECT_TRUE(versions[v].isValid());
+    }
+
+    // Editing a snapshot leaves the tree it came from alone
+    versions[3].clear();
+    versions[4].insert(std::make_pair(-1, -1));
+    EXPECT_TRUE(versions[3].empty());
+    EXPECT_EQ(-1, versions[4][-1]);
+    EXPECT_TRUE(matchesMap(tree, current));
+    EXPECT_TRUE(matchesMap(versions[5], expected[5]));
+}
+
+TEST(PersistentAVLTree, LookupsAndCopies)
+{
+    PersistentAVLTree<int, int> tree;
+    for (int i = 0; i < 100; i += 2) {
+        tree.insert(std::make_pair(i, -i));
+    }
+    EXPECT_EQ(-10, tree[10]);
+    EXPECT_THROW(tree[11], std::out_of_range);
+    EXPECT_TRUE(tree.find(11) == tree.end());
+    EXPECT_EQ(12, tree.lower_bound(11)->first);
+    EXPECT_TRUE(tree.lower_bound(99) == tree.end());
+
+    PersistentAVLTree<int, int> copy(tree);
+    copy.remove(10);
+    PersistentAVLTree<int, int> assigned;
+    assigned = copy;
+    assigned.insert(std::make_pair(10, 1));
+    EXPECT_EQ(50u, tree.size());
+    EXPECT_EQ(49u, copy.size());
+    EXPECT_EQ(1, assigned[10]);
+    EXPECT_EQ(-10, tree[10]);
+}
+
+TEST(PersistentAVLTree, NodesAreFreedWithTheLastVersion)
+{
+    {
+        PersistentAVLTree<int, Live> tree;
+        std::vector<PersistentAVLTree<int, Live> > versions;
+        for (int i = 0; i < 2000; ++i) {
+            tree.insert(std::make_pair(i % 700, Live(i)));
+            if (i % 3 == 0) tree.remove((i * 7) % 700);
+            if (i % 100 == 0) versions.push_back(tree.snapshot());
+        }
+        versions.erase(versions.begin(), versions.begin() + 10);
+        EXPECT_GT(Live::count, 0);
+    }
+    EXPECT_EQ(0, Live::count);
+}
+
+TEST(PersistentAVLTree, SnapshotsCanBeReadWhileTheTreeChanges)
+{
+    PersistentAVLTree<int, int> tree;
+    std::map<int, int> expected;
+    for (int i = 0; i < 10000; ++i) {
+        tree.insert(std::make_pair(i, i));
+        expected[i] = i;
+    }
+    PersistentAVLTree<int, int> snapshot = tree.snapshot();
+
+    bool matched = false;
+    std::thread reader([&snapshot, &expected, &matched]() {
+        matched = true;
+        for (int round = 0; round < 5; ++round) {
+            matched = matched && matchesMap(snapshot, expected) && snapshot.isValid();
+        }
+    });
+    for (int i = 0; i < 10000; i += 2) {
+        tree.remove(i);
+        tree.insert(std::make_pair(i + 1, 0));
+    }
+    reader.join();
+    EXPECT_TRUE(matched);
+    EXPECT_EQ(5000u, tree.size());
+    EXPECT_TRUE(tree.isValid());
+}
+
+TEST(PersistentAVLTree, IteratorsCarryTheirPath)
+{
+    PersistentAVLTree<int, int> tree;
+    for (int i = 0; i < 100000; i += 2) {
+        tree.insert(std::make_pair(i, -i));
+    }
+
+    // Copies of an iterator walk on independently of each other
+    PersistentAVLTree<int, int>::iterator it = tree.lower_bound(501);
+    PersistentAVLTree<int, int>::iterator copy = it;
+    int expected = 502;
+    for (; it != tree.end(); ++it, expected += 2) {
+        ASSERT_EQ(expected, it->first);
+    }
+    EXPECT_EQ(100000, expected);
+    EXPECT_EQ(502, copy->first);
+    ++copy;
+    EXPECT_EQ(504, copy->first);
+    it = copy;
+    ++copy;
+    EXPECT_EQ(504, it->first);
+    EXPECT_EQ(506, copy->first);
+
+    EXPECT_EQ(-99998, tree.find(99998)->second);
+    EXPECT_TRUE(tree.find(501) == tree.end());
+    tree.remove(501);
+    EXPECT_EQ(50000u, tree.size());
+}
@@ -0,0 +1,163 @@
+#include "check_tree.h"
+
+#include "bst.h"
+#include "avlbst.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+// A scratch file, removed again at the end of each test
+class Snapshot : public testing::Test
+{
+protected:
+    Snapshot() : path_(testing::TempDir() + "tree-snapshot-test.bin") {}
+    ~Snapshot() { std::remove(path_.c_str()); }
+
+    // Overwrites bytes of the snapshot file at the given offset
+    void patch(std::streamoff offset, const void* bytes, size_t count)
+    {
+        std::fstream file(path_.c_str(), std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(offset);
+        file.write(static_cast<const char*>(bytes), count);
+    }
+
+    std::string path_;
+};
+
+TEST_F(Snapshot, HugeCountIsRejectedBeforeAllocating)
+{
+    AVLTree<int, int> tree;
+    for (int i = 0; i < 100; ++i) {
+        tree.insert(std::make_pair(i, i));
+    }
+    tree.save(path_);
+
+    // The count follows the magic and four 32-bit fields of the header
+    uint64_t count = uint64_t(1) << 60;
+    patch(24, &count, sizeof(count));
+
+    AVLTree<int, int> loaded;
+    loaded.insert(std::make_pair(-1, -1));
+    EXPECT_THROW(loaded.load(path_), std::runtime_error);
+    EXPECT_EQ(1u, loaded.size());
+}
+
+TEST_F(Snapshot, RoundTripsBetweenTreeKinds)
+{
+    AVLTree<int, double> tree;
+    std::map<int, double> expected;
+    std::vector<int> keys = randomKeys(5000, 31);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        tree.insert(std::make_pair(keys[i], keys[i] / 4.0));
+        expected[keys[i]] = keys[i] / 4.0;
+    }
+    tree.save(path_);
+
+    AVLTree<int, double> avl;
+    avl.insert(std::make_pair(-1, 0.0));
+    avl.load(path_);
+    EXPECT_TRUE(matchesMap(avl, expected));
+    EXPECT_TRUE(avl.isValid());
+
+    // Loading builds a balanced tree, whatever kind reads the file
+    BinarySearchTree<int, double> bst;
+    bst.load(path_);
+    EXPECT_TRUE(matchesMap(bst, expected));
+    EXPECT_TRUE(bst.isBalanced());
+    OrderStatisticTree<int, double> ranked;
+    ranked.load(path_);
+    EXPECT_TRUE(ranked.isValid());
+    EXPECT_EQ(expected.rbegin()->first, ranked.select(4999)->first);
+
+    AVLTree<int, double> empty;
+    empty.save(path_);
+    avl.load(path_);
+    EXPECT_TRUE(avl.empty());
+}
+
+TEST_F(Snapshot, DamagedFilesAreRejected)
+{
+    AVLTree<int, int> tree;
+    for (int i = 0; i < 100; ++i) {
+        tree.insert(std::make_pair(i, i));
+    }
+    AVLTree<int, int> loaded;
+    loaded.insert(std::make_pair(-1, -1));
+
+    EXPECT_THROW(loaded.load(path_ + ".missing"), std::runtime_error);
+
+    // Another key or value type
+    tree.save(path_);
+    AVLTree<int, int64_t> wider;
+    EXPECT_THROW(wider.load(path_), std::runtime_error);
+
+    // A flipped bit in an item fails the checksum
+    std::ifstream in(path_.c_str(), std::ios::binary | std::ios::ate);
+    std::streamoff bytes = in.tellg();
+    char flipped;
+    in.seekg(bytes / 2);
+    in.get(flipped);
+    in.close();
+    flipped ^= 0x10;
+    patch(bytes / 2, &flipped, 1);
+    EXPECT_THROW(loaded.load(path_), std::runtime_error);
+
+    // Not a snapshot at all
+    tree.save(path_);
+    patch(0, "NOTSNAP", 7);
+    EXPECT_THROW(loaded.load(path_), std::runtime_error);
+
+    // Cut short
+    tree.save(path_);
+    std::vector<char> contents(static_cast<size_t>(bytes) - 12);
+    std::ifstream head(path_.c_str(), std::ios::binary);
+    head.read(contents.data(), contents.size());
+    head.close();
+    std::ofstream(path_.c_str(), std::ios::binary | std::ios::trunc).write(contents.data(), contents.size());
+    EXPECT_THROW(loaded.load(path_), std::runtime_error);
+
+    // Intact, but in another tree's key order
+    AVLTree<int, int, std::greater<int> > descending;
+    for (int i = 0; i < 100; ++i) {
+        descending.insert(std::make_pair(i, i));
+    }
+    descending.save(path_);
+    EXPECT_THROW(loaded.load(path_), std::runtime_error);
+
+    // A failed load leaves the tree as it was
+    EXPECT_EQ(1u, loaded.size());
+    EXPECT_EQ(-1, loaded[-1]);
+}
+
+TEST_F(Snapshot, WriterSavesItemsHeldOutsideATree)
+{
+    typedef AVLTree<int, double> Tree;
+    std::vector<std::pair<int, double> > items;
+    std::map<int, double> expected;
+    for (int i = 0; i < 100000; i += 3) {
+        items.push_back(std::make_pair(i, i / 2.0));
+        expected[i] = i / 2.0;
+    }
+    Tree::SnapshotWriter writer(path_, items.size());
+    for (size_t i = 0; i < items.size(); ++i) {
+        writer.write(items[i].first, items[i].second);
+    }
+    writer.finish();
+
+    Tree loaded;
+    loaded.load(path_);
+    EXPECT_TRUE(matchesMap(loaded, expected));
+    EXPECT_TRUE(loaded.isValid());
+
+    // The count given up front must match the items written
+    Tree::SnapshotWriter tooFew(path_, 2);
+    tooFew.write(1, 1.0);
+    EXPECT_THROW(tooFew.finish(), std::logic_error);
+    Tree::SnapshotWriter tooMany(path_, 1);
+    tooMany.write(1, 1.0);
+    EXPECT_THROW(tooMany.write(2, 2.0), std::logic_error);
+}